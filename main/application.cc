@@ -9,6 +9,7 @@
 #include "mcp_server.h"
 #include "assets.h"
 #include "settings.h"
+#include "pipeline_trace.h"
 
 #include <cstring>
 #include <esp_log.h>
@@ -381,6 +382,10 @@ void Application::Start() {
         vTaskDelete(NULL);
     }, "main_event_loop", 2048 * 4, this, 3, &main_event_loop_task_handle_);
 
+    // Blocking work offloaded from the main event loop, same stack as the main loop since it runs MCP tools.
+    // The workers are started by the first work sent to them.
+    scheduler_.SetWorkers(CONFIG_SCHEDULE_WORKER_TASKS, SCHEDULE_WORKER_TASK_PRIORITY, 2048 * 4);
+
     /* Start the clock timer to update the status bar */
     esp_timer_start_periodic(clock_timer_handle_, 1000000);
 
@@ -414,6 +419,12 @@ void Application::Start() {
         protocol_ = std::make_unique<MqttProtocol>();
     }
 
+    // Uplink audio is written by its own task above the main event loop, so it never waits for control work
+    xTaskCreate([](void* arg) {
+        ((Application*)arg)->AudioSendTask();
+        vTaskDelete(NULL);
+    }, "audio_send", 2048 * 3, this, AUDIO_SEND_TASK_PRIORITY, &audio_send_task_handle_);
+
     protocol_->OnConnected([this]() {
         DismissAlert();
     });
@@ -423,8 +434,11 @@ void Application::Start() {
         xEventGroupSetBits(event_group_, MAIN_EVENT_ERROR);
     });
     protocol_->OnIncomingAudio([this](std::unique_ptr<AudioStreamPacket> packet) {
+        PIPELINE_TRACE(kTraceReceive, packet->sequence);
         if (device_state_ == kDeviceStateSpeaking) {
             audio_service_.PushPacketToDecodeQueue(std::move(packet));
+        } else {
+            audio_service_.ReleasePacket(std::move(packet));
         }
     });
     protocol_->OnAudioChannelOpened([this, codec, &board]() {
@@ -433,6 +447,8 @@ void Application::Start() {
             ESP_LOGW(TAG, "Server sample rate %d does not match device output sample rate %d, resampling may cause distortion",
                 protocol_->server_sample_rate(), codec->output_sample_rate());
         }
+        audio_service_.SetUplinkAudioParams(protocol_->uplink_frame_duration(), protocol_->uplink_complexity(),
+            protocol_->uplink_adaptive());
     });
     protocol_->OnAudioChannelClosed([this, &board]() {
         board.SetPowerSaveMode(true);
@@ -448,29 +464,16 @@ void Application::Start() {
         if (strcmp(type->valuestring, "tts") == 0) {
             auto state = cJSON_GetObjectItem(root, "state");
             if (strcmp(state->valuestring, "start") == 0) {
-                Schedule([this]() {
-                    aborted_ = false;
-                    if (device_state_ == kDeviceStateIdle || device_state_ == kDeviceStateListening) {
-                        SetDeviceState(kDeviceStateSpeaking);
-                    }
-                });
+                OnTtsStart();
             } else if (strcmp(state->valuestring, "stop") == 0) {
-                Schedule([this]() {
-                    if (device_state_ == kDeviceStateSpeaking) {
-                        if (listening_mode_ == kListeningModeManualStop) {
-                            SetDeviceState(kDeviceStateIdle);
-                        } else {
-                            SetDeviceState(kDeviceStateListening);
-                        }
-                    }
-                });
+                OnTtsStop();
             } else if (strcmp(state->valuestring, "sentence_start") == 0) {
                 auto text = cJSON_GetObjectItem(root, "text");
                 if (cJSON_IsString(text)) {
                     ESP_LOGI(TAG, "<< %s", text->valuestring);
                     Schedule([this, display, message = std::string(text->valuestring)]() {
                         display->SetChatMessage("assistant", message.c_str());
-                    });
+                    }, kTaskPriorityBackground);
                 }
             }
         } else if (strcmp(type->valuestring, "stt") == 0) {
@@ -479,14 +482,14 @@ void Application::Start() {
                 ESP_LOGI(TAG, ">> %s", text->valuestring);
                 Schedule([this, display, message = std::string(text->valuestring)]() {
                     display->SetChatMessage("user", message.c_str());
-                });
+                }, kTaskPriorityBackground);
             }
         } else if (strcmp(type->valuestring, "llm") == 0) {
             auto emotion = cJSON_GetObjectItem(root, "emotion");
             if (cJSON_IsString(emotion)) {
                 Schedule([this, display, emotion_str = std::string(emotion->valuestring)]() {
                     display->SetEmotion(emotion_str.c_str());
-                });
+                }, kTaskPriorityBackground);
             }
         } else if (strcmp(type->valuestring, "mcp") == 0) {
             auto payload = cJSON_GetObjectItem(root, "payload");
@@ -531,6 +534,37 @@ void Application::Start() {
             ESP_LOGW(TAG, "Unknown message type: %s", type->valuestring);
         }
     });
+    // Binary encodings of the frequent messages above, see CONTROL_MESSAGE_TYPE
+    protocol_->OnIncomingControl([this, display](uint8_t type, std::string&& text) {
+        switch (type) {
+            case kControlTtsStart:
+                OnTtsStart();
+                break;
+            case kControlTtsStop:
+                OnTtsStop();
+                break;
+            case kControlTtsSentence:
+                ESP_LOGI(TAG, "<< %s", text.c_str());
+                Schedule([display, message = std::move(text)]() {
+                    display->SetChatMessage("assistant", message.c_str());
+                }, kTaskPriorityBackground);
+                break;
+            case kControlStt:
+                ESP_LOGI(TAG, ">> %s", text.c_str());
+                Schedule([display, message = std::move(text)]() {
+                    display->SetChatMessage("user", message.c_str());
+                }, kTaskPriorityBackground);
+                break;
+            case kControlEmotion:
+                Schedule([display, emotion = std::move(text)]() {
+                    display->SetEmotion(emotion.c_str());
+                }, kTaskPriorityBackground);
+                break;
+            default:
+                ESP_LOGW(TAG, "Unknown control message: %02x", type);
+                break;
+        }
+    });
     bool protocol_started = protocol_->Start();
 
     SystemInfo::PrintHeapStats();
@@ -546,22 +580,48 @@ void Application::Start() {
     }
 }
 
+// Server audio is dropped until the speaking state is entered, so these run ahead of the other tasks
+void Application::OnTtsStart() {
+    Schedule([this]() {
+        aborted_ = false;
+        if (device_state_ == kDeviceStateIdle || device_state_ == kDeviceStateListening) {
+            SetDeviceState(kDeviceStateSpeaking);
+        }
+    }, kTaskPriorityAudio, SCHEDULE_AUDIO_DEADLINE_MS);
+}
+
+void Application::OnTtsStop() {
+    Schedule([this]() {
+        if (device_state_ == kDeviceStateSpeaking) {
+            if (listening_mode_ == kListeningModeManualStop) {
+                SetDeviceState(kDeviceStateIdle);
+            } else {
+                SetDeviceState(kDeviceStateListening);
+            }
+        }
+    }, kTaskPriorityAudio, SCHEDULE_AUDIO_DEADLINE_MS);
+}
+
 // Add a async task to MainLoop
-void Application::Schedule(std::function<void()> callback) {
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        main_tasks_.push_back(std::move(callback));
-    }
+void Application::Schedule(std::function<void()> callback, TaskPriority priority, int deadline_ms, const char* caller,
+    const char* file, int line) {
+    scheduler_.Push(std::move(callback), priority, deadline_ms, caller, file, line);
     xEventGroupSetBits(event_group_, MAIN_EVENT_SCHEDULE);
 }
 
+void Application::ScheduleWorker(std::function<void()> callback, const char* caller, const char* file, int line) {
+    // Without a worker the work runs in the main loop at background priority
+    if (!scheduler_.PushToWorker(std::move(callback), caller, file, line)) {
+        Schedule(std::move(callback), kTaskPriorityBackground, 0, caller, file, line);
+    }
+}
+
 // The Main Event Loop controls the chat state and websocket connection
 // If other tasks need to access the websocket or chat state,
 // they should use Schedule to call this function
 void Application::MainEventLoop() {
     while (true) {
         auto bits = xEventGroupWaitBits(event_group_, MAIN_EVENT_SCHEDULE |
-            MAIN_EVENT_SEND_AUDIO |
             MAIN_EVENT_WAKE_WORD_DETECTED |
             MAIN_EVENT_VAD_CHANGE |
             MAIN_EVENT_CLOCK_TICK |
@@ -572,14 +632,6 @@ void Application::MainEventLoop() {
             Alert(Lang::Strings::ERROR, last_error_message_.c_str(), "circle_xmark", Lang::Sounds::OGG_EXCLAMATION);
         }
 
-        if (bits & MAIN_EVENT_SEND_AUDIO) {
-            while (auto packet = audio_service_.PopPacketFromSendQueue()) {
-                if (protocol_ && !protocol_->SendAudio(std::move(packet))) {
-                    break;
-                }
-            }
-        }
-
         if (bits & MAIN_EVENT_WAKE_WORD_DETECTED) {
             OnWakeWordDetected();
         }
@@ -592,11 +644,8 @@ void Application::MainEventLoop() {
         }
 
         if (bits & MAIN_EVENT_SCHEDULE) {
-            std::unique_lock<std::mutex> lock(mutex_);
-            auto tasks = std::move(main_tasks_);
-            lock.unlock();
-            for (auto& task : tasks) {
-                task();
+            if (scheduler_.RunPending()) {
+                xEventGroupSetBits(event_group_, MAIN_EVENT_SCHEDULE);
             }
         }
 
@@ -610,11 +659,68 @@ void Application::MainEventLoop() {
                 // SystemInfo::PrintTaskCpuUsage(pdMS_TO_TICKS(1000));
                 // SystemInfo::PrintTaskList();
                 SystemInfo::PrintHeapStats();
+                audio_service_.PrintPipelineStats();
+#if CONFIG_USE_SCHEDULE_STATS
+                scheduler_.PrintStats();
+#endif
+            }
+
+#if CONFIG_USE_PIPELINE_TRACE
+            // The protocol is created once the network is up, earlier records wait in the rings
+            if (protocol_) {
+                PipelineTrace::GetInstance().Export();
+            }
+#endif
+
+#if CONFIG_PREWARM_AUDIO_CHANNEL
+            // Keep the server connection ready while waiting for the wake word. Connecting blocks for
+            // seconds, so it runs on a worker and is not queued again until the previous one finished.
+            if (protocol_ && device_state_ == kDeviceStateIdle && !prewarm_pending_.exchange(true)) {
+                ScheduleWorker([this]() {
+                    // A copy, so Reboot() can release protocol_ without waiting for the connect
+                    std::shared_ptr<Protocol> protocol;
+                    {
+                        std::lock_guard<std::mutex> lock(audio_send_mutex_);
+                        protocol = protocol_;
+                    }
+                    if (protocol) {
+                        protocol->PrewarmAudioChannel();
+                    }
+                    prewarm_pending_ = false;
+                });
+            }
+#endif
+
+            // Report network stats of the audio channel if the server asked for them
+            if (protocol_ && protocol_->stats_interval() > 0 && clock_ticks_ % protocol_->stats_interval() == 0 &&
+                protocol_->IsAudioChannelOpened()) {
+                protocol_->SendAudioChannelStats();
             }
         }
     }
 }
 
+// Drains the audio send queue, protocols lock their own send state against the main event loop.
+// protocol_ is only used under audio_send_mutex_, Reboot() releases it on another task.
+void Application::AudioSendTask() {
+    while (true) {
+        xEventGroupWaitBits(event_group_, MAIN_EVENT_SEND_AUDIO, pdTRUE, pdFALSE, portMAX_DELAY);
+        std::lock_guard<std::mutex> lock(audio_send_mutex_);
+        if (!protocol_) {
+            continue;
+        }
+        while (auto packet = audio_service_.PopPacketFromSendQueue()) {
+            int64_t encoded_time_us = packet->encoded_time_us;
+            size_t size = packet->payload.size();
+            if (!protocol_->SendAudio(std::move(packet))) {
+                break;
+            }
+            audio_service_.RecordPacketSent(encoded_time_us);
+            PIPELINE_TRACE(kTraceSend, size);
+        }
+    }
+}
+
 void Application::OnWakeWordDetected() {
     if (!protocol_) {
         return;
@@ -622,10 +728,13 @@ void Application::OnWakeWordDetected() {
 
     if (device_state_ == kDeviceStateIdle) {
         audio_service_.EncodeWakeWord();
+        // Capture what is said right after the wake word while the channel opens
+        audio_service_.StartPreroll();
 
         if (!protocol_->IsAudioChannelOpened()) {
             SetDeviceState(kDeviceStateConnecting);
             if (!protocol_->OpenAudioChannel()) {
+                audio_service_.EnableVoiceProcessing(false);
                 audio_service_.EnableWakeWordDetection(true);
                 return;
             }
@@ -675,6 +784,7 @@ void Application::SetDeviceState(DeviceState state) {
     auto previous_state = device_state_;
     device_state_ = state;
     ESP_LOGI(TAG, "STATE: %s", STATE_STRINGS[device_state_]);
+    PIPELINE_TRACE(kTraceStateChange, state);
 
     // Send the state change event
     DeviceStateEventManager::GetInstance().PostStateChangeEvent(previous_state, state);
@@ -701,7 +811,11 @@ void Application::SetDeviceState(DeviceState state) {
             display->SetEmotion("neutral");
 
             // Make sure the audio processor is running
-            if (!audio_service_.IsAudioProcessorRunning()) {
+            if (audio_service_.IsPrerolling()) {
+                // Voice processing started at the wake word, send what was said while connecting
+                protocol_->SendStartListening(listening_mode_);
+                audio_service_.FinishPreroll();
+            } else if (!audio_service_.IsAudioProcessorRunning()) {
                 // Send the start listening command
                 protocol_->SendStartListening(listening_mode_);
                 audio_service_.EnableVoiceProcessing(true);
@@ -730,7 +844,10 @@ void Application::Reboot() {
     if (protocol_ && protocol_->IsAudioChannelOpened()) {
         protocol_->CloseAudioChannel();
     }
-    protocol_.reset();
+    {
+        std::lock_guard<std::mutex> lock(audio_send_mutex_);
+        protocol_.reset();
+    }
     audio_service_.Stop();
 
     vTaskDelay(pdMS_TO_TICKS(1000));
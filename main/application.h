@@ -10,11 +10,13 @@
 #include <mutex>
 #include <deque>
 #include <memory>
+#include <atomic>
 
 #include "protocol.h"
 #include "ota.h"
 #include "audio_service.h"
 #include "device_state_event.h"
+#include "task_scheduler.h"
 
 
 #define MAIN_EVENT_SCHEDULE (1 << 0)
@@ -25,6 +27,11 @@
 #define MAIN_EVENT_CHECK_NEW_VERSION_DONE (1 << 5)
 #define MAIN_EVENT_CLOCK_TICK (1 << 6)
 
+#define AUDIO_SEND_TASK_PRIORITY CONFIG_AUDIO_SEND_TASK_PRIORITY
+#define SCHEDULE_WORKER_TASK_PRIORITY 2
+// Scheduled changes to the audio flow should not wait longer than about two Opus frames
+#define SCHEDULE_AUDIO_DEADLINE_MS 120
+
 
 enum AecMode {
     kAecOff,
@@ -46,7 +53,12 @@ public:
     void MainEventLoop();
     DeviceState GetDeviceState() const { return device_state_; }
     bool IsVoiceDetected() const { return audio_service_.IsVoiceDetected(); }
-    void Schedule(std::function<void()> callback);
+    // Runs the callback in the main event loop, the caller location is only used for statistics
+    void Schedule(std::function<void()> callback, TaskPriority priority = kTaskPriorityControl, int deadline_ms = 0,
+        const char* caller = __builtin_FUNCTION(), const char* file = __builtin_FILE(), int line = __builtin_LINE());
+    // Runs long blocking work on a worker task, or in the main event loop at background priority if there is none
+    void ScheduleWorker(std::function<void()> callback,
+        const char* caller = __builtin_FUNCTION(), const char* file = __builtin_FILE(), int line = __builtin_LINE());
     void SetDeviceState(DeviceState state);
     void Alert(const char* status, const char* message, const char* emotion = "", const std::string_view& sound = "");
     void DismissAlert();
@@ -68,9 +80,9 @@ private:
     Application();
     ~Application();
 
-    std::mutex mutex_;
-    std::deque<std::function<void()>> main_tasks_;
-    std::unique_ptr<Protocol> protocol_;
+    TaskScheduler scheduler_;
+    // Shared so the prewarm worker can keep the protocol alive through a connect without holding a lock
+    std::shared_ptr<Protocol> protocol_;
     EventGroupHandle_t event_group_ = nullptr;
     esp_timer_handle_t clock_timer_handle_ = nullptr;
     volatile DeviceState device_state_ = kDeviceStateUnknown;
@@ -84,8 +96,16 @@ private:
     int clock_ticks_ = 0;
     TaskHandle_t check_new_version_task_handle_ = nullptr;
     TaskHandle_t main_event_loop_task_handle_ = nullptr;
+    TaskHandle_t audio_send_task_handle_ = nullptr;
+    // Held by the audio send task while it uses protocol_, so Reboot() can release the protocol safely
+    std::mutex audio_send_mutex_;
+    // A prewarm is queued on or running on the worker
+    std::atomic<bool> prewarm_pending_{false};
 
+    void AudioSendTask();
     void OnWakeWordDetected();
+    void OnTtsStart();
+    void OnTtsStop();
     void CheckNewVersion(Ota& ota);
     void CheckAssetsVersion();
     void ShowActivationCode(const std::string& code, const std::string& message);
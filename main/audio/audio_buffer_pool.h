@@ -0,0 +1,51 @@
+#ifndef AUDIO_BUFFER_POOL_H
+#define AUDIO_BUFFER_POOL_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+ * A bounded free list of audio frames / packets.
+ *
+ * Released objects keep the capacity of their vectors, so once the pipeline has
+ * reached its steady state, frames are recycled instead of being freed and
+ * allocated again, which keeps the internal SRAM from fragmenting over long sessions.
+ *
+ * Acquired objects keep the contents they had when they were released,
+ * the caller must set every field.
+ */
+template <typename T>
+class AudioBufferPool {
+public:
+    explicit AudioBufferPool(size_t max_size) : max_size_(max_size) {
+        free_.reserve(max_size);
+    }
+
+    std::unique_ptr<T> Acquire() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_.empty()) {
+            return std::make_unique<T>();
+        }
+        auto item = std::move(free_.back());
+        free_.pop_back();
+        return item;
+    }
+
+    void Release(std::unique_ptr<T> item) {
+        if (item == nullptr) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_.size() < max_size_) {
+            free_.push_back(std::move(item));
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    size_t max_size_;
+    std::vector<std::unique_ptr<T>> free_;
+};
+
+#endif // AUDIO_BUFFER_POOL_H
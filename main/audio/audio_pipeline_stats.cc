@@ -0,0 +1,106 @@
+#include "audio_pipeline_stats.h"
+
+#include <algorithm>
+#include <esp_log.h>
+#include <esp_system.h>
+#include <esp_heap_caps.h>
+
+#define TAG "AudioPipelineStats"
+
+static const char* const STAGE_NAMES[] = {
+    "encode_wait",
+    "encode",
+    "decode",
+    "playback_wait",
+    "output",
+    "send",
+};
+
+int LatencyRecorder::BucketIndex(uint32_t us) {
+    if (us < AUDIO_LATENCY_SUB_BUCKETS) {
+        return us;
+    }
+    // The top two bits below the leading one select the sub bucket
+    int msb = 31 - __builtin_clz(us);
+    int index = AUDIO_LATENCY_SUB_BUCKETS * (msb - 1) + ((us >> (msb - 2)) & (AUDIO_LATENCY_SUB_BUCKETS - 1));
+    return std::min(index, AUDIO_LATENCY_BUCKETS - 1);
+}
+
+uint32_t LatencyRecorder::BucketUpperBound(int index) {
+    if (index < AUDIO_LATENCY_SUB_BUCKETS) {
+        return index;
+    }
+    int shift = index / AUDIO_LATENCY_SUB_BUCKETS - 1;
+    int sub = index % AUDIO_LATENCY_SUB_BUCKETS;
+    return ((uint32_t)(AUDIO_LATENCY_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+void LatencyRecorder::Add(uint32_t us) {
+    buckets_[BucketIndex(us)]++;
+    count_++;
+    max_ = std::max(max_, us);
+}
+
+void LatencyRecorder::Reset() {
+    std::fill(buckets_, buckets_ + AUDIO_LATENCY_BUCKETS, 0);
+    count_ = 0;
+    max_ = 0;
+}
+
+uint32_t LatencyRecorder::Percentile(int percent) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    // Rank of the sample, counted from 1, that the percentile falls on
+    uint32_t rank = std::max<uint32_t>(1, ((uint64_t)count_ * percent + 99) / 100);
+    uint32_t seen = 0;
+    for (int i = 0; i < AUDIO_LATENCY_BUCKETS; i++) {
+        seen += buckets_[i];
+        if (seen >= rank) {
+            return std::min(BucketUpperBound(i), max_);
+        }
+    }
+    return max_;
+}
+
+void AudioPipelineStats::Record(AudioPipelineStage stage, int64_t start_time_us) {
+    if (start_time_us <= 0) {
+        return;
+    }
+    int64_t elapsed = esp_timer_get_time() - start_time_us;
+    std::lock_guard<std::mutex> lock(mutex_);
+    recorders_[stage].Add(elapsed > 0 ? (uint32_t)elapsed : 0);
+    frames_[stage]++;
+}
+
+void AudioPipelineStats::CountUnderrun() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    underruns_++;
+}
+
+void AudioPipelineStats::Print() {
+    int64_t now = esp_timer_get_time();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    float seconds = last_print_time_us_ > 0 ? (now - last_print_time_us_) / 1000000.0f : 0;
+    last_print_time_us_ = now;
+
+    for (int i = 0; i < kAudioStageCount; i++) {
+        auto& recorder = recorders_[i];
+        uint32_t frames = frames_[i];
+        frames_[i] = 0;
+        if (recorder.count() > 0) {
+            ESP_LOGI(TAG, "%-13s p50=%lu p90=%lu p99=%lu max=%lu us, %.1f fps",
+                STAGE_NAMES[i],
+                recorder.Percentile(50), recorder.Percentile(90), recorder.Percentile(99), recorder.max(),
+                seconds > 0 ? frames / seconds : 0.0f);
+        }
+        recorder.Reset();
+    }
+
+    ESP_LOGI(TAG, "playback underruns: %lu", underruns_);
+    underruns_ = 0;
+    ESP_LOGI(TAG, "free heap: %lu, minimal heap: %lu, largest internal block: %u",
+        esp_get_free_heap_size(), esp_get_minimum_free_heap_size(),
+        heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+}
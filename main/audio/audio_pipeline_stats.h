@@ -0,0 +1,62 @@
+#ifndef AUDIO_PIPELINE_STATS_H
+#define AUDIO_PIPELINE_STATS_H
+
+#include <cstdint>
+#include <mutex>
+
+#include <esp_timer.h>
+
+// Four buckets per power of two up to 2^24 us (16.7 s), slower samples land in the last bucket
+#define AUDIO_LATENCY_SUB_BUCKETS 4
+#define AUDIO_LATENCY_MAX_BITS 24
+#define AUDIO_LATENCY_BUCKETS (AUDIO_LATENCY_SUB_BUCKETS * (AUDIO_LATENCY_MAX_BITS - 1))
+
+enum AudioPipelineStage {
+    kAudioStageEncodeWait,      // PCM frame waiting in the encode queue
+    kAudioStageEncode,          // Opus encode
+    kAudioStageDecode,          // Opus decode + output resampling
+    kAudioStagePlaybackWait,    // PCM frame waiting in the playback queue
+    kAudioStageOutput,          // Codec write (I2S)
+    kAudioStageSend,            // Encoded frame waiting in the send queue + socket write
+    kAudioStageCount,
+};
+
+/*
+ * Log-linear histogram of the latency samples of one pipeline stage, so every sample of the print interval
+ * counts no matter how many frames there were. A percentile is the upper bound of its bucket, within 25%
+ * of the real value and never above the exact maximum.
+ */
+class LatencyRecorder {
+public:
+    void Add(uint32_t us);
+    void Reset();
+    // percent in 0..100, returns 0 when there are no samples
+    uint32_t Percentile(int percent) const;
+    uint32_t count() const { return count_; }
+    uint32_t max() const { return max_; }
+
+    static int BucketIndex(uint32_t us);
+    static uint32_t BucketUpperBound(int index);
+
+private:
+    uint32_t buckets_[AUDIO_LATENCY_BUCKETS] = {0};
+    uint32_t count_ = 0;
+    uint32_t max_ = 0;
+};
+
+class AudioPipelineStats {
+public:
+    void Record(AudioPipelineStage stage, int64_t start_time_us);
+    // Playback ran dry while packets were still waiting to be decoded
+    void CountUnderrun();
+    void Print();
+
+private:
+    std::mutex mutex_;
+    LatencyRecorder recorders_[kAudioStageCount];
+    uint32_t frames_[kAudioStageCount] = {0};
+    uint32_t underruns_ = 0;
+    int64_t last_print_time_us_ = 0;
+};
+
+#endif // AUDIO_PIPELINE_STATS_H
@@ -1,6 +1,10 @@
 #include "audio_service.h"
 #include <esp_log.h>
 #include <cstring>
+#include <algorithm>
+
+#include "pcm_kernels.h"
+#include "pipeline_trace.h"
 
 #if CONFIG_USE_AUDIO_PROCESSOR
 #include "processors/afe_audio_processor.h"
@@ -36,7 +40,6 @@ void AudioService::Initialize(AudioCodec* codec) {
     /* Setup the audio codec */
     opus_decoder_ = std::make_unique<OpusDecoderWrapper>(codec->output_sample_rate(), 1, OPUS_FRAME_DURATION_MS);
     opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_->SetComplexity(0);
 
     if (codec->input_sample_rate() != 16000) {
         input_resampler_.Configure(codec->input_sample_rate(), 16000);
@@ -50,6 +53,7 @@ void AudioService::Initialize(AudioCodec* codec) {
 #endif
 
     audio_processor_->OnOutput([this](std::vector<int16_t>&& data) {
+        PIPELINE_TRACE(kTraceAfeOutput, data.size());
         PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(data));
     });
 
@@ -109,12 +113,19 @@ void AudioService::Start() {
     }, "audio_output", 2048, this, 4, &audio_output_task_handle_);
 #endif
 
-    /* Start the opus codec task */
-    xTaskCreate([](void* arg) {
+    /* Start the opus decode task, it runs above the encode task so a long encode never delays playback */
+    xTaskCreatePinnedToCore([](void* arg) {
+        AudioService* audio_service = (AudioService*)arg;
+        audio_service->OpusDecodeTask();
+        vTaskDelete(NULL);
+    }, "opus_decode", OPUS_DECODE_TASK_STACK_SIZE, this, OPUS_DECODE_TASK_PRIORITY, &opus_decode_task_handle_, OPUS_DECODE_TASK_CORE);
+
+    /* Start the opus encode task */
+    xTaskCreatePinnedToCore([](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
-        audio_service->OpusCodecTask();
+        audio_service->OpusEncodeTask();
         vTaskDelete(NULL);
-    }, "opus_codec", 2048 * 13, this, 2, &opus_codec_task_handle_);
+    }, "opus_encode", 2048 * 13, this, OPUS_ENCODE_TASK_PRIORITY, &opus_encode_task_handle_, OPUS_ENCODE_TASK_CORE);
 }
 
 void AudioService::Stop() {
@@ -126,13 +137,16 @@ void AudioService::Stop() {
 
     std::lock_guard<std::mutex> lock(audio_queue_mutex_);
     audio_encode_queue_.clear();
-    audio_decode_queue_.clear();
+    audio_decode_queue_.Clear();
     audio_playback_queue_.clear();
     audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    audio_preroll_queue_.clear();
+    NotifyAllQueueWaiters();
 }
 
 bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples) {
+    // Never contended in normal operation, the AFSK receiver only reads while the device configures Wi-Fi
+    std::lock_guard<std::mutex> lock(input_mutex_);
     if (!codec_->input_enabled()) {
         esp_timer_stop(audio_power_timer_);
         esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
@@ -140,31 +154,11 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
     }
 
     if (codec_->input_sample_rate() != sample_rate) {
-        data.resize(samples * codec_->input_sample_rate() / sample_rate * codec_->input_channels());
-        if (!codec_->InputData(data)) {
+        input_buffer_.resize(samples * codec_->input_sample_rate() / sample_rate * codec_->input_channels());
+        if (!codec_->InputData(input_buffer_)) {
             return false;
         }
-        if (codec_->input_channels() == 2) {
-            auto mic_channel = std::vector<int16_t>(data.size() / 2);
-            auto reference_channel = std::vector<int16_t>(data.size() / 2);
-            for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
-                mic_channel[i] = data[j];
-                reference_channel[i] = data[j + 1];
-            }
-            auto resampled_mic = std::vector<int16_t>(input_resampler_.GetOutputSamples(mic_channel.size()));
-            auto resampled_reference = std::vector<int16_t>(reference_resampler_.GetOutputSamples(reference_channel.size()));
-            input_resampler_.Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
-            reference_resampler_.Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
-            data.resize(resampled_mic.size() + resampled_reference.size());
-            for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
-                data[j] = resampled_mic[i];
-                data[j + 1] = resampled_reference[i];
-            }
-        } else {
-            auto resampled = std::vector<int16_t>(input_resampler_.GetOutputSamples(data.size()));
-            input_resampler_.Process(data.data(), data.size(), resampled.data());
-            data = std::move(resampled);
-        }
+        ResampleInput(input_buffer_, codec_->input_channels(), data);
     } else {
         data.resize(samples * codec_->input_channels());
         if (!codec_->InputData(data)) {
@@ -175,6 +169,7 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
     /* Update the last input time */
     last_input_time_ = std::chrono::steady_clock::now();
     debug_statistics_.input_count++;
+    PIPELINE_TRACE(kTraceMicRead, data.size());
 
 #if CONFIG_USE_AUDIO_DEBUGGER
     // 音频调试：发送原始音频数据
@@ -187,7 +182,34 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
     return true;
 }
 
+void AudioService::ResampleInput(const std::vector<int16_t>& input, int channels, std::vector<int16_t>& output) {
+    if (channels != 2) {
+        output.resize(input_resampler_.GetOutputSamples(input.size()));
+        input_resampler_.Process(input.data(), input.size(), output.data());
+        return;
+    }
+
+    // Mic and reference are split into the two halves of one scratch buffer, resampled separately
+    // and interleaved straight into the output. The buffers only grow, so steady state does not allocate.
+    size_t frames = input.size() / 2;
+    size_t output_frames = input_resampler_.GetOutputSamples(frames);
+    input_channels_buffer_.resize(frames * 2);
+    resampled_channels_buffer_.resize(output_frames * 2);
+    int16_t* mic = input_channels_buffer_.data();
+    int16_t* reference = mic + frames;
+    int16_t* resampled_mic = resampled_channels_buffer_.data();
+    int16_t* resampled_reference = resampled_mic + output_frames;
+
+    PcmDeinterleave(input.data(), mic, reference, frames);
+    input_resampler_.Process(mic, frames, resampled_mic);
+    reference_resampler_.Process(reference, frames, resampled_reference);
+    output.resize(output_frames * 2);
+    PcmInterleave(resampled_mic, resampled_reference, output.data(), output_frames);
+}
+
 void AudioService::AudioInputTask() {
+    // Reused across reads, PushTaskToEncodeQueue swaps in a recycled buffer when it takes the data
+    std::vector<int16_t> data;
     while (true) {
         EventBits_t bits = xEventGroupWaitBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING |
             AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING,
@@ -204,21 +226,17 @@ void AudioService::AudioInputTask() {
 
         /* Used for audio testing in NetworkConfiguring mode by clicking the BOOT button */
         if (bits & AS_EVENT_AUDIO_TESTING_RUNNING) {
-            if (audio_testing_queue_.size() >= AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS) {
+            if (audio_testing_queue_.size() >= (size_t)(AUDIO_TESTING_MAX_DURATION_MS / frame_duration_ms_)) {
                 ESP_LOGW(TAG, "Audio testing queue is full, stopping audio testing");
                 EnableAudioTesting(false);
                 continue;
             }
-            std::vector<int16_t> data;
-            int samples = OPUS_FRAME_DURATION_MS * 16000 / 1000;
+            int samples = frame_duration_ms_ * 16000 / 1000;
             if (ReadAudioData(data, 16000, samples)) {
                 // If input channels is 2, we need to fetch the left channel data
                 if (codec_->input_channels() == 2) {
-                    auto mono_data = std::vector<int16_t>(data.size() / 2);
-                    for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-                        mono_data[i] = data[j];
-                    }
-                    data = std::move(mono_data);
+                    PcmExtractChannel(data.data(), data.data(), data.size() / 2, 2, 0);
+                    data.resize(data.size() / 2);
                 }
                 PushTaskToEncodeQueue(kAudioTaskTypeEncodeToTestingQueue, std::move(data));
                 continue;
@@ -227,7 +245,6 @@ void AudioService::AudioInputTask() {
 
         /* Feed the wake word */
         if (bits & AS_EVENT_WAKE_WORD_RUNNING) {
-            std::vector<int16_t> data;
             int samples = wake_word_->GetFeedSize();
             if (samples > 0) {
                 if (ReadAudioData(data, 16000, samples)) {
@@ -239,7 +256,6 @@ void AudioService::AudioInputTask() {
 
         /* Feed the audio processor */
         if (bits & AS_EVENT_AUDIO_PROCESSOR_RUNNING) {
-            std::vector<int16_t> data;
             int samples = audio_processor_->GetFeedSize();
             if (samples > 0) {
                 if (ReadAudioData(data, 16000, samples)) {
@@ -257,24 +273,54 @@ void AudioService::AudioInputTask() {
 }
 
 void AudioService::AudioOutputTask() {
+    // The codec still has about the last written frame to play, the next one has that long to arrive
+    int64_t frame_duration_us = 0;
     while (true) {
         std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() { return !audio_playback_queue_.empty() || service_stopped_; });
+        auto ready = [this]() { return !audio_playback_queue_.empty() || service_stopped_; };
+        if (!audio_playback_cv_.wait_for(lock, std::chrono::microseconds(frame_duration_us), ready)) {
+            /* Playback ran dry in the middle of a stream, let the jitter buffer build up its target delay again */
+            if (audio_decode_queue_.playing()) {
+                audio_decode_queue_.Rebuffer();
+            }
+#if CONFIG_USE_AUDIO_PIPELINE_STATS
+            /* The decoder did not keep up with playback although packets were waiting */
+            if (frame_duration_us > 0 && !audio_decode_queue_.empty()) {
+                pipeline_stats_.CountUnderrun();
+            }
+#endif
+            /* Nothing more to play until the next frame */
+            frame_duration_us = 0;
+        }
+        audio_playback_cv_.wait(lock, ready);
         if (service_stopped_) {
             break;
         }
 
+        bool was_full = audio_playback_queue_.size() >= MAX_PLAYBACK_TASKS_IN_QUEUE;
         auto task = std::move(audio_playback_queue_.front());
         audio_playback_queue_.pop_front();
-        audio_queue_cv_.notify_all();
         lock.unlock();
+        // Only the decode task waits for playback queue space
+        if (was_full) {
+            audio_decode_cv_.notify_one();
+        }
 
         if (!codec_->output_enabled()) {
             esp_timer_stop(audio_power_timer_);
             esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
             codec_->EnableOutput(true);
         }
+#if CONFIG_USE_AUDIO_PIPELINE_STATS
+        pipeline_stats_.Record(kAudioStagePlaybackWait, task->enqueue_time_us);
+        int64_t output_start_time = esp_timer_get_time();
+        codec_->OutputData(task->pcm);
+        pipeline_stats_.Record(kAudioStageOutput, output_start_time);
+#else
         codec_->OutputData(task->pcm);
+#endif
+        PIPELINE_TRACE(kTraceI2sWrite, task->pcm.size());
+        frame_duration_us = (int64_t)task->pcm.size() * 1000000 / codec_->output_sample_rate();
 
         /* Update the last output time */
         last_output_time_ = std::chrono::steady_clock::now();
@@ -285,90 +331,187 @@ void AudioService::AudioOutputTask() {
         if (task->timestamp > 0) {
             lock.lock();
             timestamp_queue_.push_back(task->timestamp);
+            lock.unlock();
         }
 #endif
+        audio_task_pool_.Release(std::move(task));
     }
 
     ESP_LOGW(TAG, "Audio output task stopped");
 }
 
-void AudioService::OpusCodecTask() {
+void AudioService::OpusDecodeTask() {
+    bool stack_logged = false;
     while (true) {
         std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() {
+        std::unique_ptr<AudioStreamPacket> packet;
+        bool was_full = false;
+        while (!service_stopped_) {
+            if (audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE) {
+                int64_t now = esp_timer_get_time();
+                was_full = audio_decode_queue_.duration_ms() >= MAX_DECODE_QUEUE_DURATION_MS;
+                packet = audio_decode_queue_.Pop(now);
+                if (packet) {
+                    break;
+                }
+                /* The jitter buffer is holding packets back, wake up when the next one is due */
+                int64_t wait_us = audio_decode_queue_.WaitTime(now);
+                if (wait_us >= 0) {
+                    audio_decode_cv_.wait_for(lock, std::chrono::microseconds(std::max<int64_t>(wait_us, 1000)));
+                    continue;
+                }
+            }
+            audio_decode_cv_.wait(lock);
+        }
+        if (service_stopped_) {
+            break;
+        }
+        lock.unlock();
+        if (was_full) {
+            audio_space_cv_.notify_all();
+        }
+
+        auto task = audio_task_pool_.Acquire();
+        task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+        task->timestamp = packet->timestamp;
+#if CONFIG_USE_AUDIO_PIPELINE_STATS
+        int64_t decode_start_time = esp_timer_get_time();
+#endif
+
+        SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
+        bool resample = opus_decoder_->sample_rate() != codec_->output_sample_rate();
+        // Decode into the scratch buffer if the output needs resampling, otherwise straight into the task
+        auto& decoded = resample ? decode_buffer_ : task->pcm;
+        bool decoded_ok = true;
+        bool concealed = packet->payload.empty();
+        if (concealed) {
+            /* A frame the jitter buffer could not fill. An empty packet makes opus_decode() run its packet loss
+               concealment, which extrapolates from the previous frames. Silence only if the decoder refuses. */
+            if (!opus_decoder_->Decode(std::move(packet->payload), decoded) || decoded.empty()) {
+                decoded.assign(opus_decoder_->sample_rate() / 1000 * opus_decoder_->duration_ms(), 0);
+            }
+        } else {
+            decoded_ok = opus_decoder_->Decode(std::move(packet->payload), decoded);
+        }
+        packet_pool_.Release(std::move(packet));
+        debug_statistics_.decode_count++;
+        if (!decoded_ok) {
+            ESP_LOGE(TAG, "Failed to decode audio");
+            audio_task_pool_.Release(std::move(task));
+            continue;
+        }
+
+        // Resample if the sample rate is different
+        if (resample) {
+            task->pcm.resize(output_resampler_.GetOutputSamples(decoded.size()));
+            output_resampler_.Process(decoded.data(), decoded.size(), task->pcm.data());
+        }
+        if (!stack_logged && !concealed) {
+            stack_logged = true;
+            ESP_LOGI(TAG, "Opus decode task stack: %u of %u bytes never used", (unsigned)uxTaskGetStackHighWaterMark(NULL),
+                OPUS_DECODE_TASK_STACK_SIZE);
+        }
+#if CONFIG_USE_AUDIO_PIPELINE_STATS
+        pipeline_stats_.Record(kAudioStageDecode, decode_start_time);
+        task->enqueue_time_us = esp_timer_get_time();
+#endif
+        PIPELINE_TRACE(kTraceDecodeDone, task->pcm.size());
+
+        lock.lock();
+        audio_playback_queue_.push_back(std::move(task));
+        lock.unlock();
+        audio_playback_cv_.notify_one();
+    }
+
+    ESP_LOGW(TAG, "Opus decode task stopped");
+}
+
+void AudioService::OpusEncodeTask() {
+    int complexity = -1;
+    while (true) {
+        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
+        audio_encode_cv_.wait(lock, [this]() {
             return service_stopped_ ||
-                (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) ||
-                (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE);
+                (!audio_encode_queue_.empty() && LiveSendPackets() < MaxSendPackets());
         });
         if (service_stopped_) {
             break;
         }
 
-        /* Decode the audio from decode queue */
-        if (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE) {
-            auto packet = std::move(audio_decode_queue_.front());
-            audio_decode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
-
-            auto task = std::make_unique<AudioTask>();
-            task->type = kAudioTaskTypeDecodeToPlaybackQueue;
-            task->timestamp = packet->timestamp;
-
-            SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
-            if (opus_decoder_->Decode(std::move(packet->payload), task->pcm)) {
-                // Resample if the sample rate is different
-                if (opus_decoder_->sample_rate() != codec_->output_sample_rate()) {
-                    int target_size = output_resampler_.GetOutputSamples(task->pcm.size());
-                    std::vector<int16_t> resampled(target_size);
-                    output_resampler_.Process(task->pcm.data(), task->pcm.size(), resampled.data());
-                    task->pcm = std::move(resampled);
-                }
+        bool was_full = audio_encode_queue_.size() >= MAX_ENCODE_TASKS_IN_QUEUE;
+        auto task = std::move(audio_encode_queue_.front());
+        audio_encode_queue_.pop_front();
+        lock.unlock();
+        if (was_full) {
+            audio_space_cv_.notify_all();
+        }
 
-                lock.lock();
-                audio_playback_queue_.push_back(std::move(task));
-                audio_queue_cv_.notify_all();
-            } else {
-                ESP_LOGE(TAG, "Failed to decode audio");
-                lock.lock();
-            }
-            debug_statistics_.decode_count++;
-        }
-        
-        /* Encode the audio to send queue */
-        if (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) {
-            auto task = std::move(audio_encode_queue_.front());
-            audio_encode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
+        // Follow the frame duration of the audio processor and the negotiated complexity
+        int frame_duration = task->pcm.size() * 1000 / 16000;
+        if (frame_duration != opus_encoder_->duration_ms()) {
+            ESP_LOGI(TAG, "Opus encoder frame duration: %d ms", frame_duration);
+            opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, frame_duration);
+            complexity = -1;
+        }
+        if (complexity != encode_complexity_) {
+            complexity = encode_complexity_;
+            opus_encoder_->SetComplexity(complexity);
+        }
 
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->frame_duration = OPUS_FRAME_DURATION_MS;
-            packet->sample_rate = 16000;
-            packet->timestamp = task->timestamp;
-            if (!opus_encoder_->Encode(std::move(task->pcm), packet->payload)) {
-                ESP_LOGE(TAG, "Failed to encode audio");
-                continue;
-            }
+        auto type = task->type;
+        auto packet = packet_pool_.Acquire();
+        packet->frame_duration = frame_duration;
+        packet->sample_rate = 16000;
+        packet->timestamp = task->timestamp;
+        packet->sequence = 0;
+        packet->encoded_time_us = 0;
+#if CONFIG_USE_AUDIO_PIPELINE_STATS
+        pipeline_stats_.Record(kAudioStageEncodeWait, task->enqueue_time_us);
+        int64_t encode_start_time = esp_timer_get_time();
+#endif
+        // Encode into the scratch buffer, so pooled packets only keep the capacity of real Opus frames
+        bool encoded_ok = opus_encoder_->Encode(std::move(task->pcm), encode_buffer_);
+        audio_task_pool_.Release(std::move(task));
+        if (!encoded_ok) {
+            ESP_LOGE(TAG, "Failed to encode audio");
+            packet_pool_.Release(std::move(packet));
+            continue;
+        }
+        packet->payload.assign(encode_buffer_.begin(), encode_buffer_.end());
+        PIPELINE_TRACE(kTraceEncodeDone, packet->payload.size());
+#if CONFIG_USE_AUDIO_PIPELINE_STATS
+        pipeline_stats_.Record(kAudioStageEncode, encode_start_time);
+        packet->encoded_time_us = esp_timer_get_time();
+#endif
 
-            if (task->type == kAudioTaskTypeEncodeToSendQueue) {
-                {
-                    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
+        if (type == kAudioTaskTypeEncodeToSendQueue) {
+            bool prerolling;
+            {
+                std::lock_guard<std::mutex> lock(audio_queue_mutex_);
+                prerolling = prerolling_;
+                if (prerolling) {
+                    // The channel is still opening, hold the frame in the pre-roll ring
+                    audio_preroll_queue_.push_back(std::move(packet));
+                    if (audio_preroll_queue_.size() > (size_t)(PREROLL_MAX_DURATION_MS / frame_duration)) {
+                        packet_pool_.Release(std::move(audio_preroll_queue_.front()));
+                        audio_preroll_queue_.pop_front();
+                    }
+                } else {
                     audio_send_queue_.push_back(std::move(packet));
+                    max_send_queue_size_ = std::max(max_send_queue_size_, LiveSendPackets());
                 }
-                if (callbacks_.on_send_queue_available) {
-                    callbacks_.on_send_queue_available();
-                }
-            } else if (task->type == kAudioTaskTypeEncodeToTestingQueue) {
-                std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-                audio_testing_queue_.push_back(std::move(packet));
             }
-            debug_statistics_.encode_count++;
-            lock.lock();
+            if (!prerolling && callbacks_.on_send_queue_available) {
+                callbacks_.on_send_queue_available();
+            }
+        } else if (type == kAudioTaskTypeEncodeToTestingQueue) {
+            std::lock_guard<std::mutex> lock(audio_queue_mutex_);
+            audio_testing_queue_.push_back(std::move(packet));
         }
+        debug_statistics_.encode_count++;
     }
 
-    ESP_LOGW(TAG, "Opus codec task stopped");
+    ESP_LOGW(TAG, "Opus encode task stopped");
 }
 
 void AudioService::SetDecodeSampleRate(int sample_rate, int frame_duration) {
@@ -379,17 +522,21 @@ void AudioService::SetDecodeSampleRate(int sample_rate, int frame_duration) {
     opus_decoder_.reset();
     opus_decoder_ = std::make_unique<OpusDecoderWrapper>(sample_rate, 1, frame_duration);
 
-    auto codec = Board::GetInstance().GetAudioCodec();
-    if (opus_decoder_->sample_rate() != codec->output_sample_rate()) {
-        ESP_LOGI(TAG, "Resampling audio from %d to %d", opus_decoder_->sample_rate(), codec->output_sample_rate());
-        output_resampler_.Configure(opus_decoder_->sample_rate(), codec->output_sample_rate());
+    if (opus_decoder_->sample_rate() != codec_->output_sample_rate()) {
+        ESP_LOGI(TAG, "Resampling audio from %d to %d", opus_decoder_->sample_rate(), codec_->output_sample_rate());
+        output_resampler_.Configure(opus_decoder_->sample_rate(), codec_->output_sample_rate());
     }
 }
 
 void AudioService::PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm) {
-    auto task = std::make_unique<AudioTask>();
+    auto task = audio_task_pool_.Acquire();
     task->type = type;
-    task->pcm = std::move(pcm);
+    task->timestamp = 0;
+    // Swap instead of move, so the caller gets the recycled buffer back and can refill it without allocating
+    task->pcm.swap(pcm);
+#if CONFIG_USE_AUDIO_PIPELINE_STATS
+    task->enqueue_time_us = esp_timer_get_time();
+#endif
     
     /* Push the task to the encode queue */
     std::unique_lock<std::mutex> lock(audio_queue_mutex_);
@@ -404,33 +551,45 @@ void AudioService::PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t
         timestamp_queue_.pop_front();
     }
 
-    audio_queue_cv_.wait(lock, [this]() { return audio_encode_queue_.size() < MAX_ENCODE_TASKS_IN_QUEUE; });
+    audio_space_cv_.wait(lock, [this]() { return audio_encode_queue_.size() < MAX_ENCODE_TASKS_IN_QUEUE; });
     audio_encode_queue_.push_back(std::move(task));
-    audio_queue_cv_.notify_all();
+    lock.unlock();
+    audio_encode_cv_.notify_one();
 }
 
 bool AudioService::PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait) {
     std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-    if (audio_decode_queue_.size() >= MAX_DECODE_PACKETS_IN_QUEUE) {
+    if (audio_decode_queue_.duration_ms() >= MAX_DECODE_QUEUE_DURATION_MS) {
         if (wait) {
-            audio_queue_cv_.wait(lock, [this]() { return audio_decode_queue_.size() < MAX_DECODE_PACKETS_IN_QUEUE; });
+            audio_space_cv_.wait(lock, [this]() { return audio_decode_queue_.duration_ms() < MAX_DECODE_QUEUE_DURATION_MS; });
         } else {
             return false;
         }
     }
-    audio_decode_queue_.push_back(std::move(packet));
-    audio_queue_cv_.notify_all();
+    audio_decode_queue_.Push(std::move(packet), esp_timer_get_time());
+    lock.unlock();
+    audio_decode_cv_.notify_one();
     return true;
 }
 
 std::unique_ptr<AudioStreamPacket> AudioService::PopPacketFromSendQueue() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
+    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
     if (audio_send_queue_.empty()) {
         return nullptr;
     }
+    // Pre-roll frames are at the front, sending them does not make room for the encode task
+    bool was_full = false;
+    if (preroll_send_packets_ > 0) {
+        preroll_send_packets_--;
+    } else {
+        was_full = audio_send_queue_.size() >= MaxSendPackets();
+    }
     auto packet = std::move(audio_send_queue_.front());
     audio_send_queue_.pop_front();
-    audio_queue_cv_.notify_all();
+    lock.unlock();
+    if (was_full) {
+        audio_encode_cv_.notify_one();
+    }
     return packet;
 }
 
@@ -445,13 +604,32 @@ const std::string& AudioService::GetLastWakeWord() const {
 }
 
 std::unique_ptr<AudioStreamPacket> AudioService::PopWakeWordPacket() {
-    auto packet = std::make_unique<AudioStreamPacket>();
+    auto packet = packet_pool_.Acquire();
+    packet->sample_rate = 16000;
+    packet->frame_duration = OPUS_FRAME_DURATION_MS;
+    packet->timestamp = 0;
+    packet->sequence = 0;
     if (wake_word_->GetWakeWordOpus(packet->payload)) {
         return packet;
     }
+    packet_pool_.Release(std::move(packet));
     return nullptr;
 }
 
+void AudioService::RecordPacketSent(int64_t encoded_time_us) {
+#if CONFIG_USE_AUDIO_PIPELINE_STATS
+    pipeline_stats_.Record(kAudioStageSend, encoded_time_us);
+#endif
+}
+
+std::unique_ptr<AudioStreamPacket> AudioService::AcquirePacket() {
+    return packet_pool_.Acquire();
+}
+
+void AudioService::ReleasePacket(std::unique_ptr<AudioStreamPacket> packet) {
+    packet_pool_.Release(std::move(packet));
+}
+
 void AudioService::EnableWakeWordDetection(bool enable) {
     if (!wake_word_) {
         return;
@@ -478,9 +656,10 @@ void AudioService::EnableVoiceProcessing(bool enable) {
     ESP_LOGD(TAG, "%s voice processing", enable ? "Enabling" : "Disabling");
     if (enable) {
         if (!audio_processor_initialized_) {
-            audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS, models_list_);
+            audio_processor_->Initialize(codec_, frame_duration_ms_, models_list_);
             audio_processor_initialized_ = true;
         }
+        UpdateFrameDuration();
 
         /* We should make sure no audio is playing */
         ResetDecoder();
@@ -490,7 +669,51 @@ void AudioService::EnableVoiceProcessing(bool enable) {
     } else {
         audio_processor_->Stop();
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_PROCESSOR_RUNNING);
+        ClearPreroll();
+    }
+}
+
+void AudioService::StartPreroll() {
+    ClearPreroll();
+    prerolling_ = true;
+    EnableWakeWordDetection(false);
+    EnableVoiceProcessing(true);
+}
+
+void AudioService::FinishPreroll() {
+    size_t frames;
+    {
+        std::lock_guard<std::mutex> lock(audio_queue_mutex_);
+        if (!prerolling_) {
+            return;
+        }
+        prerolling_ = false;
+        // Nothing reaches the send queue during pre-roll, so the held frames keep their order.
+        // The sender sends them back to back with their original timestamps.
+        frames = audio_preroll_queue_.size();
+        for (auto& packet : audio_preroll_queue_) {
+            // Held on purpose, not a send delay
+            packet->encoded_time_us = 0;
+            audio_send_queue_.push_back(std::move(packet));
+        }
+        audio_preroll_queue_.clear();
+        // They were held while the channel opened, not queued by a slow network, so they neither stall
+        // the encode task nor make UpdateFrameDuration step up to longer frames
+        preroll_send_packets_ = audio_send_queue_.size();
+    }
+    ESP_LOGI(TAG, "Sending %u pre-roll frames", frames);
+    if (frames > 0 && callbacks_.on_send_queue_available) {
+        callbacks_.on_send_queue_available();
+    }
+}
+
+void AudioService::ClearPreroll() {
+    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
+    prerolling_ = false;
+    for (auto& packet : audio_preroll_queue_) {
+        packet_pool_.Release(std::move(packet));
     }
+    audio_preroll_queue_.clear();
 }
 
 void AudioService::EnableAudioTesting(bool enable) {
@@ -499,17 +722,21 @@ void AudioService::EnableAudioTesting(bool enable) {
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
     } else {
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
-        /* Copy audio_testing_queue_ to audio_decode_queue_ */
+        /* Move audio_testing_queue_ to audio_decode_queue_ */
         std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-        audio_decode_queue_ = std::move(audio_testing_queue_);
-        audio_queue_cv_.notify_all();
+        int64_t now = esp_timer_get_time();
+        for (auto& packet : audio_testing_queue_) {
+            audio_decode_queue_.Push(std::move(packet), now);
+        }
+        audio_testing_queue_.clear();
+        audio_decode_cv_.notify_one();
     }
 }
 
 void AudioService::EnableDeviceAec(bool enable) {
     ESP_LOGI(TAG, "%s device AEC", enable ? "Enabling" : "Disabling");
     if (!audio_processor_initialized_) {
-        audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS, models_list_);
+        audio_processor_->Initialize(codec_, frame_duration_ms_, models_list_);
         audio_processor_initialized_ = true;
     }
 
@@ -607,11 +834,12 @@ void AudioService::PlaySound(const std::string_view& ogg) {
             }
 
             // Audio packet (Opus)
-            auto packet = std::make_unique<AudioStreamPacket>();
+            auto packet = packet_pool_.Acquire();
             packet->sample_rate = sample_rate;
             packet->frame_duration = 60;
-            packet->payload.resize(pkt_len);
-            std::memcpy(packet->payload.data(), pkt_ptr, pkt_len);
+            packet->timestamp = 0;
+            packet->sequence = 0;
+            packet->payload.assign(pkt_ptr, pkt_ptr + pkt_len);
             PushPacketToDecodeQueue(std::move(packet), true);
         }
 
@@ -628,10 +856,10 @@ void AudioService::ResetDecoder() {
     std::lock_guard<std::mutex> lock(audio_queue_mutex_);
     opus_decoder_->ResetState();
     timestamp_queue_.clear();
-    audio_decode_queue_.clear();
+    audio_decode_queue_.Clear();
     audio_playback_queue_.clear();
     audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    NotifyAllQueueWaiters();
 }
 
 void AudioService::CheckAndUpdateAudioPowerState() {
@@ -677,6 +905,64 @@ void AudioService::SetModelsList(srmodel_list_t* models_list) {
     }
 }
 
+void AudioService::NotifyAllQueueWaiters() {
+    audio_encode_cv_.notify_all();
+    audio_decode_cv_.notify_all();
+    audio_playback_cv_.notify_all();
+    audio_space_cv_.notify_all();
+}
+
+void AudioService::SetUplinkAudioParams(int frame_duration_ms, int complexity, bool adaptive) {
+    ESP_LOGI(TAG, "Uplink audio: %d ms frames, complexity %d%s", frame_duration_ms, complexity, adaptive ? ", adaptive" : "");
+    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
+    negotiated_frame_duration_ms_ = frame_duration_ms;
+    adaptive_frame_duration_ = adaptive;
+    encode_complexity_ = complexity;
+    max_send_queue_size_ = 0;
+}
+
+void AudioService::UpdateFrameDuration() {
+    static const int kFrameDurations[] = {20, 40, 60, 120};
+    static const int kFrameDurationCount = sizeof(kFrameDurations) / sizeof(kFrameDurations[0]);
+
+    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
+    int frame_duration = negotiated_frame_duration_ms_;
+    if (adaptive_frame_duration_) {
+        /* Step to longer frames when the network could not drain the send queue during the last utterance,
+         * and back towards the negotiated duration when it kept up */
+        int queued_ms = max_send_queue_size_ * frame_duration_ms_;
+        int index = 0;
+        while (index < kFrameDurationCount - 1 && kFrameDurations[index] < frame_duration_ms_) {
+            index++;
+        }
+        if (queued_ms >= FRAME_DURATION_UP_QUEUE_MS && index < kFrameDurationCount - 1) {
+            frame_duration = kFrameDurations[index + 1];
+        } else if (queued_ms <= frame_duration_ms_ && index > 0 && kFrameDurations[index] > negotiated_frame_duration_ms_) {
+            frame_duration = kFrameDurations[index - 1];
+        } else {
+            frame_duration = std::max(frame_duration_ms_, negotiated_frame_duration_ms_);
+        }
+    }
+    max_send_queue_size_ = 0;
+    if (frame_duration == frame_duration_ms_) {
+        return;
+    }
+    ESP_LOGI(TAG, "Frame duration: %d ms -> %d ms", frame_duration_ms_, frame_duration);
+    frame_duration_ms_ = frame_duration;
+    lock.unlock();
+
+    /* The encode task follows the new frame size on its own */
+    audio_processor_->SetFrameDuration(frame_duration);
+}
+
+void AudioService::PrintPipelineStats() {
+#if CONFIG_USE_AUDIO_PIPELINE_STATS
+    pipeline_stats_.Print();
+    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
+    audio_decode_queue_.PrintStatistics();
+#endif
+}
+
 bool AudioService::IsAfeWakeWord() {
 #if CONFIG_IDF_TARGET_ESP32S3 || CONFIG_IDF_TARGET_ESP32P4
     return wake_word_ != nullptr && dynamic_cast<AfeWakeWord*>(wake_word_.get()) != nullptr;
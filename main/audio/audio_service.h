@@ -6,6 +6,7 @@
 #include <condition_variable>
 #include <chrono>
 #include <mutex>
+#include <atomic>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -20,6 +21,9 @@
 #include "audio_codec.h"
 #include "audio_processor.h"
 #include "processors/audio_debugger.h"
+#include "audio_pipeline_stats.h"
+#include "audio_buffer_pool.h"
+#include "jitter_buffer.h"
 #include "wake_word.h"
 #include "protocol.h"
 
@@ -27,21 +31,49 @@
 /*
  * There are two types of audio data flow:
  * 1. (MIC) -> [Processors] -> {Encode Queue} -> [Opus Encoder] -> {Send Queue} -> (Server)
- * 2. (Server) -> {Decode Queue} -> [Opus Decoder] -> {Playback Queue} -> (Speaker)
+ * 2. (Server) -> {Decode Queue (Jitter Buffer)} -> [Opus Decoder] -> {Playback Queue} -> (Speaker)
  *
- * We use one task for MIC / Speaker / Processors, and one task for Opus Encoder / Opus Decoder.
+ * We use one task for MIC / Processors, one for Speaker, and separate tasks for Opus Encoder and Opus Decoder,
+ * so encoding in full-duplex mode never delays playback.
  * 
  * Decode Queue and Send Queue are the main queues, because Opus packets are quite smaller than PCM packets.
  * 
  */
 
+// Default uplink frame duration, the server may negotiate 20 / 40 / 60 / 120 ms in hello
 #define OPUS_FRAME_DURATION_MS 60
 #define MAX_ENCODE_TASKS_IN_QUEUE 2
 #define MAX_PLAYBACK_TASKS_IN_QUEUE 2
-#define MAX_DECODE_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
-#define MAX_SEND_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
+// Decode and send queues are limited by audio duration, so the limits follow the frame duration
+#define MAX_DECODE_QUEUE_DURATION_MS 2400
+#define MAX_SEND_QUEUE_DURATION_MS 2400
+// Speech kept while the audio channel opens after a wake word, older frames are dropped.
+// At most one full send queue, the held frames are moved to the send queue at once.
+#define PREROLL_MAX_DURATION_MS MAX_SEND_QUEUE_DURATION_MS
+// Adaptive frame duration: a send queue this deep during an utterance makes the next one use longer frames
+#define FRAME_DURATION_UP_QUEUE_MS 600
 #define AUDIO_TESTING_MAX_DURATION_MS 10000
 #define MAX_TIMESTAMPS_IN_QUEUE 3
+// Frames that can be in flight at the same time: both PCM queues plus the frame held by each of the four tasks
+// that take one (the task feeding the encode queue, opus_encode, opus_decode and audio_output)
+#define AUDIO_TASK_POOL_SIZE (MAX_ENCODE_TASKS_IN_QUEUE + MAX_PLAYBACK_TASKS_IN_QUEUE + 4)
+// About one second of Opus packets, larger bursts fall back to the heap
+#define AUDIO_PACKET_POOL_SIZE (1000 / OPUS_FRAME_DURATION_MS)
+
+#if CONFIG_FREERTOS_UNICORE || CONFIG_OPUS_ENCODE_TASK_CORE < 0
+#define OPUS_ENCODE_TASK_CORE tskNO_AFFINITY
+#else
+#define OPUS_ENCODE_TASK_CORE CONFIG_OPUS_ENCODE_TASK_CORE
+#endif
+#if CONFIG_FREERTOS_UNICORE || CONFIG_OPUS_DECODE_TASK_CORE < 0
+#define OPUS_DECODE_TASK_CORE tskNO_AFFINITY
+#else
+#define OPUS_DECODE_TASK_CORE CONFIG_OPUS_DECODE_TASK_CORE
+#endif
+#define OPUS_ENCODE_TASK_PRIORITY CONFIG_OPUS_ENCODE_TASK_PRIORITY
+#define OPUS_DECODE_TASK_PRIORITY CONFIG_OPUS_DECODE_TASK_PRIORITY
+// Decoding needs far less stack than encoding, the high water mark is logged after the first decoded frame
+#define OPUS_DECODE_TASK_STACK_SIZE (2048 * 5)
 
 #define AUDIO_POWER_TIMEOUT_MS 15000
 #define AUDIO_POWER_CHECK_INTERVAL_MS 1000
@@ -69,7 +101,8 @@ enum AudioTaskType {
 struct AudioTask {
     AudioTaskType type;
     std::vector<int16_t> pcm;
-    uint32_t timestamp;
+    uint32_t timestamp = 0;
+    int64_t enqueue_time_us = 0;
 };
 
 struct DebugStatistics {
@@ -94,10 +127,15 @@ public:
     bool IsIdle();
     bool IsWakeWordRunning() const { return xEventGroupGetBits(event_group_) & AS_EVENT_WAKE_WORD_RUNNING; }
     bool IsAudioProcessorRunning() const { return xEventGroupGetBits(event_group_) & AS_EVENT_AUDIO_PROCESSOR_RUNNING; }
+    bool IsPrerolling() const { return prerolling_; }
     bool IsAfeWakeWord();
 
     void EnableWakeWordDetection(bool enable);
     void EnableVoiceProcessing(bool enable);
+    // Starts voice processing at the wake word, encoded frames are held until FinishPreroll
+    void StartPreroll();
+    // Releases the held frames to the send queue, voice processing keeps running
+    void FinishPreroll();
     void EnableAudioTesting(bool enable);
     void EnableDeviceAec(bool enable);
 
@@ -105,10 +143,20 @@ public:
 
     bool PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait = false);
     std::unique_ptr<AudioStreamPacket> PopPacketFromSendQueue();
+    // Called by the sender after the socket write, with the encoded_time_us of the packet
+    void RecordPacketSent(int64_t encoded_time_us);
+    // Opus packets are recycled through a pool, protocols should acquire and release them here
+    std::unique_ptr<AudioStreamPacket> AcquirePacket();
+    void ReleasePacket(std::unique_ptr<AudioStreamPacket> packet);
     void PlaySound(const std::string_view& sound);
+    // Reads from the microphone, called by the audio input task and by the AFSK Wi-Fi configuration task.
+    // Calls are serialized, they share the scratch buffers and the input resamplers.
     bool ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples);
     void ResetDecoder();
     void SetModelsList(srmodel_list_t* models_list);
+    void PrintPipelineStats();
+    // Negotiated uplink encoding, takes effect when voice processing starts next time
+    void SetUplinkAudioParams(int frame_duration_ms, int complexity, bool adaptive);
 
 private:
     AudioCodec* codec_ = nullptr;
@@ -122,6 +170,9 @@ private:
     OpusResampler reference_resampler_;
     OpusResampler output_resampler_;
     DebugStatistics debug_statistics_;
+#if CONFIG_USE_AUDIO_PIPELINE_STATS
+    AudioPipelineStats pipeline_stats_;
+#endif
     srmodel_list_t* models_list_ = nullptr;
 
     EventGroupHandle_t event_group_;
@@ -129,12 +180,31 @@ private:
     // Audio encode / decode
     TaskHandle_t audio_input_task_handle_ = nullptr;
     TaskHandle_t audio_output_task_handle_ = nullptr;
-    TaskHandle_t opus_codec_task_handle_ = nullptr;
+    TaskHandle_t opus_encode_task_handle_ = nullptr;
+    TaskHandle_t opus_decode_task_handle_ = nullptr;
+    // Each waiter has its own condition variable, so a push or pop only wakes the task that needs it
     std::mutex audio_queue_mutex_;
-    std::condition_variable audio_queue_cv_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_decode_queue_;
+    std::condition_variable audio_encode_cv_;     // Opus encode task: PCM to encode and send queue space
+    std::condition_variable audio_decode_cv_;     // Opus decode task: packet to decode and playback queue space
+    std::condition_variable audio_playback_cv_;   // Audio output task: playback queue not empty
+    std::condition_variable audio_space_cv_;      // Producers: encode / decode queue has free space
+
+    // Recycled frames and packets, plus scratch buffers owned by the encode / decode tasks
+    AudioBufferPool<AudioTask> audio_task_pool_{AUDIO_TASK_POOL_SIZE};
+    AudioBufferPool<AudioStreamPacket> packet_pool_{AUDIO_PACKET_POOL_SIZE};
+    std::vector<uint8_t> encode_buffer_;
+    std::vector<int16_t> decode_buffer_;
+    // Scratch buffers for ReadAudioData, grown once and reused like the input resamplers' state.
+    // input_mutex_ guards them and the resamplers against a second reader.
+    std::mutex input_mutex_;
+    std::vector<int16_t> input_buffer_;
+    std::vector<int16_t> input_channels_buffer_;
+    std::vector<int16_t> resampled_channels_buffer_;
+
+    JitterBuffer audio_decode_queue_{packet_pool_};
     std::deque<std::unique_ptr<AudioStreamPacket>> audio_send_queue_;
     std::deque<std::unique_ptr<AudioStreamPacket>> audio_testing_queue_;
+    std::deque<std::unique_ptr<AudioStreamPacket>> audio_preroll_queue_;
     std::deque<std::unique_ptr<AudioTask>> audio_encode_queue_;
     std::deque<std::unique_ptr<AudioTask>> audio_playback_queue_;
     // For server AEC
@@ -146,16 +216,33 @@ private:
     bool service_stopped_ = true;
     bool audio_input_need_warmup_ = false;
 
+    // Uplink encoding, the encode task reconfigures the encoder when the frames it gets change
+    int frame_duration_ms_ = OPUS_FRAME_DURATION_MS;
+    int negotiated_frame_duration_ms_ = OPUS_FRAME_DURATION_MS;
+    bool adaptive_frame_duration_ = false;
+    size_t max_send_queue_size_ = 0;
+    // Pre-roll frames at the front of the send queue, they count neither for backpressure nor for adaptation
+    size_t preroll_send_packets_ = 0;
+    std::atomic<int> encode_complexity_{0};
+    std::atomic<bool> prerolling_{false};
+
     esp_timer_handle_t audio_power_timer_ = nullptr;
     std::chrono::steady_clock::time_point last_input_time_;
     std::chrono::steady_clock::time_point last_output_time_;
 
     void AudioInputTask();
     void AudioOutputTask();
-    void OpusCodecTask();
+    void OpusEncodeTask();
+    void OpusDecodeTask();
+    void ResampleInput(const std::vector<int16_t>& input, int channels, std::vector<int16_t>& output);
+    void ClearPreroll();
     void PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm);
     void SetDecodeSampleRate(int sample_rate, int frame_duration);
     void CheckAndUpdateAudioPowerState();
+    void NotifyAllQueueWaiters();
+    void UpdateFrameDuration();
+    size_t MaxSendPackets() const { return MAX_SEND_QUEUE_DURATION_MS / frame_duration_ms_; }
+    size_t LiveSendPackets() const { return audio_send_queue_.size() - preroll_send_packets_; }
 };
 
 #endif
\ No newline at end of file
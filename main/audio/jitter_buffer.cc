@@ -0,0 +1,199 @@
+#include "jitter_buffer.h"
+
+#include <algorithm>
+#include <iterator>
+#include <esp_log.h>
+
+#define TAG "JitterBuffer"
+
+void JitterBuffer::Push(std::unique_ptr<AudioStreamPacket> packet, int64_t now_us) {
+    if (packet->sequence == 0) {
+        buffered_ms_ += PacketDuration(*packet);
+        packets_.push_back({std::move(packet), now_us});
+        return;
+    }
+
+    if (packet->frame_duration > 0) {
+        frame_duration_ms_ = packet->frame_duration;
+    }
+
+    uint32_t sequence = packet->sequence;
+    if (has_next_sequence_ && (int32_t)(sequence - next_sequence_) < 0) {
+        if (next_sequence_ - sequence > JITTER_BUFFER_RESTART_FRAMES) {
+            ESP_LOGI(TAG, "Stream restarted at sequence %lu, expected: %lu", sequence, next_sequence_);
+            Clear();
+        } else {
+            late_packets_++;
+            pool_.Release(std::move(packet));
+            return;
+        }
+    }
+    UpdateJitter(*packet, now_us);
+
+    // Insert in sequence order, most packets arrive in order and go to the back
+    auto it = packets_.end();
+    while (it != packets_.begin()) {
+        auto prev = std::prev(it);
+        if (prev->packet->sequence == 0 || (int32_t)(prev->packet->sequence - sequence) < 0) {
+            break;
+        }
+        if (prev->packet->sequence == sequence) {
+            duplicate_packets_++;
+            pool_.Release(std::move(packet));
+            return;
+        }
+        it = prev;
+    }
+    buffered_ms_ += PacketDuration(*packet);
+    if (it == packets_.end()) {
+        // insert() at the front of an empty deque is a push_front, which takes a new block every time
+        packets_.push_back({std::move(packet), now_us});
+    } else {
+        packets_.insert(it, {std::move(packet), now_us});
+    }
+}
+
+std::unique_ptr<AudioStreamPacket> JitterBuffer::Pop(int64_t now_us) {
+    if (packets_.empty()) {
+        return nullptr;
+    }
+
+    auto& head = packets_.front();
+    if (head.packet->sequence != 0) {
+        int64_t target_us = TargetDelayUs();
+        // A burst that already covers the target delay does not need to wait
+        bool enough_buffered = BufferedUs() >= target_us + frame_duration_ms_ * 1000;
+        if (!playing_) {
+            if (!enough_buffered && now_us - head.arrival_us < target_us) {
+                return nullptr;
+            }
+            playing_ = true;
+            has_next_sequence_ = true;
+            next_sequence_ = head.packet->sequence;
+            missing_since_us_ = 0;
+        }
+
+        uint32_t gap = head.packet->sequence - next_sequence_;
+        if (gap > 0) {
+            // Give the missing packet as long as the target delay to arrive
+            if (missing_since_us_ == 0) {
+                missing_since_us_ = now_us;
+            }
+            if (!enough_buffered && now_us - missing_since_us_ < target_us) {
+                return nullptr;
+            }
+
+            if (gap <= JITTER_BUFFER_MAX_CONCEALED_FRAMES) {
+                auto concealed = pool_.Acquire();
+                concealed->sample_rate = head.packet->sample_rate;
+                concealed->frame_duration = head.packet->frame_duration;
+                concealed->timestamp = 0;
+                concealed->sequence = next_sequence_++;
+                concealed->payload.clear();
+                concealed_frames_++;
+                return concealed;
+            }
+            skipped_frames_ += gap;
+            next_sequence_ = head.packet->sequence;
+        }
+        next_sequence_++;
+        missing_since_us_ = 0;
+    }
+
+    auto packet = std::move(head.packet);
+    packets_.pop_front();
+    buffered_ms_ -= PacketDuration(*packet);
+    return packet;
+}
+
+int64_t JitterBuffer::WaitTime(int64_t now_us) const {
+    if (packets_.empty()) {
+        return -1;
+    }
+    auto& head = packets_.front();
+    if (head.packet->sequence == 0) {
+        return 0;
+    }
+
+    int64_t target_us = TargetDelayUs();
+    int64_t since_us;
+    if (!playing_) {
+        since_us = head.arrival_us;
+    } else if (head.packet->sequence != next_sequence_ && missing_since_us_ != 0) {
+        since_us = missing_since_us_;
+    } else {
+        return 0;
+    }
+    if (BufferedUs() >= target_us + frame_duration_ms_ * 1000) {
+        return 0;
+    }
+    return std::max<int64_t>(0, target_us - (now_us - since_us));
+}
+
+void JitterBuffer::Rebuffer() {
+    playing_ = false;
+}
+
+void JitterBuffer::Clear() {
+    ReleaseAll();
+    playing_ = false;
+    has_next_sequence_ = false;
+    missing_since_us_ = 0;
+    has_transit_ = false;
+    timestamp_clock_ = false;
+}
+
+void JitterBuffer::PrintStatistics() {
+    ESP_LOGI(TAG, "jitter: %lu us, target delay: %lu ms, late: %lu, duplicate: %lu, concealed: %lu, skipped: %lu",
+        (uint32_t)jitter_us_, (uint32_t)(TargetDelayUs() / 1000),
+        late_packets_, duplicate_packets_, concealed_frames_, skipped_frames_);
+    late_packets_ = 0;
+    duplicate_packets_ = 0;
+    concealed_frames_ = 0;
+    skipped_frames_ = 0;
+}
+
+int64_t JitterBuffer::TargetDelayUs() const {
+    // Three times the mean deviation covers almost all late arrivals
+    int64_t target_us = 3 * jitter_us_;
+    return std::clamp<int64_t>(target_us, JITTER_BUFFER_MIN_DELAY_MS * 1000, JITTER_BUFFER_MAX_DELAY_MS * 1000);
+}
+
+int64_t JitterBuffer::BufferedUs() const {
+    return (int64_t)buffered_ms_ * 1000;
+}
+
+int JitterBuffer::PacketDuration(const AudioStreamPacket& packet) const {
+    return packet.frame_duration > 0 ? packet.frame_duration : frame_duration_ms_;
+}
+
+void JitterBuffer::UpdateJitter(const AudioStreamPacket& packet, int64_t now_us) {
+    // The server timestamp is the media time in ms and stays right when the frame duration changes.
+    // Without one, the media time of a packet is its sequence number times the frame duration.
+    bool timestamp_clock = timestamp_clock_ || packet.timestamp != 0;
+    if (timestamp_clock != timestamp_clock_) {
+        // The two clocks have different origins, start the transit over
+        timestamp_clock_ = true;
+        has_transit_ = false;
+    }
+    int64_t media_us = timestamp_clock_ ? (int64_t)packet.timestamp * 1000
+        : (int64_t)packet.sequence * frame_duration_ms_ * 1000;
+    int64_t transit_us = now_us - media_us;
+    if (has_transit_) {
+        int64_t d = transit_us - last_transit_us_;
+        if (d < 0) {
+            d = -d;
+        }
+        jitter_us_ += (d - jitter_us_) / 16;
+    }
+    last_transit_us_ = transit_us;
+    has_transit_ = true;
+}
+
+void JitterBuffer::ReleaseAll() {
+    for (auto& entry : packets_) {
+        pool_.Release(std::move(entry.packet));
+    }
+    packets_.clear();
+    buffered_ms_ = 0;
+}
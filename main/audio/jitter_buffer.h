@@ -0,0 +1,88 @@
+#ifndef JITTER_BUFFER_H
+#define JITTER_BUFFER_H
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+#include "protocol.h"
+#include "audio_buffer_pool.h"
+
+// Playout delay is kept between these bounds, whatever the measured jitter
+#define JITTER_BUFFER_MIN_DELAY_MS 20
+#define JITTER_BUFFER_MAX_DELAY_MS 480
+// Longer gaps are skipped instead of concealed
+#define JITTER_BUFFER_MAX_CONCEALED_FRAMES 3
+// A sequence number this far behind the playout position means the server restarted the stream
+#define JITTER_BUFFER_RESTART_FRAMES 50
+
+/*
+ * Adaptive jitter buffer for the server audio (decode queue).
+ *
+ * Sequenced packets (UDP) are reordered by sequence number. Whenever playback starts or runs dry,
+ * playout is delayed by a target derived from the RFC 3550 interarrival jitter, so good links keep
+ * a short delay and lossy links get a deeper buffer. The jitter uses the packet timestamp (ms) as the
+ * media clock, or sequence times frame duration for servers that send no timestamps. A packet that is
+ * still missing when its turn comes is replaced by an empty packet, which the decode task conceals
+ * with Opus PLC.
+ *
+ * Packets without a sequence number (WebSocket, local sounds) are played in arrival order without delay.
+ *
+ * Not thread safe, the owner serializes access.
+ */
+class JitterBuffer {
+public:
+    explicit JitterBuffer(AudioBufferPool<AudioStreamPacket>& pool) : pool_(pool) {}
+
+    void Push(std::unique_ptr<AudioStreamPacket> packet, int64_t now_us);
+    // Returns nullptr if the next packet is not due yet
+    std::unique_ptr<AudioStreamPacket> Pop(int64_t now_us);
+    // Microseconds until Pop() can return a packet, -1 if the buffer is empty
+    int64_t WaitTime(int64_t now_us) const;
+    // Playback ran dry, hold the next packets until the target delay is buffered again
+    void Rebuffer();
+    // A sequenced stream is being played out
+    bool playing() const { return playing_; }
+    void Clear();
+    void PrintStatistics();
+
+    size_t size() const { return packets_.size(); }
+    bool empty() const { return packets_.empty(); }
+    // Total duration of the buffered packets
+    int duration_ms() const { return buffered_ms_; }
+
+private:
+    struct Entry {
+        std::unique_ptr<AudioStreamPacket> packet;
+        int64_t arrival_us;
+    };
+
+    AudioBufferPool<AudioStreamPacket>& pool_;
+    std::deque<Entry> packets_;
+
+    int frame_duration_ms_ = 60;
+    int buffered_ms_ = 0;
+    bool playing_ = false;
+    bool has_next_sequence_ = false;
+    uint32_t next_sequence_ = 0;
+    int64_t missing_since_us_ = 0;
+
+    // RFC 3550 interarrival jitter, in microseconds
+    bool has_transit_ = false;
+    bool timestamp_clock_ = false;  // The stream carries timestamps, they are the media clock from then on
+    int64_t last_transit_us_ = 0;
+    int64_t jitter_us_ = 0;
+
+    uint32_t late_packets_ = 0;
+    uint32_t duplicate_packets_ = 0;
+    uint32_t concealed_frames_ = 0;
+    uint32_t skipped_frames_ = 0;
+
+    int64_t TargetDelayUs() const;
+    int64_t BufferedUs() const;
+    void UpdateJitter(const AudioStreamPacket& packet, int64_t now_us);
+    int PacketDuration(const AudioStreamPacket& packet) const;
+    void ReleaseAll();
+};
+
+#endif // JITTER_BUFFER_H
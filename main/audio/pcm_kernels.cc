@@ -0,0 +1,51 @@
+#include "pcm_kernels.h"
+
+static inline int16_t Saturate16(int32_t value) {
+    return value > INT16_MAX ? INT16_MAX : value < -INT16_MAX ? -INT16_MAX : (int16_t)value;
+}
+
+void PcmDeinterleave(const int16_t* __restrict src, int16_t* __restrict left, int16_t* __restrict right, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        left[i] = src[2 * i];
+        right[i] = src[2 * i + 1];
+    }
+}
+
+void PcmInterleave(const int16_t* __restrict left, const int16_t* __restrict right, int16_t* __restrict dst, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        dst[2 * i] = left[i];
+        dst[2 * i + 1] = right[i];
+    }
+}
+
+void PcmExtractChannel(const int16_t* src, int16_t* dst, size_t frames, int channels, int channel) {
+    // Forward copy is safe in place because dst[i] never overtakes src[i * channels + channel]
+    src += channel;
+    for (size_t i = 0; i < frames; i++) {
+        dst[i] = src[i * channels];
+    }
+}
+
+void PcmApplyGain(int16_t* data, size_t samples, int32_t gain) {
+    for (size_t i = 0; i < samples; i++) {
+        data[i] = Saturate16(data[i] * gain);
+    }
+}
+
+void PcmScaleToInt32(const int16_t* __restrict src, int32_t* __restrict dst, size_t samples, int32_t factor) {
+    // With factor <= 65536 the product fits in 32 bits, so no 64-bit multiply or saturation is needed
+    if (factor > 65536) {
+        factor = 65536;
+    } else if (factor < 0) {
+        factor = 0;
+    }
+    for (size_t i = 0; i < samples; i++) {
+        dst[i] = (int32_t)src[i] * factor;
+    }
+}
+
+void PcmShiftToInt16(const int32_t* __restrict src, int16_t* __restrict dst, size_t samples, int shift) {
+    for (size_t i = 0; i < samples; i++) {
+        dst[i] = Saturate16(src[i] >> shift);
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef PCM_KERNELS_H
+#define PCM_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Sample format conversions used by the audio codecs and AudioService.
+ *
+ * Every kernel is a single pass over plain arrays without allocation, so callers keep their own
+ * buffers. Saturation matches the code these kernels replaced: 16-bit results are clamped to
+ * [-INT16_MAX, INT16_MAX]. They are plain scalar loops with __restrict pointers, no hand-written SIMD;
+ * tests/host/pcm_kernels_test.cc checks them against the replaced loops.
+ */
+
+// L R L R ... to two mono buffers
+void PcmDeinterleave(const int16_t* src, int16_t* left, int16_t* right, size_t frames);
+// Two mono buffers to L R L R ...
+void PcmInterleave(const int16_t* left, const int16_t* right, int16_t* dst, size_t frames);
+// Copies one channel of interleaved audio, dst may be src (in place)
+void PcmExtractChannel(const int16_t* src, int16_t* dst, size_t frames, int channels, int channel);
+// data = data * gain, in place with saturation
+void PcmApplyGain(int16_t* data, size_t samples, int32_t gain);
+// 16-bit samples to 32-bit I2S samples, factor is the Q16 volume (0 - 65536)
+void PcmScaleToInt32(const int16_t* src, int32_t* dst, size_t samples, int32_t factor);
+// 32-bit I2S samples to 16-bit, dst = src >> shift with saturation
+void PcmShiftToInt16(const int32_t* src, int16_t* dst, size_t samples, int shift);
+
+#endif // PCM_KERNELS_H
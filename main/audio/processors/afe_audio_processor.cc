@@ -13,6 +13,7 @@ AfeAudioProcessor::AfeAudioProcessor()
 void AfeAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) {
     codec_ = codec;
     frame_samples_ = frame_duration_ms * 16000 / 1000;
+    next_frame_samples_ = frame_samples_;
 
     // Pre-allocate output buffer capacity
     output_buffer_.reserve(frame_samples_);
@@ -81,6 +82,11 @@ AfeAudioProcessor::~AfeAudioProcessor() {
     vEventGroupDelete(event_group_);
 }
 
+void AfeAudioProcessor::SetFrameDuration(int frame_duration_ms) {
+    // Picked up by the processor task between two frames
+    next_frame_samples_ = frame_duration_ms * 16000 / 1000;
+}
+
 size_t AfeAudioProcessor::GetFeedSize() {
     if (afe_data_ == nullptr) {
         return 0;
@@ -150,6 +156,14 @@ void AfeAudioProcessor::AudioProcessorTask() {
         }
 
         if (output_callback_) {
+            // Samples buffered for a frame of the old size are dropped, so no frame mixes both sizes
+            int frame_samples = next_frame_samples_;
+            if (frame_samples != frame_samples_) {
+                frame_samples_ = frame_samples;
+                output_buffer_.clear();
+                output_buffer_.reserve(frame_samples_);
+            }
+
             size_t samples = res->data_size / sizeof(int16_t);
             
             // Add data to buffer
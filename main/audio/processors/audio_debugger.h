@@ -13,10 +13,13 @@ public:
     ~AudioDebugger();
 
     void Feed(const std::vector<int16_t>& data);
+    // Pipeline trace text, sent to the next port so the audio stream stays clean
+    void SendTrace(const char* data, size_t size);
 
 private:
     int udp_sockfd_ = -1;
     struct sockaddr_in udp_server_addr_;
+    struct sockaddr_in trace_server_addr_;
 };
 
 #endif 
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include "audio_service.h"
 #include "system_info.h"
 #include "assets.h"
+#include "pcm_kernels.h"
 
 #include <esp_log.h>
 #include <esp_mn_iface.h>
@@ -150,13 +151,11 @@ void CustomWakeWord::Feed(const std::vector<int16_t>& data) {
     esp_mn_state_t mn_state;
     // If input channels is 2, we need to fetch the left channel data
     if (codec_->input_channels() == 2) {
-        auto mono_data = std::vector<int16_t>(data.size() / 2);
-        for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-            mono_data[i] = data[j];
-        }
+        mono_buffer_.resize(data.size() / 2);
+        PcmExtractChannel(data.data(), mono_buffer_.data(), mono_buffer_.size(), 2, 0);
 
-        StoreWakeWordData(mono_data);
-        mn_state = multinet_->detect(multinet_model_data_, const_cast<int16_t*>(mono_data.data()));
+        StoreWakeWordData(mono_buffer_);
+        mn_state = multinet_->detect(multinet_model_data_, mono_buffer_.data());
     } else {
         StoreWakeWordData(data);
         mn_state = multinet_->detect(multinet_model_data_, const_cast<int16_t*>(data.data()));
@@ -194,11 +193,15 @@ size_t CustomWakeWord::GetFeedSize() {
 }
 
 void CustomWakeWord::StoreWakeWordData(const std::vector<int16_t>& data) {
-    // store audio data to wake_word_pcm_
-    wake_word_pcm_.push_back(data);
     // keep about 2 seconds of data, detect duration is 30ms (sample_rate == 16000, chunksize == 512)
-    while (wake_word_pcm_.size() > 2000 / 30) {
+    if (wake_word_pcm_.size() >= 2000 / 30) {
+        // The oldest chunk's buffer is reused for the newest, so a full history costs no allocation
+        auto chunk = std::move(wake_word_pcm_.front());
         wake_word_pcm_.pop_front();
+        chunk.assign(data.begin(), data.end());
+        wake_word_pcm_.push_back(std::move(chunk));
+    } else {
+        wake_word_pcm_.push_back(data);
     }
 }
 
@@ -3,6 +3,7 @@
 #include <algorithm>
 #include "esp_log.h"
 #include "display.h"
+#include "pcm_kernels.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -21,6 +22,7 @@ namespace audio_wifi_config
         const int kInputSampleRate = 16000;                                    // Input sampling rate
         const float kDownsampleStep = static_cast<float>(kInputSampleRate) / static_cast<float>(kAudioSampleRate); // Downsampling step
         std::vector<int16_t> audio_data;
+        std::vector<float> downsampled_data;
         AudioSignalProcessor signal_processor(kAudioSampleRate, kMarkFrequency, kSpaceFrequency, kBitRate, kWindowSize);
         AudioDataBuffer data_buffer;
 
@@ -40,16 +42,13 @@ namespace audio_wifi_config
                 continue;
             }
 
-            if (input_channels == 2) { // 如果是双声道输入，转换为单声道
-                auto mono_data = std::vector<int16_t>(audio_data.size() / 2);
-                for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-                    mono_data[i] = audio_data[j];
-                }
-                audio_data = std::move(mono_data);
+            if (input_channels == 2) { // 如果是双声道输入，原地取左声道转换为单声道
+                PcmExtractChannel(audio_data.data(), audio_data.data(), audio_data.size() / 2, 2, 0);
+                audio_data.resize(audio_data.size() / 2);
             }
             
-            // Downsample the audio data
-            std::vector<float> downsampled_data;
+            // Downsample the audio data, the buffers keep their capacity across reads
+            downsampled_data.clear();
             size_t last_index = 0;
 
             if (kDownsampleStep > 1.0f) {
@@ -5,6 +5,8 @@
 #include <unistd.h>
 #include <errno.h>
 #include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 
@@ -94,6 +96,62 @@ static void log_available_video_devices() {
 #define CAM_PRINT_FOURCC(pixelformat) (void)0;
 #endif  // CONFIG_XIAOZHI_ENABLE_CAMERA_DEBUG_MODE
 
+// 预览图最多占屏幕的比例，与 LcdDisplay::SetPreviewImage 一致
+#define PREVIEW_MAX_WIDTH_PERCENT 70
+#define PREVIEW_MAX_HEIGHT_PERCENT 50
+
+// 预览图按整数步长缩小到屏幕预览区域的大小
+static int GetPreviewScaleStep(int width, int height, Display* display) {
+    int max_width = std::max(display->width() * PREVIEW_MAX_WIDTH_PERCENT / 100, 1);
+    int max_height = std::max(display->height() * PREVIEW_MAX_HEIGHT_PERCENT / 100, 1);
+    int step = std::max((width + max_width - 1) / max_width, (height + max_height - 1) / max_height);
+    return std::max(step, 1);
+}
+
+static inline uint16_t YuvToRgb565(int y, int u, int v) {
+    // BT.601 full range
+    int d = u - 128;
+    int e = v - 128;
+    int r = std::clamp(y + ((359 * e) >> 8), 0, 255);
+    int g = std::clamp(y - ((88 * d + 183 * e) >> 8), 0, 255);
+    int b = std::clamp(y + ((454 * d) >> 8), 0, 255);
+    return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+}
+
+// 逐行取每 step 个像素中的一个，直接转换为 RGB565 写入预览图，不需要整帧大小的中间缓冲
+static void DownscaleToRgb565(const uint8_t* src, size_t src_stride, v4l2_pix_fmt_t format, int step,
+                              uint16_t* dst, int dst_width, int dst_height) {
+    for (int y = 0; y < dst_height; y++) {
+        const uint8_t* row = src + (size_t)(y * step + step / 2) * src_stride;
+        uint16_t* out = dst + (size_t)y * dst_width;
+        for (int x = 0; x < dst_width; x++) {
+            int sx = x * step + step / 2;
+            switch (format) {
+                case V4L2_PIX_FMT_RGB565:
+                    out[x] = ((const uint16_t*)row)[sx];
+                    break;
+                case V4L2_PIX_FMT_RGB24: {
+                    const uint8_t* p = row + sx * 3;
+                    out[x] = ((p[0] & 0xF8) << 8) | ((p[1] & 0xFC) << 3) | (p[2] >> 3);
+                    break;
+                }
+                case V4L2_PIX_FMT_YUYV: {
+                    // 每两个像素共用一组 U、V
+                    const uint8_t* p = row + (sx & ~1) * 2;
+                    out[x] = YuvToRgb565(row[sx * 2], p[1], p[3]);
+                    break;
+                }
+                case V4L2_PIX_FMT_GREY:
+                    out[x] = YuvToRgb565(row[sx], 128, 128);
+                    break;
+                default:
+                    out[x] = 0;
+                    break;
+            }
+        }
+    }
+}
+
 Esp32Camera::Esp32Camera(const esp_video_init_config_t& config) {
     if (esp_video_init(&config) != ESP_OK) {
         ESP_LOGE(TAG, "esp_video_init failed");
@@ -742,10 +800,34 @@ bool Esp32Camera::Capture() {
         uint8_t* data = nullptr;
 
         switch (frame_.format) {
-            // LVGL 显示 YUV 系的图像似乎都有问题，暂时转换为 RGB565 显示
+            // 逐行缩小并转换为屏幕预览区域大小的 RGB565，不再复制整帧
+            case V4L2_PIX_FMT_RGB565:
+            case V4L2_PIX_FMT_RGB24:
             case V4L2_PIX_FMT_YUYV:
-            case V4L2_PIX_FMT_YUV420:
-            case V4L2_PIX_FMT_RGB24: {
+            case V4L2_PIX_FMT_GREY: {
+                int step = GetPreviewScaleStep(w, h, display);
+                uint16_t preview_width = (w / step) & ~1;
+                uint16_t preview_height = h / step;
+                data = (uint8_t*)heap_caps_malloc(preview_width * preview_height * 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+                if (data == nullptr) {
+                    ESP_LOGE(TAG, "Failed to allocate memory for preview image");
+                    return false;
+                }
+                size_t bytes_per_pixel = frame_.format == V4L2_PIX_FMT_GREY ? 1 : frame_.format == V4L2_PIX_FMT_RGB24 ? 3 : 2;
+                int64_t start_time = esp_timer_get_time();
+                DownscaleToRgb565(frame_.data, w * bytes_per_pixel, frame_.format, step, (uint16_t*)data,
+                                  preview_width, preview_height);
+                ESP_LOGI(TAG, "Preview %ux%u -> %ux%u in %lu us", w, h, preview_width, preview_height,
+                         (uint32_t)(esp_timer_get_time() - start_time));
+                w = preview_width;
+                h = preview_height;
+                stride = w * 2;
+                lvgl_image_size = w * h * 2;
+                break;
+            }
+
+            // LVGL 显示 YUV 系的图像似乎都有问题，暂时转换为 RGB565 显示
+            case V4L2_PIX_FMT_YUV420: {
                 color_format = LV_COLOR_FORMAT_RGB565;
                 data = (uint8_t*)heap_caps_malloc(w * h * 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
                 if (data == nullptr) {
@@ -790,16 +872,6 @@ bool Esp32Camera::Capture() {
                 break;
             }
 
-            case V4L2_PIX_FMT_RGB565:
-                data = (uint8_t*)heap_caps_malloc(w * h * 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-                if (data == nullptr) {
-                    ESP_LOGE(TAG, "Failed to allocate memory for preview image");
-                    return false;
-                }
-                memcpy(data, frame_.data, frame_.len);
-                lvgl_image_size = frame_.len;  // fallthrough 时兼顾 YUYV 与 RGB565
-                break;
-
 #ifdef CONFIG_XIAOZHI_CAMERA_ALLOW_JPEG_INPUT
             case V4L2_PIX_FMT_JPEG: {
                 uint8_t* out_data = nullptr;  // out data is allocated by jpeg_to_image
@@ -819,11 +891,28 @@ bool Esp32Camera::Capture() {
                     return false;
                 }
 
-                data = out_data;
-                w = out_width;
-                h = out_height;
-                lvgl_image_size = out_len;
-                stride = out_stride;
+                // 解码后的整帧只在缩小时使用，预览图只保留屏幕大小
+                int step = GetPreviewScaleStep(out_width, out_height, display);
+                if (step == 1) {
+                    data = out_data;
+                    w = out_width;
+                    h = out_height;
+                    lvgl_image_size = out_len;
+                    stride = out_stride;
+                    break;
+                }
+                w = (out_width / step) & ~1;
+                h = out_height / step;
+                data = (uint8_t*)heap_caps_malloc(w * h * 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+                if (data == nullptr) {
+                    ESP_LOGE(TAG, "Failed to allocate memory for preview image");
+                    heap_caps_free(out_data);
+                    return false;
+                }
+                DownscaleToRgb565(out_data, out_stride, V4L2_PIX_FMT_RGB565, step, (uint16_t*)data, w, h);
+                heap_caps_free(out_data);
+                stride = w * 2;
+                lvgl_image_size = w * h * 2;
                 break;
             }
 #endif
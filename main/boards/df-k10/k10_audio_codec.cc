@@ -1,4 +1,5 @@
 #include "k10_audio_codec.h"
+#include "pcm_kernels.h"
 
 #include <esp_log.h>
 #include <driver/i2c_master.h>
@@ -199,22 +200,20 @@ int K10AudioCodec::Read(int16_t* dest, int samples) {
 
 int K10AudioCodec::Write(const int16_t* data, int samples) {
     if (output_enabled_) {
-        std::vector<int32_t> buffer(samples * 2);  // Allocate buffer for 2x samples
+        auto& buffer = write_buffer_;
+        if (buffer.size() < (size_t)samples * 2) {
+            buffer.resize(samples * 2);  // 2x samples
+        }
 
-        // Apply volume adjustment (same as before)
+        // Apply volume adjustment into the upper half, then spread it over the whole buffer
         int32_t volume_factor = pow(double(output_volume_) / 100.0, 2) * 65536;
+        int32_t* scaled = buffer.data() + samples;
+        PcmScaleToInt32(data, scaled, samples, volume_factor);
         for (int i = 0; i < samples; i++) {
-            int64_t temp = int64_t(data[i]) * volume_factor;
-            if (temp > INT32_MAX) {
-            buffer[i * 2] = INT32_MAX;
-            } else if (temp < INT32_MIN) {
-            buffer[i * 2] = INT32_MIN;
-            } else {
-            buffer[i * 2] = static_cast<int32_t>(temp);
-            }
-
             // Repeat each sample for slow playback (assuming mono audio)
-            buffer[i * 2 + 1] = buffer[i * 2];
+            int32_t value = scaled[i];
+            buffer[i * 2] = value;
+            buffer[i * 2 + 1] = value;
         }
 
         size_t bytes_written;
@@ -14,6 +14,7 @@
 #include <cstring>
 
 #include "board.h"
+#include "device_state_event.h"
 
 #define TAG "LcdDisplay"
 
@@ -132,14 +133,32 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
 #endif
     lvgl_port_init(&port_cfg);
 
-    ESP_LOGI(TAG, "Adding LCD display");
+    // Two buffers let LVGL render the next area while the previous one is still on the SPI bus.
+    // PSRAM buffers are not sent by DMA directly, the port copies them through a bounce buffer of trans_size pixels.
+#if CONFIG_SPI_LCD_RENDER_BUFFER_DOUBLE_PSRAM
+    const bool double_buffer = true;
+    const bool buffer_in_psram = true;
+    const uint32_t trans_size = width_ * 10;
+#elif CONFIG_SPI_LCD_RENDER_BUFFER_DOUBLE
+    const bool double_buffer = true;
+    const bool buffer_in_psram = false;
+    const uint32_t trans_size = 0;
+#else
+    const bool double_buffer = false;
+    const bool buffer_in_psram = false;
+    const uint32_t trans_size = 0;
+#endif
+    const int buffer_lines = std::min(CONFIG_SPI_LCD_RENDER_BUFFER_LINES, height_);
+
+    ESP_LOGI(TAG, "Adding LCD display, %d line %s buffer%s", buffer_lines, double_buffer ? "double" : "single",
+        buffer_in_psram ? " in PSRAM" : "");
     const lvgl_port_display_cfg_t display_cfg = {
         .io_handle = panel_io_,
         .panel_handle = panel_,
         .control_handle = nullptr,
-        .buffer_size = static_cast<uint32_t>(width_ * 20),
-        .double_buffer = false,
-        .trans_size = 0,
+        .buffer_size = static_cast<uint32_t>(width_ * buffer_lines),
+        .double_buffer = double_buffer,
+        .trans_size = trans_size,
         .hres = static_cast<uint32_t>(width_),
         .vres = static_cast<uint32_t>(height_),
         .monochrome = false,
@@ -150,8 +169,8 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
         },
         .color_format = LV_COLOR_FORMAT_RGB565,
         .flags = {
-            .buff_dma = 1,
-            .buff_spiram = 0,
+            .buff_dma = !buffer_in_psram,
+            .buff_spiram = buffer_in_psram,
             .sw_rotate = 0,
             .swap_bytes = 1,
             .full_refresh = 0,
@@ -169,6 +188,13 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
         lv_display_set_offset(display_, offset_x, offset_y);
     }
 
+#if CONFIG_USE_LCD_RENDER_STATS
+    if (lvgl_port_lock(0)) {
+        render_stats_.Attach(display_);
+        lvgl_port_unlock();
+    }
+#endif
+
     SetupUI();
 }
 
@@ -302,6 +328,11 @@ LcdDisplay::~LcdDisplay() {
         esp_timer_delete(preview_timer_);
     }
 
+#if CONFIG_USE_WECHAT_MESSAGE_STYLE
+    if (chat_timer_ != nullptr) {
+        lv_timer_delete(chat_timer_);
+    }
+#endif
     if (preview_image_ != nullptr) {
         lv_obj_del(preview_image_);
     }
@@ -471,6 +502,17 @@ void LcdDisplay::SetupUI() {
 
     // We'll create chat messages dynamically in SetChatMessage
     chat_message_label_ = nullptr;
+    chat_timer_ = lv_timer_create([](lv_timer_t* timer) {
+        auto self = static_cast<LcdDisplay*>(lv_timer_get_user_data(timer));
+        self->OnChatTimer();
+    }, CHAT_TIMER_PERIOD_MS, this);
+    lv_timer_pause(chat_timer_);
+
+    // The refresh rate and the scroll animation follow the device state
+    DeviceStateEventManager::GetInstance().RegisterStateChangeCallback([this](DeviceState previous_state, DeviceState current_state) {
+        DisplayLockGuard lock(this);
+        OnDeviceStateChanged(current_state);
+    });
 
     low_battery_popup_ = lv_obj_create(screen);
     lv_obj_set_scrollbar_mode(low_battery_popup_, LV_SCROLLBAR_MODE_OFF);
@@ -499,44 +541,69 @@ void LcdDisplay::SetupUI() {
 #else
 #define  MAX_MESSAGES 20
 #endif
+// New messages are scrolled into view by a timer the first of them starts, a burst of messages scrolls only once
+#define  CHAT_TIMER_PERIOD_MS 100
+
+// Text messages are a full width row holding the bubble and its label, image previews are a bare bubble.
+// Returns the role of a text row, nullptr for anything else.
+static const char* GetChatRowType(lv_obj_t* obj) {
+    if (obj == nullptr || lv_obj_get_child_cnt(obj) == 0) {
+        return nullptr;
+    }
+    auto type = (const char*)lv_obj_get_user_data(lv_obj_get_child(obj, 0));
+    if (type == nullptr || strcmp(type, "image") == 0) {
+        return nullptr;
+    }
+    return type;
+}
+
+lv_obj_t* LcdDisplay::CreateChatRow() {
+    auto lvgl_theme = static_cast<LvglTheme*>(current_theme_);
+
+    // Transparent full width row, so the bubble can be aligned left, right or center
+    lv_obj_t* row = lv_obj_create(content_);
+    lv_obj_set_width(row, LV_HOR_RES);
+    lv_obj_set_height(row, LV_SIZE_CONTENT);
+    lv_obj_set_style_bg_opa(row, LV_OPA_TRANSP, 0);
+    lv_obj_set_style_border_width(row, 0, 0);
+    lv_obj_set_style_pad_all(row, 0, 0);
+
+    lv_obj_t* bubble = lv_obj_create(row);
+    lv_obj_set_style_radius(bubble, 8, 0);
+    lv_obj_set_scrollbar_mode(bubble, LV_SCROLLBAR_MODE_OFF);
+    lv_obj_set_style_border_width(bubble, 0, 0);
+    lv_obj_set_style_pad_all(bubble, lvgl_theme->spacing(4), 0);
+    lv_obj_set_style_bg_opa(bubble, LV_OPA_70, 0);
+    lv_obj_set_size(bubble, LV_SIZE_CONTENT, LV_SIZE_CONTENT);
+    lv_obj_set_style_flex_grow(bubble, 0, 0);
+
+    lv_obj_t* msg_text = lv_label_create(bubble);
+    lv_label_set_long_mode(msg_text, LV_LABEL_LONG_WRAP);
+    return row;
+}
+
 void LcdDisplay::SetChatMessage(const char* role, const char* content) {
     DisplayLockGuard lock(this);
     if (content_ == nullptr) {
         return;
     }
-    
-    // Check if message count exceeds limit
+
+    lv_obj_t* row = nullptr;
     uint32_t child_count = lv_obj_get_child_cnt(content_);
-    if (child_count >= MAX_MESSAGES) {
-        // Delete the oldest message (first child object)
-        lv_obj_t* first_child = lv_obj_get_child(content_, 0);
-        lv_obj_t* last_child = lv_obj_get_child(content_, child_count - 1);
-        if (first_child != nullptr) {
-            lv_obj_del(first_child);
-        }
-        // Scroll to the last message immediately
-        if (last_child != nullptr) {
-            lv_obj_scroll_to_view_recursive(last_child, LV_ANIM_OFF);
-        }
-    }
-    
-    // Collapse system messages (if it's a system message, check if the last message is also a system message)
+    lv_obj_t* last_row = child_count > 0 ? lv_obj_get_child(content_, child_count - 1) : nullptr;
+
+    // Collapse system messages, a system message replaces the last message if that is a system message too
     if (strcmp(role, "system") == 0) {
-        if (child_count > 0) {
-            // Get the last message container
-            lv_obj_t* last_container = lv_obj_get_child(content_, child_count - 1);
-            if (last_container != nullptr && lv_obj_get_child_cnt(last_container) > 0) {
-                // Get the bubble inside the container
-                lv_obj_t* last_bubble = lv_obj_get_child(last_container, 0);
-                if (last_bubble != nullptr) {
-                    // Check if bubble type is system message
-                    void* bubble_type_ptr = lv_obj_get_user_data(last_bubble);
-                    if (bubble_type_ptr != nullptr && strcmp((const char*)bubble_type_ptr, "system") == 0) {
-                        // If the last message is also a system message, delete it
-                        lv_obj_del(last_container);
-                    }
+        auto last_type = GetChatRowType(last_row);
+        if (last_type != nullptr && strcmp(last_type, "system") == 0) {
+            if (content[0] == '\0') {
+                if (chat_message_label_ != nullptr && lv_obj_get_parent(chat_message_label_) == lv_obj_get_child(last_row, 0)) {
+                    chat_message_label_ = nullptr;
                 }
+                lv_obj_del(last_row);
+                return;
             }
+            row = last_row;
         }
     } else {
         // Hide the centered AI logo
@@ -544,147 +611,100 @@ void LcdDisplay::SetChatMessage(const char* role, const char* content) {
     }
 
     // Avoid empty message boxes
-    if(strlen(content) == 0) {
+    if (content[0] == '\0') {
         return;
     }
 
+    // Reuse the oldest message rather than deleting it and building a new one
+    if (row == nullptr && child_count >= MAX_MESSAGES) {
+        lv_obj_t* oldest = lv_obj_get_child(content_, 0);
+        if (GetChatRowType(oldest) != nullptr) {
+            row = oldest;
+            lv_obj_move_to_index(row, -1);
+        } else {
+            lv_obj_del(oldest);
+        }
+    }
+    if (row == nullptr) {
+        row = CreateChatRow();
+    }
+
     auto lvgl_theme = static_cast<LvglTheme*>(current_theme_);
     auto text_font = lvgl_theme->text_font()->font();
+    lv_obj_t* msg_bubble = lv_obj_get_child(row, 0);
+    lv_obj_t* msg_text = lv_obj_get_child(msg_bubble, 0);
 
-    // Create a message bubble
-    lv_obj_t* msg_bubble = lv_obj_create(content_);
-    lv_obj_set_style_radius(msg_bubble, 8, 0);
-    lv_obj_set_scrollbar_mode(msg_bubble, LV_SCROLLBAR_MODE_OFF);
-    lv_obj_set_style_border_width(msg_bubble, 0, 0);
-    lv_obj_set_style_pad_all(msg_bubble, lvgl_theme->spacing(4), 0);
-
-    // Create the message text
-    lv_obj_t* msg_text = lv_label_create(msg_bubble);
-    lv_label_set_text(msg_text, content);
-    
-    // Calculate actual text width
+    // Wrap the text at 85% of the screen width, shorter messages get a bubble just as wide as the text
     lv_coord_t text_width = lv_txt_get_width(content, strlen(content), text_font, 0);
+    lv_coord_t max_width = LV_HOR_RES * 85 / 100 - 16;
+    lv_coord_t min_width = 20;
+    lv_obj_set_width(msg_text, std::clamp(text_width, min_width, max_width));
+    lv_label_set_text(msg_text, content);
 
-    // Calculate bubble width
-    lv_coord_t max_width = LV_HOR_RES * 85 / 100 - 16;  // 85% of screen width
-    lv_coord_t min_width = 20;  
-    lv_coord_t bubble_width;
-    
-    // Ensure text width is not less than minimum width
-    if (text_width < min_width) {
-        text_width = min_width;
+    // A recycled row keeps its styles if the role is the same, only the text is redrawn
+    auto row_type = (const char*)lv_obj_get_user_data(msg_bubble);
+    if (row_type == nullptr || strcmp(row_type, role) != 0) {
+        if (strcmp(role, "user") == 0) {
+            // User messages are right-aligned
+            lv_obj_set_style_bg_color(msg_bubble, lvgl_theme->user_bubble_color(), 0);
+            lv_obj_set_style_text_color(msg_text, lvgl_theme->text_color(), 0);
+            lv_obj_set_user_data(msg_bubble, (void*)"user");
+            lv_obj_align(msg_bubble, LV_ALIGN_RIGHT_MID, -25, 0);
+        } else if (strcmp(role, "assistant") == 0) {
+            // Assistant messages are left-aligned
+            lv_obj_set_style_bg_color(msg_bubble, lvgl_theme->assistant_bubble_color(), 0);
+            lv_obj_set_style_text_color(msg_text, lvgl_theme->text_color(), 0);
+            lv_obj_set_user_data(msg_bubble, (void*)"assistant");
+            lv_obj_align(msg_bubble, LV_ALIGN_LEFT_MID, 0, 0);
+        } else if (strcmp(role, "system") == 0) {
+            // System messages are centered
+            lv_obj_set_style_bg_color(msg_bubble, lvgl_theme->system_bubble_color(), 0);
+            lv_obj_set_style_text_color(msg_text, lvgl_theme->system_text_color(), 0);
+            lv_obj_set_user_data(msg_bubble, (void*)"system");
+            lv_obj_align(msg_bubble, LV_ALIGN_CENTER, 0, 0);
+        }
     }
 
-    // If text width is less than max width, use text width
-    if (text_width < max_width) {
-        bubble_width = text_width; 
-    } else {
-        bubble_width = max_width;
+    // Store reference to the latest message label
+    chat_message_label_ = msg_text;
+    ScheduleChatScroll();
+#if CONFIG_USE_LCD_RENDER_STATS
+    render_stats_.CountMessage();
+#endif
+}
+
+void LcdDisplay::ScheduleChatScroll() {
+    if (!chat_scroll_pending_) {
+        chat_scroll_pending_ = true;
+        lv_timer_reset(chat_timer_);
+        lv_timer_resume(chat_timer_);
     }
-    
-    // Set message text width
-    lv_obj_set_width(msg_text, bubble_width);  // Subtract padding
-    lv_label_set_long_mode(msg_text, LV_LABEL_LONG_WRAP);
+}
 
-    // Set bubble width
-    lv_obj_set_width(msg_bubble, bubble_width);
-    lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-
-    // Set alignment and style based on message role
-    if (strcmp(role, "user") == 0) {
-        // User messages are right-aligned with green background
-        lv_obj_set_style_bg_color(msg_bubble, lvgl_theme->user_bubble_color(), 0);
-        lv_obj_set_style_bg_opa(msg_bubble, LV_OPA_70, 0);
-        // Set text color for contrast
-        lv_obj_set_style_text_color(msg_text, lvgl_theme->text_color(), 0);
-        
-        // Set custom attribute to mark bubble type
-        lv_obj_set_user_data(msg_bubble, (void*)"user");
-        
-        // Set appropriate width for content
-        lv_obj_set_width(msg_bubble, LV_SIZE_CONTENT);
-        lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-        
-        // Don't grow
-        lv_obj_set_style_flex_grow(msg_bubble, 0, 0);
-    } else if (strcmp(role, "assistant") == 0) {
-        // Assistant messages are left-aligned with white background
-        lv_obj_set_style_bg_color(msg_bubble, lvgl_theme->assistant_bubble_color(), 0);
-        lv_obj_set_style_bg_opa(msg_bubble, LV_OPA_70, 0);
-        // Set text color for contrast
-        lv_obj_set_style_text_color(msg_text, lvgl_theme->text_color(), 0);
-        
-        // Set custom attribute to mark bubble type
-        lv_obj_set_user_data(msg_bubble, (void*)"assistant");
-        
-        // Set appropriate width for content
-        lv_obj_set_width(msg_bubble, LV_SIZE_CONTENT);
-        lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-        
-        // Don't grow
-        lv_obj_set_style_flex_grow(msg_bubble, 0, 0);
-    } else if (strcmp(role, "system") == 0) {
-        // System messages are center-aligned with light gray background
-        lv_obj_set_style_bg_color(msg_bubble, lvgl_theme->system_bubble_color(), 0);
-        lv_obj_set_style_bg_opa(msg_bubble, LV_OPA_70, 0);
-        // Set text color for contrast
-        lv_obj_set_style_text_color(msg_text, lvgl_theme->system_text_color(), 0);
-        
-        // Set custom attribute to mark bubble type
-        lv_obj_set_user_data(msg_bubble, (void*)"system");
-        
-        // Set appropriate width for content
-        lv_obj_set_width(msg_bubble, LV_SIZE_CONTENT);
-        lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-        
-        // Don't grow
-        lv_obj_set_style_flex_grow(msg_bubble, 0, 0);
+void LcdDisplay::OnChatTimer() {
+    lv_timer_pause(chat_timer_);
+    chat_scroll_pending_ = false;
+    uint32_t child_count = lv_obj_get_child_cnt(content_);
+    if (child_count > 0) {
+        // An animated scroll redraws the whole chat area on every frame, jump instead while audio is playing
+        lv_obj_scroll_to_view_recursive(lv_obj_get_child(content_, child_count - 1), speaking_ ? LV_ANIM_OFF : LV_ANIM_ON);
     }
-    
-    // Create a full-width container for user messages to ensure right alignment
-    if (strcmp(role, "user") == 0) {
-        // Create a full-width container
-        lv_obj_t* container = lv_obj_create(content_);
-        lv_obj_set_width(container, LV_HOR_RES);
-        lv_obj_set_height(container, LV_SIZE_CONTENT);
-        
-        // Make container transparent and borderless
-        lv_obj_set_style_bg_opa(container, LV_OPA_TRANSP, 0);
-        lv_obj_set_style_border_width(container, 0, 0);
-        lv_obj_set_style_pad_all(container, 0, 0);
-        
-        // Move the message bubble into this container
-        lv_obj_set_parent(msg_bubble, container);
-        
-        // Right align the bubble in the container
-        lv_obj_align(msg_bubble, LV_ALIGN_RIGHT_MID, -25, 0);
-        
-        // Auto-scroll to this container
-        lv_obj_scroll_to_view_recursive(container, LV_ANIM_ON);
-    } else if (strcmp(role, "system") == 0) {
-        // Create full-width container for system messages to ensure center alignment
-        lv_obj_t* container = lv_obj_create(content_);
-        lv_obj_set_width(container, LV_HOR_RES);
-        lv_obj_set_height(container, LV_SIZE_CONTENT);
-        
-        lv_obj_set_style_bg_opa(container, LV_OPA_TRANSP, 0);
-        lv_obj_set_style_border_width(container, 0, 0);
-        lv_obj_set_style_pad_all(container, 0, 0);
-        
-        lv_obj_set_parent(msg_bubble, container);
-        lv_obj_align(msg_bubble, LV_ALIGN_CENTER, 0, 0);
-        lv_obj_scroll_to_view_recursive(container, LV_ANIM_ON);
-    } else {
-        // For assistant messages
-        // Left align assistant messages
-        lv_obj_align(msg_bubble, LV_ALIGN_LEFT_MID, 0, 0);
+}
 
-        // Auto-scroll to the message bubble
-        lv_obj_scroll_to_view_recursive(msg_bubble, LV_ANIM_ON);
+void LcdDisplay::OnDeviceStateChanged(DeviceState state) {
+    bool speaking = state == kDeviceStateSpeaking;
+    if (speaking == speaking_) {
+        return;
     }
-    
-    // Store reference to the latest message label
-    chat_message_label_ = msg_text;
+    speaking_ = speaking;
+
+#if CONFIG_LCD_SPEAKING_REFRESH_PERIOD_MS > 0
+    // Render budget: refresh less often while audio is playing, so the LVGL task leaves the CPU to audio
+    lv_timer_t* refresh_timer = lv_display_get_refr_timer(display_);
+    if (refresh_timer != nullptr) {
+        lv_timer_set_period(refresh_timer, speaking ? CONFIG_LCD_SPEAKING_REFRESH_PERIOD_MS : LV_DEF_REFR_PERIOD);
+    }
+#endif
 }
 
 void LcdDisplay::SetPreviewImage(std::unique_ptr<LvglImage> image) {
@@ -767,8 +787,7 @@ void LcdDisplay::SetPreviewImage(std::unique_ptr<LvglImage> image) {
     // Left align the image bubble like assistant messages
     lv_obj_align(img_bubble, LV_ALIGN_LEFT_MID, 0, 0);
 
-    // Auto-scroll to the image bubble
-    lv_obj_scroll_to_view_recursive(img_bubble, LV_ANIM_ON);
+    ScheduleChatScroll();
 }
 #else
 void LcdDisplay::SetupUI() {
@@ -3,6 +3,8 @@
 
 #include "lvgl_display.h"
 #include "gif/lvgl_gif.h"
+#include "lvgl_render_stats.h"
+#include "device_state.h"
 
 #include <esp_lcd_panel_io.h>
 #include <esp_lcd_panel_ops.h>
@@ -35,9 +37,24 @@ protected:
     esp_timer_handle_t preview_timer_ = nullptr;
     std::unique_ptr<LvglImage> preview_image_cached_ = nullptr;
     bool hide_subtitle_ = false;  // Control whether to hide chat messages/subtitles
+#if CONFIG_USE_WECHAT_MESSAGE_STYLE
+    // Runs only while a scroll is pending
+    lv_timer_t* chat_timer_ = nullptr;
+    bool chat_scroll_pending_ = false;
+    bool speaking_ = false;
+#endif
+#if CONFIG_USE_LCD_RENDER_STATS
+    LvglRenderStats render_stats_;
+#endif
 
     void InitializeLcdThemes();
     void SetupUI();
+#if CONFIG_USE_WECHAT_MESSAGE_STYLE
+    lv_obj_t* CreateChatRow();
+    void ScheduleChatScroll();
+    void OnChatTimer();
+    void OnDeviceStateChanged(DeviceState state);
+#endif
     virtual bool Lock(int timeout_ms = 0) override;
     virtual void Unlock() override;
 
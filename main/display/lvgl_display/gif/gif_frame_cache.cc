@@ -0,0 +1,79 @@
+#include "gif_frame_cache.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <algorithm>
+
+#define TAG "GifFrameCache"
+
+#ifndef CONFIG_GIF_FRAME_CACHE_SIZE_KB
+#define CONFIG_GIF_FRAME_CACHE_SIZE_KB 1024
+#endif
+
+#define GIF_FRAME_CACHE_SIZE (CONFIG_GIF_FRAME_CACHE_SIZE_KB * 1024)
+
+GifFrameCache::Animation::~Animation() {
+    auto& cache = GifFrameCache::GetInstance();
+    for (auto& frame : frames) {
+        cache.FreeFrame(frame.pixels, frame_size);
+    }
+}
+
+std::shared_ptr<const GifFrameCache::Animation> GifFrameCache::Find(const void* data, size_t data_size) {
+    for (auto it = animations_.begin(); it != animations_.end(); ++it) {
+        if ((*it)->data == data && (*it)->data_size == data_size) {
+            animations_.splice(animations_.begin(), animations_, it);
+            return animations_.front();
+        }
+    }
+    return nullptr;
+}
+
+bool GifFrameCache::IsCacheable(const void* data, size_t data_size) const {
+    return std::find(uncacheable_.begin(), uncacheable_.end(), std::make_pair(data, data_size)) == uncacheable_.end();
+}
+
+void GifFrameCache::MarkUncacheable(const void* data, size_t data_size) {
+    if (IsCacheable(data, data_size)) {
+        uncacheable_.emplace_back(data, data_size);
+    }
+}
+
+uint8_t* GifFrameCache::AllocateFrame(const Animation& animation) {
+    if (animation.size() + animation.frame_size > GIF_FRAME_CACHE_SIZE) {
+        ESP_LOGW(TAG, "GIF with more than %u frames of %u KB does not fit, not cached", animation.frames.size(),
+            animation.frame_size / 1024);
+        MarkUncacheable(animation.data, animation.data_size);
+        return nullptr;
+    }
+
+    // Free the least recently used animations that nobody is playing
+    auto it = animations_.end();
+    while (used_ + animation.frame_size > GIF_FRAME_CACHE_SIZE && it != animations_.begin()) {
+        --it;
+        if (it->use_count() == 1) {
+            ESP_LOGD(TAG, "Evict %u frames, %u KB", (*it)->frames.size(), (*it)->size() / 1024);
+            it = animations_.erase(it);
+        }
+    }
+    if (used_ + animation.frame_size > GIF_FRAME_CACHE_SIZE) {
+        return nullptr;
+    }
+
+    auto pixels = (uint8_t*)heap_caps_malloc(animation.frame_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (pixels != nullptr) {
+        used_ += animation.frame_size;
+    }
+    return pixels;
+}
+
+void GifFrameCache::Insert(std::shared_ptr<Animation> animation) {
+    ESP_LOGI(TAG, "Cached %u frames, %u KB, decode %lu us/frame, %u KB used", animation->frames.size(),
+        animation->size() / 1024, (uint32_t)(animation->decode_time_us / animation->frames.size()), used_ / 1024);
+    animations_.push_front(std::move(animation));
+}
+
+void GifFrameCache::FreeFrame(uint8_t* pixels, size_t size) {
+    heap_caps_free(pixels);
+    used_ -= size;
+}
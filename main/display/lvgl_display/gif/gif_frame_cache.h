@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <vector>
+
+/**
+ * Decoded GIF frames in PSRAM, shared by all LvglGif instances
+ *
+ * An animation is recorded while its first loop is decoded and added once complete. Later instances of
+ * the same GIF play the recorded frames, which costs a pointer swap per frame instead of an LZW decode.
+ * The cache is limited to CONFIG_GIF_FRAME_CACHE_SIZE_KB; when a new frame does not fit, the least
+ * recently used animations that are not playing are freed.
+ *
+ * Only used from the LVGL task or with the LVGL lock held, like the LvglGif instances.
+ */
+class GifFrameCache {
+public:
+    struct Frame {
+        uint8_t* pixels;    // ARGB8888, width * height * 4 bytes
+        uint16_t delay;     // In 1/100 s, as in the graphic control extension
+    };
+
+    struct Animation {
+        const void* data = nullptr;     // GIF file data, the cache key
+        size_t data_size = 0;
+        size_t frame_size = 0;
+        int32_t loop_count = -1;
+        std::vector<Frame> frames;
+        int64_t decode_time_us = 0;     // Total time it took to decode the recorded frames
+
+        ~Animation();
+        size_t size() const { return frames.size() * frame_size; }
+    };
+
+    static GifFrameCache& GetInstance() {
+        static GifFrameCache instance;
+        return instance;
+    }
+    GifFrameCache(const GifFrameCache&) = delete;
+    GifFrameCache& operator=(const GifFrameCache&) = delete;
+
+    // Returns the complete animation of this GIF, nullptr if it is not cached
+    std::shared_ptr<const Animation> Find(const void* data, size_t data_size);
+    // Returns false if the GIF is known not to fit into the cache or not to loop seamlessly
+    bool IsCacheable(const void* data, size_t data_size) const;
+    void MarkUncacheable(const void* data, size_t data_size);
+
+    // Allocates a frame for an animation being recorded, freeing unused animations if needed.
+    // Returns nullptr if the frame does not fit, an animation larger than the whole cache is marked uncacheable.
+    uint8_t* AllocateFrame(const Animation& animation);
+    void Insert(std::shared_ptr<Animation> animation);
+
+private:
+    GifFrameCache() = default;
+
+    std::list<std::shared_ptr<Animation>> animations_;     // Most recently used first
+    std::vector<std::pair<const void*, size_t>> uncacheable_;
+    size_t used_ = 0;   // Bytes of all frames alive, including evicted animations that are still playing
+
+    void FreeFrame(uint8_t* pixels, size_t size);
+};
@@ -36,6 +36,8 @@ static void f_gif_close(gd_GIF * gif);
 
 #if LV_USE_DRAW_SW_ASM == LV_DRAW_SW_ASM_HELIUM
     #include "gifdec_mve.h"
+#else
+    #include "gifdec_lut.h"
 #endif
 
 static uint16_t
@@ -150,7 +152,7 @@ static gd_GIF * gif_open(gd_GIF * gif_base)
     #endif
 
 #ifdef GIFDEC_FILL_BG
-    GIFDEC_FILL_BG(gif->canvas, gif->width * gif->height, 1, gif->width * gif->height, bgcolor, 0x00);
+    GIFDEC_FILL_BG(gif->canvas, gif->width, gif->height, gif->width, bgcolor, 0x00);
 #else
     for(int i = 0; i < gif->width * gif->height; i++) {
         gif->canvas[i * 4 + 0] = *(bgcolor + 2);
@@ -161,6 +163,7 @@ static gd_GIF * gif_open(gd_GIF * gif_base)
 #endif
     gif->anim_start = f_gif_seek(gif, 0, LV_FS_SEEK_CUR);
     gif->loop_count = -1;
+    gif->frame_index = -1;
     goto ok;
 fail:
     f_gif_close(gif_base);
@@ -732,6 +735,7 @@ gd_get_frame(gd_GIF * gif)
     while(sep != ',') {
         if(sep == ';') {
             f_gif_seek(gif, gif->anim_start, LV_FS_SEEK_SET);
+            gif->frame_index = -1;
             if(gif->loop_count == 1 || gif->loop_count < 0) {
                 return 0;
             }
@@ -746,6 +750,7 @@ gd_get_frame(gd_GIF * gif)
     }
     if(read_image(gif) == -1)
         return -1;
+    gif->frame_index++;
     return 1;
 }
 
@@ -759,6 +764,7 @@ void
 gd_rewind(gd_GIF * gif)
 {
     gif->loop_count = -1;
+    gif->frame_index = -1;
     f_gif_seek(gif, gif->anim_start, LV_FS_SEEK_SET);
 }
 
@@ -0,0 +1,101 @@
+/**
+ * @file gifdec_lut.h
+ *
+ * Word-wise versions of GIFDEC_FILL_BG / GIFDEC_RENDER_FRAME for targets without Helium (ESP32-S3, P4, C3...).
+ * The palette is expanded once per frame into 32-bit ARGB8888 words, so every pixel costs one lookup and
+ * one aligned 32-bit store instead of three palette loads and four byte stores.
+ * Plain C, no SIMD. The output is bit-exact with the scalar loops in gifdec.c, see tests/host/gifdec_lut_test.cc.
+ */
+
+#ifndef GIFDEC_LUT_H
+#define GIFDEC_LUT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdint.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define GIFDEC_FILL_BG(dst, w, h, stride, color, opa) \
+    _gifdec_fill_bg_lut(dst, w, h, stride, color, opa)
+
+#define GIFDEC_RENDER_FRAME(dst, w, h, stride, frame, pattern, tindex) \
+    _gifdec_render_frame_lut(dst, w, h, stride, frame, pattern, tindex)
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/* Palette entries are R, G, B; the canvas is B, G, R, A in memory, i.e. 0xAARRGGBB as a little endian word */
+static inline uint32_t _gifdec_argb(const uint8_t * color, uint8_t opa)
+{
+    return ((uint32_t)opa << 24) | ((uint32_t)color[0] << 16) | ((uint32_t)color[1] << 8) | color[2];
+}
+
+static inline void _gifdec_fill_bg_lut(uint8_t * dst, uint16_t w, uint16_t h, uint16_t stride, uint8_t * color,
+                                       uint8_t opa)
+{
+    uint32_t argb = _gifdec_argb(color, opa);
+    /* The canvas is allocated right after gd_GIF, so every pixel is word aligned */
+    uint32_t * row = (uint32_t *)dst;
+
+    for(uint16_t y = 0; y < h; y++) {
+        for(uint16_t x = 0; x < w; x++) {
+            row[x] = argb;
+        }
+        row += stride;
+    }
+}
+
+static inline void _gifdec_render_frame_lut(uint8_t * dst, uint16_t w, uint16_t h, uint16_t stride, uint8_t * frame,
+                                            uint8_t * pattern, uint16_t tindex)
+{
+    /* Only used from the LVGL task, so one table serves all GIFs */
+    static uint32_t lut[0x100];
+
+    if(w == 0 || h == 0) {
+        return;
+    }
+
+    for(int i = 0; i < 0x100; i++) {
+        lut[i] = _gifdec_argb(&pattern[i * 3], 0xFF);
+    }
+
+    uint32_t * dst_row = (uint32_t *)dst;
+    const uint8_t * src_row = frame;
+    if(tindex > 0xFF) {
+        /* No transparent index, every pixel is written */
+        for(uint16_t y = 0; y < h; y++) {
+            for(uint16_t x = 0; x < w; x++) {
+                dst_row[x] = lut[src_row[x]];
+            }
+            dst_row += stride;
+            src_row += stride;
+        }
+    }
+    else {
+        for(uint16_t y = 0; y < h; y++) {
+            for(uint16_t x = 0; x < w; x++) {
+                uint8_t index = src_row[x];
+                if(index != tindex) {
+                    dst_row[x] = lut[index];
+                }
+            }
+            dst_row += stride;
+            src_row += stride;
+        }
+    }
+}
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*GIFDEC_LUT_H*/
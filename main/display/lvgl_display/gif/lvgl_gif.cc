@@ -1,5 +1,6 @@
 #include "lvgl_gif.h"
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <cstring>
 
 #define TAG "LvglGif"
@@ -35,6 +36,19 @@ LvglGif::LvglGif(const lv_img_dsc_t* img_dsc)
 
     loaded_ = true;
     ESP_LOGD(TAG, "GIF loaded from image descriptor: %dx%d", gif_->width, gif_->height);
+
+#if CONFIG_USE_GIF_FRAME_CACHE
+    auto& cache = GifFrameCache::GetInstance();
+    cached_ = cache.Find(img_dsc->data, img_dsc->data_size);
+    if (cached_) {
+        gif_->loop_count = cached_->loop_count;
+    } else if (cache.IsCacheable(img_dsc->data, img_dsc->data_size)) {
+        recording_ = std::make_shared<GifFrameCache::Animation>();
+        recording_->data = img_dsc->data;
+        recording_->data_size = img_dsc->data_size;
+        recording_->frame_size = img_dsc_.data_size;
+    }
+#endif
 }
 
 // Destructor
@@ -106,6 +120,12 @@ void LvglGif::Stop() {
 
     if (gif_) {
         gd_rewind(gif_);
+        // A recording has to start with the first frame on a clean canvas
+        recording_.reset();
+        if (cached_) {
+            cached_frame_ = -1;
+            gif_->loop_count = cached_->loop_count;
+        }
         NextFrame();
         ESP_LOGD(TAG, "GIF animation stopped and rewound");
     }
@@ -157,6 +177,11 @@ void LvglGif::NextFrame() {
         return;
     }
 
+    if (cached_) {
+        NextCachedFrame();
+        return;
+    }
+
     // Check if enough time has passed for the next frame
     uint32_t elapsed = lv_tick_elaps(last_call_);
     if (elapsed < gif_->gce.delay * 10) {
@@ -166,6 +191,7 @@ void LvglGif::NextFrame() {
     last_call_ = lv_tick_get();
 
     // Get next frame
+    int64_t decode_start_time = esp_timer_get_time();
     int has_next = gd_get_frame(gif_);
     if (has_next == 0) {
         // Animation finished, pause timer
@@ -179,6 +205,9 @@ void LvglGif::NextFrame() {
     // Render current frame
     if (gif_->canvas) {
         gd_render_frame(gif_, gif_->canvas);
+        if (recording_) {
+            RecordFrame(has_next, esp_timer_get_time() - decode_start_time);
+        }
         
         // Call frame callback if set
         if (frame_callback_) {
@@ -187,6 +216,79 @@ void LvglGif::NextFrame() {
     }
 }
 
+void LvglGif::NextCachedFrame() {
+    uint16_t delay = cached_frame_ >= 0 ? cached_->frames[cached_frame_].delay : 0;
+    if (lv_tick_elaps(last_call_) < delay * 10) {
+        return;
+    }
+    last_call_ = lv_tick_get();
+
+    // Same loop handling as gd_get_frame
+    if (++cached_frame_ == (int32_t)cached_->frames.size()) {
+        if (gif_->loop_count == 1 || gif_->loop_count < 0) {
+            cached_frame_--;
+            playing_ = false;
+            if (timer_) {
+                lv_timer_pause(timer_);
+            }
+            ESP_LOGD(TAG, "GIF animation completed");
+            return;
+        }
+        if (gif_->loop_count > 1) {
+            gif_->loop_count--;
+        }
+        cached_frame_ = 0;
+    }
+
+    img_dsc_.data = cached_->frames[cached_frame_].pixels;
+    if (frame_callback_) {
+        frame_callback_();
+    }
+}
+
+void LvglGif::RecordFrame(int has_next, int64_t decode_time_us) {
+    auto& cache = GifFrameCache::GetInstance();
+    auto& frames = recording_->frames;
+
+    if (has_next < 0) {
+        cache.MarkUncacheable(recording_->data, recording_->data_size);
+        recording_.reset();
+        return;
+    }
+
+    if (has_next == 0 || (gif_->frame_index == 0 && !frames.empty())) {
+        // End of the first loop. The next loop starts from the canvas the last frame left behind, if that
+        // differs from the start of the first loop the recorded frames can not be replayed in a loop.
+        if (has_next == 1 && memcmp(gif_->canvas, frames[0].pixels, recording_->frame_size) != 0) {
+            ESP_LOGD(TAG, "GIF loops are not identical, not cached");
+            cache.MarkUncacheable(recording_->data, recording_->data_size);
+        } else if (!frames.empty()) {
+            cache.Insert(std::move(recording_));
+        }
+        recording_.reset();
+        return;
+    }
+
+    if (gif_->frame_index != (int32_t)frames.size()) {
+        recording_.reset();
+        return;
+    }
+
+    auto pixels = cache.AllocateFrame(*recording_);
+    if (pixels == nullptr) {
+        recording_.reset();
+        return;
+    }
+
+    if (frames.empty()) {
+        // The NETSCAPE extension comes before the first frame
+        recording_->loop_count = gif_->loop_count;
+    }
+    memcpy(pixels, gif_->canvas, recording_->frame_size);
+    frames.push_back({pixels, gif_->gce.delay});
+    recording_->decode_time_us += decode_time_us;
+}
+
 void LvglGif::Cleanup() {
     // Stop and delete timer
     if (timer_) {
@@ -194,6 +296,9 @@ void LvglGif::Cleanup() {
         timer_ = nullptr;
     }
 
+    cached_.reset();
+    recording_.reset();
+
     // Close GIF decoder
     if (gif_) {
         gd_close_gif(gif_);
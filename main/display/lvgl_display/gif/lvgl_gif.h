@@ -2,6 +2,7 @@
 
 #include "../lvgl_image.h"
 #include "gifdec.h"
+#include "gif_frame_cache.h"
 #include <lvgl.h>
 #include <memory>
 #include <functional>
@@ -88,11 +89,28 @@ private:
     
     // Frame update callback
     std::function<void()> frame_callback_;
+
+    // Frames from the shared cache, played instead of decoding
+    std::shared_ptr<const GifFrameCache::Animation> cached_;
+    int32_t cached_frame_ = -1;
+
+    // Frames of the first loop, added to the cache once the loop is complete
+    std::shared_ptr<GifFrameCache::Animation> recording_;
     
     /**
      * Update to next frame
      */
     void NextFrame();
+
+    /**
+     * Show the next cached frame
+     */
+    void NextCachedFrame();
+
+    /**
+     * Copy the frame just decoded into the recording
+     */
+    void RecordFrame(int has_next, int64_t decode_time_us);
     
     /**
      * Cleanup resources
@@ -0,0 +1,84 @@
+#include "lvgl_render_stats.h"
+
+#include <algorithm>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#define TAG "RenderStats"
+
+#define RENDER_STATS_PRINT_INTERVAL_US (10 * 1000000LL)
+
+void LvglRenderStats::Attach(lv_display_t* display) {
+    // The caller holds the LVGL lock, the callbacks then run in the LVGL task
+    lv_display_add_event_cb(display, EventCallback, LV_EVENT_REFR_START, this);
+    lv_display_add_event_cb(display, EventCallback, LV_EVENT_RENDER_START, this);
+    lv_display_add_event_cb(display, EventCallback, LV_EVENT_FLUSH_WAIT_START, this);
+    lv_display_add_event_cb(display, EventCallback, LV_EVENT_FLUSH_WAIT_FINISH, this);
+    lv_display_add_event_cb(display, EventCallback, LV_EVENT_REFR_READY, this);
+    lv_display_add_event_cb(display, EventCallback, LV_EVENT_INVALIDATE_AREA, this);
+}
+
+void LvglRenderStats::EventCallback(lv_event_t* e) {
+    auto stats = (LvglRenderStats*)lv_event_get_user_data(e);
+    stats->OnEvent(lv_event_get_code(e), lv_event_get_param(e));
+}
+
+void LvglRenderStats::OnEvent(lv_event_code_t code, void* param) {
+    int64_t now = esp_timer_get_time();
+    switch (code) {
+        case LV_EVENT_REFR_START:
+            refresh_start_time_ = now;
+            rendered_ = false;
+            frame_flush_wait_us_ = 0;
+            break;
+        case LV_EVENT_RENDER_START:
+            rendered_ = true;
+            break;
+        case LV_EVENT_FLUSH_WAIT_START:
+            flush_wait_start_time_ = now;
+            break;
+        case LV_EVENT_FLUSH_WAIT_FINISH:
+            frame_flush_wait_us_ += now - flush_wait_start_time_;
+            break;
+        case LV_EVENT_REFR_READY:
+            if (rendered_ && refresh_start_time_ > 0) {
+                uint32_t refresh_us = now - refresh_start_time_;
+                frames_++;
+                total_refresh_us_ += refresh_us;
+                total_flush_wait_us_ += frame_flush_wait_us_;
+                max_refresh_us_ = std::max(max_refresh_us_, refresh_us);
+            }
+            if (now - last_print_time_ >= RENDER_STATS_PRINT_INTERVAL_US) {
+                Print(now);
+            }
+            break;
+        case LV_EVENT_INVALIDATE_AREA:
+            if (param != nullptr) {
+                invalidated_pixels_ += lv_area_get_size((const lv_area_t*)param);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void LvglRenderStats::Print(int64_t now) {
+    if (last_print_time_ > 0 && frames_ > 0) {
+        float seconds = (now - last_print_time_) / 1000000.0f;
+        ESP_LOGI(TAG, "%.1f fps, frame avg=%lu max=%lu us, render avg=%lu us, flush wait avg=%lu us",
+            frames_ / seconds, (uint32_t)(total_refresh_us_ / frames_), max_refresh_us_,
+            (uint32_t)((total_refresh_us_ - total_flush_wait_us_) / frames_),
+            (uint32_t)(total_flush_wait_us_ / frames_));
+        if (messages_ > 0) {
+            ESP_LOGI(TAG, "%lu messages, invalidated %lu px/frame, %lu px/message", messages_,
+                (uint32_t)(invalidated_pixels_ / frames_), (uint32_t)(invalidated_pixels_ / messages_));
+        }
+    }
+    last_print_time_ = now;
+    frames_ = 0;
+    total_refresh_us_ = 0;
+    total_flush_wait_us_ = 0;
+    max_refresh_us_ = 0;
+    invalidated_pixels_ = 0;
+    messages_ = 0;
+}
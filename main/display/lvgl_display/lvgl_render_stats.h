@@ -0,0 +1,39 @@
+#pragma once
+
+#include <lvgl.h>
+#include <cstdint>
+
+/*
+ * Frame statistics of an LVGL display, from the display refresh events.
+ *
+ * A frame is a refresh that rendered something. Its time is split into the time LVGL waited for the
+ * display transfer (flush wait) and the rest, which is mostly rendering. With a single render buffer every
+ * transfer is waited for; with double buffering the wait should mostly disappear.
+ *
+ * Invalidated pixels are summed as LVGL reports them, overlapping areas count twice. Divided by the chat
+ * messages shown in the same interval, they give the redraw cost of a message, including whatever else
+ * changed on the screen meanwhile.
+ */
+class LvglRenderStats {
+public:
+    void Attach(lv_display_t* display);
+    void CountMessage() { messages_++; }
+
+private:
+    int64_t refresh_start_time_ = 0;
+    int64_t flush_wait_start_time_ = 0;
+    bool rendered_ = false;
+    int64_t frame_flush_wait_us_ = 0;
+
+    uint32_t frames_ = 0;
+    int64_t total_refresh_us_ = 0;
+    int64_t total_flush_wait_us_ = 0;
+    uint32_t max_refresh_us_ = 0;
+    uint64_t invalidated_pixels_ = 0;
+    uint32_t messages_ = 0;
+    int64_t last_print_time_ = 0;
+
+    static void EventCallback(lv_event_t* e);
+    void OnEvent(lv_event_code_t code, void* param);
+    void Print(int64_t now);
+};
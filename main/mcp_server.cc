@@ -99,7 +99,7 @@ void McpServer::AddCommonTools() {
 
     auto camera = board.GetCamera();
     if (camera) {
-        AddTool("self.camera.take_photo",
+        auto tool = new McpTool("self.camera.take_photo",
             "Take a photo and explain it. Use this tool after the user asks you to see something.\n"
             "Args:\n"
             "  `question`: The question that you want to ask about the photo.\n"
@@ -118,6 +118,9 @@ void McpServer::AddCommonTools() {
                 auto question = properties["question"].value<std::string>();
                 return camera->Explain(question);
             });
+        // Capture and upload take seconds
+        tool->set_blocking(true);
+        AddTool(tool);
     }
 #endif
 
@@ -552,14 +555,19 @@ void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* to
         return;
     }
 
-    // Use main thread to call the tool
+    // Use main thread to call the tool, behind audio and state changes. Blocking tools go to a worker.
     auto& app = Application::GetInstance();
-    app.Schedule([this, id, tool_iter, arguments = std::move(arguments)]() {
+    auto call = [this, id, tool_iter, arguments = std::move(arguments)]() {
         try {
             ReplyResult(id, (*tool_iter)->Call(arguments));
         } catch (const std::exception& e) {
             ESP_LOGE(TAG, "tools/call: %s", e.what());
             ReplyError(id, e.what());
         }
-    });
+    };
+    if ((*tool_iter)->blocking()) {
+        app.ScheduleWorker(std::move(call));
+    } else {
+        app.Schedule(std::move(call), kTaskPriorityBackground);
+    }
 }
@@ -212,6 +212,7 @@ private:
     PropertyList properties_;
     std::function<ReturnValue(const PropertyList&)> callback_;
     bool user_only_ = false;
+    bool blocking_ = false;
 
 public:
     McpTool(const std::string& name, 
@@ -224,10 +225,13 @@ public:
         callback_(callback) {}
 
     void set_user_only(bool user_only) { user_only_ = user_only; }
+    // Blocking tools run on a scheduler worker instead of the main event loop
+    void set_blocking(bool blocking) { blocking_ = blocking; }
     inline const std::string& name() const { return name_; }
     inline const std::string& description() const { return description_; }
     inline const PropertyList& properties() const { return properties_; }
     inline bool user_only() const { return user_only_; }
+    inline bool blocking() const { return blocking_; }
 
     std::string to_json() const {
         std::vector<std::string> required = properties_.GetRequired();
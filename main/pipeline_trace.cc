@@ -0,0 +1,134 @@
+#include "pipeline_trace.h"
+#include "processors/audio_debugger.h"
+
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <cstdio>
+#include <cstring>
+
+#define TAG "PipelineTrace"
+
+// Datagrams stay below the usual MTU
+#define PIPELINE_TRACE_UDP_PAYLOAD 1200
+
+static_assert((CONFIG_PIPELINE_TRACE_EVENTS & (CONFIG_PIPELINE_TRACE_EVENTS - 1)) == 0,
+    "PIPELINE_TRACE_EVENTS must be a power of two, so indexes stay in order when they wrap");
+
+static const char* const EVENT_NAMES[] = {
+    "mic_read",
+    "afe_output",
+    "encode_done",
+    "send",
+    "receive",
+    "decode_done",
+    "i2s_write",
+    "state",
+    "task_begin",
+    "task_end",
+};
+
+PipelineTrace::PipelineTrace() {
+#if CONFIG_USE_PIPELINE_TRACE
+    // Prefer PSRAM, the rings are only touched once per event
+    rings_ = (Ring*)heap_caps_calloc(portNUM_PROCESSORS, sizeof(Ring), MALLOC_CAP_SPIRAM);
+    if (rings_ == nullptr) {
+        rings_ = (Ring*)heap_caps_calloc(portNUM_PROCESSORS, sizeof(Ring), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if (rings_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %u trace events", portNUM_PROCESSORS * CONFIG_PIPELINE_TRACE_EVENTS);
+        return;
+    }
+    ESP_LOGI(TAG, "Tracing %d events per core", CONFIG_PIPELINE_TRACE_EVENTS);
+#endif
+}
+
+PipelineTrace::~PipelineTrace() {
+    heap_caps_free(rings_);
+}
+
+void PipelineTrace::Record(PipelineTraceEvent event, uint32_t arg) {
+    if (rings_ == nullptr) {
+        return;
+    }
+    // A task moved to the other core in between still gets a slot of its own, the add is atomic on both cores
+    int core = xPortGetCoreID();
+    auto& ring = rings_[core];
+    uint32_t index = heads_[core].fetch_add(1, std::memory_order_relaxed);
+    auto& entry = ring.entries[index % CONFIG_PIPELINE_TRACE_EVENTS];
+    entry.sequence.store(0, std::memory_order_relaxed);
+    entry.time_us = (uint32_t)esp_timer_get_time();
+    strncpy(entry.task, pcTaskGetName(NULL), sizeof(entry.task) - 1);
+    entry.arg = arg;
+    entry.event = event;
+    entry.sequence.store(index + 1, std::memory_order_release);
+}
+
+void PipelineTrace::Export() {
+    if (rings_ == nullptr) {
+        return;
+    }
+#if CONFIG_USE_AUDIO_DEBUGGER
+    if (audio_debugger_ == nullptr) {
+        audio_debugger_ = std::make_unique<AudioDebugger>();
+    }
+#endif
+
+    char line[96];
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        auto& ring = rings_[core];
+        auto& tail = tails_[core];
+        uint32_t head = heads_[core].load(std::memory_order_acquire);
+        if (head - tail > CONFIG_PIPELINE_TRACE_EVENTS) {
+            dropped_ += head - tail - CONFIG_PIPELINE_TRACE_EVENTS;
+            tail = head - CONFIG_PIPELINE_TRACE_EVENTS;
+        }
+
+        for (; tail != head; tail++) {
+            auto& entry = ring.entries[tail % CONFIG_PIPELINE_TRACE_EVENTS];
+            uint32_t sequence = entry.sequence.load(std::memory_order_acquire);
+            if (sequence == 0) {
+                // Still being written, picked up by the next export
+                break;
+            }
+            uint32_t time_us = entry.time_us;
+            char task[configMAX_TASK_NAME_LEN];
+            memcpy(task, entry.task, sizeof(task));
+            uint32_t arg = entry.arg;
+            uint8_t event = entry.event;
+            if (sequence != tail + 1 || entry.sequence.load(std::memory_order_acquire) != sequence ||
+                event >= kTraceEventCount) {
+                // Overwritten by a newer record while the ring wrapped
+                dropped_++;
+                continue;
+            }
+
+            int length = snprintf(line, sizeof(line), "TRACE %lu %d %s %s %lu\n",
+                time_us, core, task, EVENT_NAMES[event], arg);
+            if (buffer_.size() + length > PIPELINE_TRACE_UDP_PAYLOAD) {
+                Flush();
+            }
+            buffer_.append(line, length);
+        }
+    }
+
+    if (dropped_ > 0) {
+        int length = snprintf(line, sizeof(line), "TRACE_DROPPED %lu\n", dropped_);
+        buffer_.append(line, length);
+        dropped_ = 0;
+    }
+    Flush();
+}
+
+void PipelineTrace::Flush() {
+    if (buffer_.empty()) {
+        return;
+    }
+    if (audio_debugger_) {
+        audio_debugger_->SendTrace(buffer_.data(), buffer_.size());
+    } else {
+        fwrite(buffer_.data(), 1, buffer_.size(), stdout);
+    }
+    buffer_.clear();
+}
@@ -0,0 +1,86 @@
+#ifndef PIPELINE_TRACE_H
+#define PIPELINE_TRACE_H
+
+#include <freertos/FreeRTOS.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#ifndef CONFIG_PIPELINE_TRACE_EVENTS
+#define CONFIG_PIPELINE_TRACE_EVENTS 1024
+#endif
+
+enum PipelineTraceEvent : uint8_t {
+    kTraceMicRead,          // arg: samples read from the codec
+    kTraceAfeOutput,        // arg: samples of processed PCM
+    kTraceEncodeDone,       // arg: Opus bytes
+    kTraceSend,             // arg: Opus bytes written to the protocol
+    kTraceReceive,          // arg: transport sequence number
+    kTraceDecodeDone,       // arg: PCM samples
+    kTraceI2sWrite,         // arg: PCM samples written to the codec
+    kTraceStateChange,      // arg: new DeviceState
+    kTraceTaskBegin,        // arg: source line of the scheduled task
+    kTraceTaskEnd,          // arg: source line of the scheduled task
+    kTraceEventCount,
+};
+
+#if CONFIG_USE_PIPELINE_TRACE
+#define PIPELINE_TRACE(event, arg) PipelineTrace::GetInstance().Record(event, arg)
+#else
+#define PIPELINE_TRACE(event, arg)
+#endif
+
+class AudioDebugger;
+
+/*
+ * Timestamps of the audio pipeline and the main event loop, for a timeline of where the latency goes.
+ *
+ * Every core writes to its own ring, a slot is claimed with one atomic add and published with its sequence
+ * number, so recording never takes a lock and never blocks an audio task. Export() sends the records written
+ * since the previous call as text lines, over the audio debugger UDP channel (port + 1) when it is enabled,
+ * otherwise to the serial log. scripts/trace_to_perfetto.py turns them into a Chrome / Perfetto trace.
+ */
+class PipelineTrace {
+public:
+    static PipelineTrace& GetInstance() {
+        static PipelineTrace instance;
+        return instance;
+    }
+    PipelineTrace(const PipelineTrace&) = delete;
+    PipelineTrace& operator=(const PipelineTrace&) = delete;
+
+    void Record(PipelineTraceEvent event, uint32_t arg);
+    // Opens the UDP socket on the first call, so it must not be called before the network is up
+    void Export();
+
+private:
+    PipelineTrace();
+    ~PipelineTrace();
+
+    struct Entry {
+        std::atomic<uint32_t> sequence;     // Index + 1 once the entry is complete
+        uint32_t time_us;
+        // Copied at record time, a task may be deleted before the export
+        char task[configMAX_TASK_NAME_LEN];
+        uint32_t arg;
+        uint8_t event;
+    };
+
+    struct Ring {
+        Entry entries[CONFIG_PIPELINE_TRACE_EVENTS];
+    };
+
+    Ring* rings_ = nullptr;
+    // Kept in internal RAM, atomic read-modify-write does not work on PSRAM
+    std::atomic<uint32_t> heads_[portNUM_PROCESSORS] = {};
+    uint32_t tails_[portNUM_PROCESSORS] = {};   // Only used by Export
+    std::unique_ptr<AudioDebugger> audio_debugger_;
+    std::string buffer_;
+    uint32_t dropped_ = 0;
+
+    void Flush();
+};
+
+#endif // PIPELINE_TRACE_H
@@ -0,0 +1,83 @@
+#include "audio_channel_stats.h"
+
+void AudioChannelStatsTracker::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_ = AudioChannelStats();
+    has_sequence_ = false;
+    first_sequence_ = 0;
+    highest_sequence_ = 0;
+    received_mask_ = 0;
+    unique_packets_ = 0;
+    has_transit_ = false;
+    last_transit_ms_ = 0;
+    jitter_q4_ = 0;
+}
+
+void AudioChannelStatsTracker::OnPacket(uint32_t sequence, uint32_t timestamp, uint32_t now_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.received++;
+
+    // Relative transit time, the unknown clock offset between server and device cancels out.
+    // Transports without a timestamp send 0, which says nothing about the network.
+    if (timestamp != 0) {
+        int32_t transit = (int32_t)(now_ms - timestamp);
+        if (has_transit_) {
+            int32_t d = transit - last_transit_ms_;
+            if (d < 0) {
+                d = -d;
+            }
+            jitter_q4_ += d - ((jitter_q4_ + 8) >> 4);
+        }
+        has_transit_ = true;
+        last_transit_ms_ = transit;
+    }
+
+    if (sequence == 0) {
+        return;
+    }
+    if (!has_sequence_) {
+        has_sequence_ = true;
+        first_sequence_ = sequence;
+        highest_sequence_ = sequence;
+        received_mask_ = 1;
+        unique_packets_ = 1;
+        return;
+    }
+    if (sequence > highest_sequence_) {
+        uint32_t shift = sequence - highest_sequence_;
+        received_mask_ = shift < 64 ? (received_mask_ << shift) | 1 : 1;
+        highest_sequence_ = sequence;
+        unique_packets_++;
+        return;
+    }
+
+    uint32_t age = highest_sequence_ - sequence;
+    if (age >= 64 || sequence < first_sequence_) {
+        // Out of the window it cannot be told from a duplicate, so its sequence number stays lost
+        stats_.reordered++;
+        return;
+    }
+    if (received_mask_ & (1ULL << age)) {
+        stats_.duplicate++;
+        return;
+    }
+    received_mask_ |= 1ULL << age;
+    stats_.reordered++;
+    unique_packets_++;
+}
+
+void AudioChannelStatsTracker::OnRoundTrip(int rtt_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.rtt_ms = rtt_ms;
+}
+
+AudioChannelStats AudioChannelStatsTracker::Get() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    AudioChannelStats stats = stats_;
+    if (has_sequence_) {
+        uint32_t expected = highest_sequence_ - first_sequence_ + 1;
+        stats.lost = expected > unique_packets_ ? expected - unique_packets_ : 0;
+    }
+    stats.jitter_ms = jitter_q4_ >> 4;
+    return stats;
+}
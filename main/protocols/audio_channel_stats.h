@@ -0,0 +1,49 @@
+#ifndef AUDIO_CHANNEL_STATS_H
+#define AUDIO_CHANNEL_STATS_H
+
+#include <cstdint>
+#include <mutex>
+
+// Receive statistics of the audio channel, reset by every server hello
+struct AudioChannelStats {
+    uint32_t received = 0;      // Packets received, duplicates included
+    uint32_t lost = 0;          // Sequence numbers not received (yet)
+    uint32_t reordered = 0;     // Packets that arrived after a later sequence number
+    uint32_t duplicate = 0;
+    uint32_t jitter_ms = 0;     // RFC 3550 interarrival jitter of the header timestamps
+    int rtt_ms = -1;            // Round trip of the last answered stats report, -1 if none yet
+};
+
+/*
+ * Counts what the network did to the server audio before it reached the jitter buffer.
+ *
+ * Loss, reordering and duplicates are derived from the transport sequence numbers with a 64 packet
+ * window, so a late packet is no longer counted as lost once it arrives. A packet older than the window
+ * may be a duplicate, it is counted as reordered and its sequence number stays lost. Packets without a
+ * sequence number (WebSocket) only update the packet count and jitter, a timestamp of 0 only the count.
+ *
+ * Thread safe, packets are counted by the network task and read by the main task.
+ */
+class AudioChannelStatsTracker {
+public:
+    void Reset();
+    void OnPacket(uint32_t sequence, uint32_t timestamp, uint32_t now_ms);
+    void OnRoundTrip(int rtt_ms);
+    AudioChannelStats Get();
+
+private:
+    std::mutex mutex_;
+    AudioChannelStats stats_;
+
+    bool has_sequence_ = false;
+    uint32_t first_sequence_ = 0;
+    uint32_t highest_sequence_ = 0;
+    uint64_t received_mask_ = 0;    // Bit n set if highest_sequence_ - n was received
+    uint32_t unique_packets_ = 0;
+
+    bool has_transit_ = false;
+    int32_t last_transit_ms_ = 0;
+    uint32_t jitter_q4_ = 0;        // Jitter in 1/16 ms, as in RFC 3550 appendix A.8
+};
+
+#endif // AUDIO_CHANNEL_STATS_H
@@ -0,0 +1,199 @@
+#include "json_reader.h"
+
+#include <cstdint>
+
+bool JsonReader::SkipSpace(size_t& pos) const {
+    while (pos < size_ && (data_[pos] == ' ' || data_[pos] == '\t' || data_[pos] == '\r' || data_[pos] == '\n')) {
+        pos++;
+    }
+    return pos < size_;
+}
+
+bool JsonReader::ReadString(size_t& pos, std::string_view& value) const {
+    if (pos >= size_ || data_[pos] != '"') {
+        return false;
+    }
+    size_t start = ++pos;
+    while (pos < size_) {
+        char c = data_[pos];
+        if (c == '\\') {
+            pos += 2;
+        } else if (c == '"') {
+            value = std::string_view(data_ + start, pos - start);
+            pos++;
+            return true;
+        } else {
+            pos++;
+        }
+    }
+    return false;
+}
+
+bool JsonReader::SkipValue(size_t& pos) const {
+    if (!SkipSpace(pos)) {
+        return false;
+    }
+    std::string_view ignored;
+    char c = data_[pos];
+    if (c == '"') {
+        return ReadString(pos, ignored);
+    }
+    if (c == '{' || c == '[') {
+        // Strings are read as a whole, so brackets inside them are not counted
+        int depth = 0;
+        while (pos < size_) {
+            c = data_[pos];
+            if (c == '"') {
+                if (!ReadString(pos, ignored)) {
+                    return false;
+                }
+                continue;
+            }
+            if (c == '{' || c == '[') {
+                depth++;
+            } else if (c == '}' || c == ']') {
+                if (--depth == 0) {
+                    pos++;
+                    return true;
+                }
+            }
+            pos++;
+        }
+        return false;
+    }
+    // Number, true, false or null
+    size_t start = pos;
+    while (pos < size_ && data_[pos] != ',' && data_[pos] != '}' && data_[pos] != ']' &&
+        data_[pos] != ' ' && data_[pos] != '\t' && data_[pos] != '\r' && data_[pos] != '\n') {
+        pos++;
+    }
+    return pos > start;
+}
+
+bool JsonReader::GetString(std::string_view key, std::string_view& value) const {
+    size_t pos = 0;
+    if (!SkipSpace(pos) || data_[pos] != '{') {
+        return false;
+    }
+    pos++;
+    if (SkipSpace(pos) && data_[pos] == '}') {
+        return false;
+    }
+    // The first call reads the whole object even after the key was found, a truncated frame must not be
+    // dispatched. Later calls can stop at the key.
+    bool found = false;
+    while (SkipSpace(pos)) {
+        std::string_view name;
+        if (!ReadString(pos, name) || !SkipSpace(pos) || data_[pos] != ':') {
+            return false;
+        }
+        pos++;
+        if (!SkipSpace(pos)) {
+            return false;
+        }
+        if (name == key && !found) {
+            // Like cJSON_GetObjectItem(), the first of duplicate keys wins
+            if (!ReadString(pos, value)) {
+                return false;
+            }
+            found = true;
+            if (checked_) {
+                return true;
+            }
+        } else if (!SkipValue(pos)) {
+            return false;
+        }
+        if (!SkipSpace(pos)) {
+            return false;
+        }
+        if (data_[pos] == '}') {
+            checked_ = true;
+            return found;
+        }
+        if (data_[pos] != ',') {
+            return false;
+        }
+        pos++;
+    }
+    return false;
+}
+
+static void AppendUtf8(uint32_t code, std::string& output) {
+    if (code < 0x80) {
+        output.push_back((char)code);
+    } else if (code < 0x800) {
+        output.push_back((char)(0xC0 | (code >> 6)));
+        output.push_back((char)(0x80 | (code & 0x3F)));
+    } else if (code < 0x10000) {
+        output.push_back((char)(0xE0 | (code >> 12)));
+        output.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+        output.push_back((char)(0x80 | (code & 0x3F)));
+    } else {
+        output.push_back((char)(0xF0 | (code >> 18)));
+        output.push_back((char)(0x80 | ((code >> 12) & 0x3F)));
+        output.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+        output.push_back((char)(0x80 | (code & 0x3F)));
+    }
+}
+
+static bool ParseHex4(std::string_view raw, size_t pos, uint32_t& code) {
+    if (pos + 4 > raw.size()) {
+        return false;
+    }
+    code = 0;
+    for (size_t i = pos; i < pos + 4; i++) {
+        char c = raw[i];
+        code <<= 4;
+        if (c >= '0' && c <= '9') code |= c - '0';
+        else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+        else return false;
+    }
+    return true;
+}
+
+void JsonReader::Unescape(std::string_view raw, std::string& output) {
+    output.clear();
+    output.reserve(raw.size());
+    for (size_t i = 0; i < raw.size(); i++) {
+        char c = raw[i];
+        if (c != '\\' || i + 1 >= raw.size()) {
+            output.push_back(c);
+            continue;
+        }
+        c = raw[++i];
+        switch (c) {
+            case 'b': output.push_back('\b'); break;
+            case 'f': output.push_back('\f'); break;
+            case 'n': output.push_back('\n'); break;
+            case 'r': output.push_back('\r'); break;
+            case 't': output.push_back('\t'); break;
+            case 'u': {
+                // A bad escape or a lone surrogate becomes U+FFFD, a surrogate is not valid in UTF-8
+                uint32_t code;
+                if (!ParseHex4(raw, i + 1, code)) {
+                    AppendUtf8(0xFFFD, output);
+                    break;
+                }
+                i += 4;
+                if (code >= 0xD800 && code < 0xE000) {
+                    // A high surrogate followed by a low surrogate is one code point
+                    uint32_t low;
+                    if (code < 0xDC00 && i + 2 < raw.size() && raw[i + 1] == '\\' && raw[i + 2] == 'u' &&
+                        ParseHex4(raw, i + 3, low) && low >= 0xDC00 && low < 0xE000) {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        i += 6;
+                    } else {
+                        code = 0xFFFD;
+                    }
+                }
+                AppendUtf8(code, output);
+                break;
+            }
+            default:
+                // \" \\ \/
+                output.push_back(c);
+                break;
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef JSON_READER_H
+#define JSON_READER_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/*
+ * Reads string members of a flat JSON object in place, without building a tree or allocating.
+ *
+ * Used on the incoming message hot path to dispatch on "type" and pick up a few string fields.
+ * Values are views into the receive buffer with escapes left intact, Unescape() decodes them.
+ * Nested objects and arrays are skipped, messages that need them still go through cJSON.
+ */
+class JsonReader {
+public:
+    JsonReader(const char* data, size_t size) : data_(data), size_(size) {}
+
+    // False if the member is missing, is not a string, or the object is malformed or truncated.
+    // The whole object is checked, up to its closing brace.
+    bool GetString(std::string_view key, std::string_view& value) const;
+
+    // Decodes JSON escapes, including \uXXXX surrogate pairs, into UTF-8.
+    // Lone surrogates and bad \u escapes become U+FFFD.
+    static void Unescape(std::string_view raw, std::string& output);
+
+private:
+    const char* data_;
+    size_t size_;
+    mutable bool checked_ = false;  // The object was read up to its closing brace
+
+    bool SkipSpace(size_t& pos) const;
+    bool ReadString(size_t& pos, std::string_view& value) const;
+    bool SkipValue(size_t& pos) const;
+};
+
+#endif // JSON_READER_H
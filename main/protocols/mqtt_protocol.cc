@@ -5,6 +5,7 @@
 
 #include <esp_log.h>
 #include <cstring>
+#include <algorithm>
 #include <arpa/inet.h>
 #include "assets/lang_config.h"
 
@@ -20,14 +21,19 @@ MqttProtocol::MqttProtocol() {
             auto& app = Application::GetInstance();
             if (app.GetDeviceState() == kDeviceStateIdle) {
                 ESP_LOGI(TAG, "Reconnecting to MQTT server");
-                app.Schedule([protocol]() {
-                    protocol->StartMqttClient(false);
+                app.ScheduleWorker([protocol]() {
+                    // Skipped if a prewarm or an audio channel is connecting already
+                    std::unique_lock<std::mutex> lock(protocol->connect_mutex_, std::try_to_lock);
+                    if (lock.owns_lock()) {
+                        protocol->StartMqttClient(false);
+                    }
                 });
             }
         },
         .arg = this,
     };
     esp_timer_create(&reconnect_timer_args, &reconnect_timer_);
+    mbedtls_aes_init(&aes_ctx_);
 }
 
 MqttProtocol::~MqttProtocol() {
@@ -39,6 +45,7 @@ MqttProtocol::~MqttProtocol() {
 
     udp_.reset();
     mqtt_.reset();
+    mbedtls_aes_free(&aes_ctx_);
     
     if (event_group_handle_ != nullptr) {
         vEventGroupDelete(event_group_handle_);
@@ -46,13 +53,24 @@ MqttProtocol::~MqttProtocol() {
 }
 
 bool MqttProtocol::Start() {
+    std::lock_guard<std::mutex> lock(connect_mutex_);
     return StartMqttClient(false);
 }
 
+void MqttProtocol::ResetMqtt() {
+    std::unique_ptr<Mqtt> mqtt;
+    {
+        std::lock_guard<std::mutex> lock(mqtt_mutex_);
+        mqtt = std::move(mqtt_);
+    }
+    // Destroyed outside the lock, its callbacks may run while it shuts down
+    mqtt.reset();
+}
+
 bool MqttProtocol::StartMqttClient(bool report_error) {
     if (mqtt_ != nullptr) {
         ESP_LOGW(TAG, "Mqtt client already started");
-        mqtt_.reset();
+        ResetMqtt();
     }
 
     Settings settings("mqtt", false);
@@ -61,7 +79,6 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
     auto username = settings.GetString("username");
     auto password = settings.GetString("password");
     int keepalive_interval = settings.GetInt("keepalive", 240);
-    publish_topic_ = settings.GetString("publish_topic");
 
     if (endpoint.empty()) {
         ESP_LOGW(TAG, "MQTT endpoint is not specified");
@@ -71,11 +88,12 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
         return false;
     }
 
+    // Connected before it is published to mqtt_, so SendText never waits for the connection
     auto network = Board::GetInstance().GetNetwork();
-    mqtt_ = network->CreateMqtt(0);
-    mqtt_->SetKeepAlive(keepalive_interval);
+    std::unique_ptr<Mqtt> mqtt = network->CreateMqtt(0);
+    mqtt->SetKeepAlive(keepalive_interval);
 
-    mqtt_->OnDisconnected([this]() {
+    mqtt->OnDisconnected([this]() {
         if (on_disconnected_ != nullptr) {
             on_disconnected_();
         }
@@ -83,15 +101,19 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
         esp_timer_start_once(reconnect_timer_, MQTT_RECONNECT_INTERVAL_MS * 1000);
     });
 
-    mqtt_->OnConnected([this]() {
+    mqtt->OnConnected([this]() {
         if (on_connected_ != nullptr) {
             on_connected_();
         }
         esp_timer_stop(reconnect_timer_);
     });
 
-    mqtt_->OnMessage([this](const std::string& topic, const std::string& payload) {
-        cJSON* root = cJSON_Parse(payload.c_str());
+    mqtt->OnMessage([this](const std::string& topic, const std::string& payload) {
+        if (ParseJsonAsControl(payload.data(), payload.size())) {
+            last_incoming_time_ = std::chrono::steady_clock::now();
+            return;
+        }
+        cJSON* root = cJSON_ParseWithLength(payload.data(), payload.size());
         if (root == nullptr) {
             ESP_LOGE(TAG, "Failed to parse json message %s", payload.c_str());
             return;
@@ -113,6 +135,8 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
                     CloseAudioChannel();
                 });
             }
+        } else if (strcmp(type->valuestring, "pong") == 0) {
+            ParsePong(root);
         } else if (on_incoming_json_ != nullptr) {
             on_incoming_json_(root);
         }
@@ -130,18 +154,24 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
     } else {
         broker_address = endpoint;
     }
-    if (!mqtt_->Connect(broker_address, broker_port, client_id, username, password)) {
-        ESP_LOGE(TAG, "Failed to connect to endpoint, code=%d", mqtt_->GetLastError());
+    if (!mqtt->Connect(broker_address, broker_port, client_id, username, password)) {
+        ESP_LOGE(TAG, "Failed to connect to endpoint, code=%d", mqtt->GetLastError());
         SetError(Lang::Strings::SERVER_NOT_CONNECTED);
         return false;
     }
+    {
+        std::lock_guard<std::mutex> lock(mqtt_mutex_);
+        mqtt_ = std::move(mqtt);
+        publish_topic_ = settings.GetString("publish_topic");
+    }
 
     ESP_LOGI(TAG, "Connected to endpoint");
     return true;
 }
 
 bool MqttProtocol::SendText(const std::string& text) {
-    if (publish_topic_.empty()) {
+    std::lock_guard<std::mutex> lock(mqtt_mutex_);
+    if (publish_topic_.empty() || mqtt_ == nullptr) {
         return false;
     }
     if (!mqtt_->Publish(publish_topic_, text)) {
@@ -158,24 +188,94 @@ bool MqttProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
         return false;
     }
 
-    std::string nonce(aes_nonce_);
-    *(uint16_t*)&nonce[2] = htons(packet->payload.size());
-    *(uint32_t*)&nonce[8] = htonl(packet->timestamp);
-    *(uint32_t*)&nonce[12] = htonl(++local_sequence_);
+    auto& audio_service = Application::GetInstance().GetAudioService();
+    if (audio_batch_frames_ > 1) {
+        bool full = AddToAudioBatch(*packet);
+        audio_service.ReleasePacket(std::move(packet));
+        return full ? SendBatchLocked() : true;
+    }
+
+    int uplink_loss = uplink_loss_percent_;
+    if (redundancy_ && (uplink_loss < 0 || uplink_loss >= MQTT_UDP_REDUNDANCY_MIN_LOSS)) {
+        bool sent = SendRedundantLocked(*packet);
+        audio_service.ReleasePacket(std::move(packet));
+        return sent;
+    }
 
-    std::string encrypted;
-    encrypted.resize(aes_nonce_.size() + packet->payload.size());
-    memcpy(encrypted.data(), nonce.data(), nonce.size());
+    redundant_frame_.clear();
+    bool sent = SendUdpPacket(0x01, packet->payload.data(), packet->payload.size(), packet->timestamp, ++local_sequence_);
+    audio_service.ReleasePacket(std::move(packet));
+    return sent;
+}
+
+bool MqttProtocol::SendRedundantLocked(const AudioStreamPacket& packet) {
+    // A batch of the previous and the current frame, starting at the previous sequence number.
+    // The server keeps the first copy of every sequence number, so one lost packet loses no frame.
+    uint32_t sequence = ++local_sequence_;
+    redundancy_buffer_.clear();
+    redundancy_buffer_.push_back(redundant_frame_.empty() ? 1 : 2);
+    redundancy_buffer_.insert(redundancy_buffer_.end(), redundant_frame_.begin(), redundant_frame_.end());
+
+    size_t offset = redundancy_buffer_.size();
+    redundancy_buffer_.resize(offset + sizeof(AudioBatchFrame) + packet.payload.size());
+    auto frame = (AudioBatchFrame*)&redundancy_buffer_[offset];
+    frame->timestamp = htonl(packet.timestamp);
+    frame->payload_size = htons(packet.payload.size());
+    memcpy(frame->payload, packet.payload.data(), packet.payload.size());
+
+    auto first = (const AudioBatchFrame*)&redundancy_buffer_[1];
+    uint32_t first_sequence = redundant_frame_.empty() ? sequence : sequence - 1;
+    bool sent = SendUdpPacket(0x02, redundancy_buffer_.data(), redundancy_buffer_.size(), ntohl(first->timestamp), first_sequence);
+    redundant_frame_.assign(redundancy_buffer_.begin() + offset, redundancy_buffer_.end());
+    return sent;
+}
 
+bool MqttProtocol::SendAudioBatch() {
+    std::lock_guard<std::mutex> lock(channel_mutex_);
+    // The utterance ends here, the next one does not start with a repeat of its last frame
+    redundant_frame_.clear();
+    if (udp_ == nullptr) {
+        audio_batch_.clear();
+        return false;
+    }
+    return SendBatchLocked();
+}
+
+bool MqttProtocol::SendBatchLocked() {
+    if (audio_batch_.empty()) {
+        return true;
+    }
+    // The header carries the timestamp and sequence of the first frame, the sequence advances by one per frame
+    int count = audio_batch_[0];
+    auto first = (const AudioBatchFrame*)&audio_batch_[1];
+    uint32_t sequence = local_sequence_ + 1;
+    local_sequence_ += count;
+    bool sent = SendUdpPacket(0x02, audio_batch_.data(), audio_batch_.size(), ntohl(first->timestamp), sequence);
+    audio_batch_.clear();
+    return sent;
+}
+
+bool MqttProtocol::SendUdpPacket(uint8_t type, const uint8_t* payload, size_t size, uint32_t timestamp, uint32_t sequence) {
+    // The header and ciphertext are written into a buffer that keeps its capacity across packets
+    udp_send_buffer_.resize(MQTT_UDP_HEADER_SIZE + size);
+    auto header = (uint8_t*)udp_send_buffer_.data();
+    memcpy(header, aes_nonce_, MQTT_UDP_HEADER_SIZE);
+    header[0] = type;
+    *(uint16_t*)&header[2] = htons(size);
+    *(uint32_t*)&header[8] = htonl(timestamp);
+    *(uint32_t*)&header[12] = htonl(sequence);
+
+    // mbedtls advances the counter block, so it works on a copy of the header
+    uint8_t counter[MQTT_UDP_HEADER_SIZE];
+    memcpy(counter, header, MQTT_UDP_HEADER_SIZE);
     size_t nc_off = 0;
     uint8_t stream_block[16] = {0};
-    if (mbedtls_aes_crypt_ctr(&aes_ctx_, packet->payload.size(), &nc_off, (uint8_t*)nonce.c_str(), stream_block,
-        (uint8_t*)packet->payload.data(), (uint8_t*)&encrypted[nonce.size()]) != 0) {
+    if (mbedtls_aes_crypt_ctr(&aes_ctx_, size, &nc_off, counter, stream_block, payload, header + MQTT_UDP_HEADER_SIZE) != 0) {
         ESP_LOGE(TAG, "Failed to encrypt audio data");
         return false;
     }
 
-    return udp_->Send(encrypted) > 0;
+    return udp_->Send(udp_send_buffer_) > 0;
 }
 
 void MqttProtocol::CloseAudioChannel() {
@@ -195,13 +295,38 @@ void MqttProtocol::CloseAudioChannel() {
     }
 }
 
+void MqttProtocol::PrewarmAudioChannel() {
+    // The UDP channel needs the server hello, so only the MQTT connection can be made ahead of time.
+    // It reconnects sooner than the reconnect timer would.
+    std::unique_lock<std::mutex> lock(connect_mutex_, std::try_to_lock);
+    if (!lock.owns_lock() || (mqtt_ != nullptr && mqtt_->IsConnected())) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    if (last_prewarm_time_us_ != 0 && now - last_prewarm_time_us_ < AUDIO_CHANNEL_PREWARM_RETRY_MS * 1000LL) {
+        return;
+    }
+    last_prewarm_time_us_ = now;
+    if (StartMqttClient(false)) {
+        ESP_LOGI(TAG, "Prewarmed MQTT connection in %d ms", (int)((esp_timer_get_time() - now) / 1000));
+    }
+}
+
 bool MqttProtocol::OpenAudioChannel() {
-    if (mqtt_ == nullptr || !mqtt_->IsConnected()) {
-        ESP_LOGI(TAG, "MQTT is not connected, try to connect now");
-        if (!StartMqttClient(true)) {
-            return false;
+    int64_t start_time = esp_timer_get_time();
+    bool warm;
+    {
+        // Waits for a prewarm that is still connecting on the worker
+        std::lock_guard<std::mutex> lock(connect_mutex_);
+        warm = mqtt_ != nullptr && mqtt_->IsConnected();
+        if (!warm) {
+            ESP_LOGI(TAG, "MQTT is not connected, try to connect now");
+            if (!StartMqttClient(true)) {
+                return false;
+            }
         }
     }
+    int64_t connected_time = esp_timer_get_time();
 
     error_occurred_ = false;
     session_id_ = "";
@@ -219,6 +344,11 @@ bool MqttProtocol::OpenAudioChannel() {
         SetError(Lang::Strings::SERVER_TIMEOUT);
         return false;
     }
+    if (error_occurred_) {
+        // The hello could not be used, ParseServerHello already reported why
+        return false;
+    }
+    int64_t hello_time = esp_timer_get_time();
 
     std::lock_guard<std::mutex> lock(channel_mutex_);
     auto network = Board::GetInstance().GetNetwork();
@@ -229,47 +359,85 @@ bool MqttProtocol::OpenAudioChannel() {
          * |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|
          * |payload payload_len|
          */
-        if (data.size() < sizeof(aes_nonce_)) {
+        if (data.size() < MQTT_UDP_HEADER_SIZE) {
             ESP_LOGE(TAG, "Invalid audio packet size: %u", data.size());
             return;
         }
-        if (data[0] != 0x01) {
+        if (data[0] != 0x01 && data[0] != 0x02) {
             ESP_LOGE(TAG, "Invalid audio packet type: %x", data[0]);
             return;
         }
         uint32_t timestamp = ntohl(*(uint32_t*)&data[8]);
         uint32_t sequence = ntohl(*(uint32_t*)&data[12]);
-        if (sequence < remote_sequence_) {
-            ESP_LOGW(TAG, "Received audio packet with old sequence: %lu, expected: %lu", sequence, remote_sequence_);
-            return;
-        }
-        if (sequence != remote_sequence_ + 1) {
-            ESP_LOGW(TAG, "Received audio packet with wrong sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
+        // Out of order packets are passed on, the jitter buffer puts them back in place or drops them if too late
+        // Loss and reordering are counted in the channel stats
+        if (sequence <= remote_sequence_) {
+            ESP_LOGD(TAG, "Received audio packet with old sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
+        } else if (sequence != remote_sequence_ + 1) {
+            ESP_LOGD(TAG, "Received audio packet with wrong sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
         }
 
-        size_t decrypted_size = data.size() - aes_nonce_.size();
+        // Decrypted straight into the batch buffer or a pooled packet, the header is copied because
+        // mbedtls advances the counter block and the received data is read only
+        size_t decrypted_size = data.size() - MQTT_UDP_HEADER_SIZE;
         size_t nc_off = 0;
         uint8_t stream_block[16] = {0};
-        auto nonce = (uint8_t*)data.data();
-        auto encrypted = (uint8_t*)data.data() + aes_nonce_.size();
-        auto packet = std::make_unique<AudioStreamPacket>();
+        uint8_t nonce[MQTT_UDP_HEADER_SIZE];
+        memcpy(nonce, data.data(), MQTT_UDP_HEADER_SIZE);
+        auto encrypted = (const uint8_t*)data.data() + MQTT_UDP_HEADER_SIZE;
+        auto& audio_service = Application::GetInstance().GetAudioService();
+        if (data[0] == 0x02) {
+            // Batched frames are decrypted into a buffer owned by the UDP receive callback, then split into packets
+            batch_receive_buffer_.resize(decrypted_size);
+            int ret = mbedtls_aes_crypt_ctr(&aes_ctx_, decrypted_size, &nc_off, nonce, stream_block, encrypted, batch_receive_buffer_.data());
+            if (ret != 0) {
+                ESP_LOGE(TAG, "Failed to decrypt audio data, ret: %d", ret);
+                return;
+            }
+            if (!ParseAudioBatch(batch_receive_buffer_.data(), batch_receive_buffer_.size(), sequence)) {
+                return;
+            }
+            uint32_t last_sequence = sequence + std::max<int>(batch_receive_buffer_[0], 1) - 1;
+            if (last_sequence > remote_sequence_) {
+                remote_sequence_ = last_sequence;
+            }
+            last_incoming_time_ = std::chrono::steady_clock::now();
+            return;
+        }
+        auto packet = audio_service.AcquirePacket();
         packet->sample_rate = server_sample_rate_;
         packet->frame_duration = server_frame_duration_;
         packet->timestamp = timestamp;
+        packet->sequence = sequence;
         packet->payload.resize(decrypted_size);
         int ret = mbedtls_aes_crypt_ctr(&aes_ctx_, decrypted_size, &nc_off, nonce, stream_block, encrypted, (uint8_t*)packet->payload.data());
         if (ret != 0) {
             ESP_LOGE(TAG, "Failed to decrypt audio data, ret: %d", ret);
+            audio_service.ReleasePacket(std::move(packet));
             return;
         }
+        CountIncomingAudio(sequence, timestamp);
         if (on_incoming_audio_ != nullptr) {
             on_incoming_audio_(std::move(packet));
         }
-        remote_sequence_ = sequence;
+        if (sequence > remote_sequence_) {
+            remote_sequence_ = sequence;
+        }
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
-    udp_->Connect(udp_server_, udp_port_);
+    if (!udp_->Connect(udp_server_, udp_port_)) {
+        ESP_LOGE(TAG, "Failed to connect to UDP server %s:%d", udp_server_.c_str(), udp_port_);
+        udp_.reset();
+        SetError(Lang::Strings::SERVER_NOT_CONNECTED);
+        return false;
+    }
+
+    // Only logged once the channel is usable, a failed open has no phases to compare
+    int64_t udp_time = esp_timer_get_time();
+    ESP_LOGI(TAG, "Audio channel opened in %d ms: mqtt connect %d ms%s, hello %d ms, udp %d ms",
+        (int)((udp_time - start_time) / 1000), (int)((connected_time - start_time) / 1000), warm ? " (prewarmed)" : "",
+        (int)((hello_time - connected_time) / 1000), (int)((udp_time - hello_time) / 1000));
 
     if (on_audio_channel_opened_ != nullptr) {
         on_audio_channel_opened_();
@@ -288,12 +456,16 @@ std::string MqttProtocol::GetHelloMessage() {
     cJSON_AddBoolToObject(features, "aec", true);
 #endif
     cJSON_AddBoolToObject(features, "mcp", true);
+    AddAudioBatchFeature(features);
+    AddStatsFeature(features);
+    cJSON_AddBoolToObject(features, "redundancy", true);
     cJSON_AddItemToObject(root, "features", features);
     cJSON* audio_params = cJSON_CreateObject();
     cJSON_AddStringToObject(audio_params, "format", "opus");
     cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
     cJSON_AddNumberToObject(audio_params, "channels", 1);
     cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
+    AddUplinkAudioParams(audio_params);
     cJSON_AddItemToObject(root, "audio_params", audio_params);
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
@@ -327,10 +499,25 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
             server_frame_duration_ = frame_duration->valueint;
         }
     }
+    ParseUplinkAudioParams(audio_params);
+    ParseStatsFeature(root);
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        ParseAudioBatchFeature(root);
+        auto features = cJSON_GetObjectItem(root, "features");
+        redundancy_ = cJSON_IsTrue(cJSON_GetObjectItem(features, "redundancy"));
+        redundant_frame_.clear();
+        if (redundancy_) {
+            ESP_LOGI(TAG, "Uplink redundancy enabled");
+        }
+    }
 
     auto udp = cJSON_GetObjectItem(root, "udp");
     if (!cJSON_IsObject(udp)) {
         ESP_LOGE(TAG, "UDP is not specified");
+        // Wake OpenAudioChannel now instead of letting it wait for the hello timeout
+        SetError(Lang::Strings::SERVER_ERROR);
+        xEventGroupSetBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
         return;
     }
     udp_server_ = cJSON_GetObjectItem(udp, "server")->valuestring;
@@ -340,8 +527,15 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
 
     // auto encryption = cJSON_GetObjectItem(udp, "encryption")->valuestring;
     // ESP_LOGI(TAG, "UDP server: %s, port: %d, encryption: %s", udp_server_.c_str(), udp_port_, encryption);
-    aes_nonce_ = DecodeHexString(nonce);
-    mbedtls_aes_init(&aes_ctx_);
+    auto nonce_bytes = DecodeHexString(nonce);
+    if (nonce_bytes.size() != MQTT_UDP_HEADER_SIZE) {
+        ESP_LOGE(TAG, "Invalid UDP nonce size: %u", nonce_bytes.size());
+        SetError(Lang::Strings::SERVER_ERROR);
+        xEventGroupSetBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
+        return;
+    }
+    memcpy(aes_nonce_, nonce_bytes.data(), MQTT_UDP_HEADER_SIZE);
+    // The key schedule is computed once per session and reused by every packet
     mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)DecodeHexString(key).c_str(), 128);
     local_sequence_ = 0;
     remote_sequence_ = 0;
@@ -21,6 +21,12 @@
 
 #define MQTT_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
 
+// The UDP packet header doubles as the AES-CTR nonce
+#define MQTT_UDP_HEADER_SIZE 16
+// With redundancy negotiated, the previous frame is repeated while the uplink loss reported by the
+// server is at least this percentage (or not reported at all)
+#define MQTT_UDP_REDUNDANCY_MIN_LOSS 1
+
 class MqttProtocol : public Protocol {
 public:
     MqttProtocol();
@@ -31,6 +37,7 @@ public:
     bool OpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
+    void PrewarmAudioChannel() override;
 
 private:
     EventGroupHandle_t event_group_handle_;
@@ -38,21 +45,37 @@ private:
     std::string publish_topic_;
 
     std::mutex channel_mutex_;
+    // mqtt_ is replaced under connect_mutex_, which may be held by the prewarm worker for a whole connect.
+    // Publishing only needs this lock, so the main event loop never waits for a connection.
+    std::mutex mqtt_mutex_;
     std::unique_ptr<Mqtt> mqtt_;
     std::unique_ptr<Udp> udp_;
     mbedtls_aes_context aes_ctx_;
-    std::string aes_nonce_;
+    // Nonce template from the server hello, only type, size, timestamp and sequence change per packet
+    uint8_t aes_nonce_[MQTT_UDP_HEADER_SIZE];
     std::string udp_server_;
     int udp_port_;
     uint32_t local_sequence_;
     uint32_t remote_sequence_;
+    std::vector<uint8_t> batch_receive_buffer_;
+    std::string udp_send_buffer_;
+    // Uplink redundancy, the previous frame in AudioBatchFrame format is sent again with the next one
+    bool redundancy_ = false;
+    std::vector<uint8_t> redundant_frame_;
+    std::vector<uint8_t> redundancy_buffer_;
     esp_timer_handle_t reconnect_timer_;
 
+    // Called with connect_mutex_ held
     bool StartMqttClient(bool report_error=false);
+    void ResetMqtt();
     void ParseServerHello(const cJSON* root);
     std::string DecodeHexString(const std::string& hex_string);
 
     bool SendText(const std::string& text) override;
+    bool SendAudioBatch() override;
+    bool SendBatchLocked();
+    bool SendRedundantLocked(const AudioStreamPacket& packet);
+    bool SendUdpPacket(uint8_t type, const uint8_t* payload, size_t size, uint32_t timestamp, uint32_t sequence);
     std::string GetHelloMessage();
 };
 
@@ -1,6 +1,12 @@
 #include "protocol.h"
+#include "application.h"
+#include "json_reader.h"
 
+#include <algorithm>
+#include <cstring>
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <arpa/inet.h>
 
 #define TAG "Protocol"
 
@@ -8,6 +14,10 @@ void Protocol::OnIncomingJson(std::function<void(const cJSON* root)> callback) {
     on_incoming_json_ = callback;
 }
 
+void Protocol::OnIncomingControl(std::function<void(uint8_t type, std::string&& text)> callback) {
+    on_incoming_control_ = callback;
+}
+
 void Protocol::OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback) {
     on_incoming_audio_ = callback;
 }
@@ -40,6 +50,11 @@ void Protocol::SetError(const std::string& message) {
 }
 
 void Protocol::SendAbortSpeaking(AbortReason reason) {
+    if (binary_control_) {
+        uint8_t value = reason;
+        SendControl(kControlAbort, &value, 1);
+        return;
+    }
     std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"abort\"";
     if (reason == kAbortReasonWakeWordDetected) {
         message += ",\"reason\":\"wake_word_detected\"";
@@ -49,12 +64,22 @@ void Protocol::SendAbortSpeaking(AbortReason reason) {
 }
 
 void Protocol::SendWakeWordDetected(const std::string& wake_word) {
+    SendAudioBatch();
+    if (binary_control_) {
+        SendControl(kControlListenDetect, wake_word.data(), wake_word.size());
+        return;
+    }
     std::string json = "{\"session_id\":\"" + session_id_ + 
                       "\",\"type\":\"listen\",\"state\":\"detect\",\"text\":\"" + wake_word + "\"}";
     SendText(json);
 }
 
 void Protocol::SendStartListening(ListeningMode mode) {
+    if (binary_control_) {
+        uint8_t value = mode;
+        SendControl(kControlListenStart, &value, 1);
+        return;
+    }
     std::string message = "{\"session_id\":\"" + session_id_ + "\"";
     message += ",\"type\":\"listen\",\"state\":\"start\"";
     if (mode == kListeningModeRealtime) {
@@ -69,6 +94,11 @@ void Protocol::SendStartListening(ListeningMode mode) {
 }
 
 void Protocol::SendStopListening() {
+    SendAudioBatch();
+    if (binary_control_) {
+        SendControl(kControlListenStop, nullptr, 0);
+        return;
+    }
     std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"listen\",\"state\":\"stop\"}";
     SendText(message);
 }
@@ -88,3 +118,212 @@ bool Protocol::IsTimeout() const {
     }
     return timeout;
 }
+
+void Protocol::AddUplinkAudioParams(cJSON* audio_params) {
+    // Frame durations the device can encode, the server picks one in its hello
+    static const int frame_durations[] = {20, 40, 60, 120};
+    cJSON_AddItemToObject(audio_params, "frame_durations", cJSON_CreateIntArray(frame_durations, 4));
+}
+
+void Protocol::ParseUplinkAudioParams(const cJSON* audio_params) {
+    uplink_frame_duration_ = 60;
+    uplink_complexity_ = 0;
+    uplink_adaptive_ = false;
+
+    auto uplink = cJSON_GetObjectItem(audio_params, "uplink");
+    if (!cJSON_IsObject(uplink)) {
+        return;
+    }
+    auto frame_duration = cJSON_GetObjectItem(uplink, "frame_duration");
+    if (cJSON_IsNumber(frame_duration)) {
+        int value = frame_duration->valueint;
+        if (value == 20 || value == 40 || value == 60 || value == 120) {
+            uplink_frame_duration_ = value;
+        } else {
+            ESP_LOGW(TAG, "Unsupported uplink frame duration: %d", value);
+        }
+    }
+    auto complexity = cJSON_GetObjectItem(uplink, "complexity");
+    if (cJSON_IsNumber(complexity)) {
+        uplink_complexity_ = std::clamp(complexity->valueint, 0, 10);
+    }
+    auto adaptive = cJSON_GetObjectItem(uplink, "adaptive");
+    uplink_adaptive_ = cJSON_IsTrue(adaptive);
+}
+
+void Protocol::AddAudioBatchFeature(cJSON* features) {
+#if CONFIG_AUDIO_BATCH_FRAMES > 1
+    cJSON_AddNumberToObject(features, "audio_batch", CONFIG_AUDIO_BATCH_FRAMES);
+#endif
+}
+
+void Protocol::ParseAudioBatchFeature(const cJSON* root) {
+    audio_batch_frames_ = 1;
+    audio_batch_.clear();
+#if CONFIG_AUDIO_BATCH_FRAMES > 1
+    auto features = cJSON_GetObjectItem(root, "features");
+    auto audio_batch = cJSON_GetObjectItem(features, "audio_batch");
+    if (cJSON_IsNumber(audio_batch) && audio_batch->valueint > 1) {
+        audio_batch_frames_ = std::min(audio_batch->valueint, CONFIG_AUDIO_BATCH_FRAMES);
+        ESP_LOGI(TAG, "Audio batch: %d frames per message", audio_batch_frames_);
+    }
+#endif
+}
+
+bool Protocol::AddToAudioBatch(const AudioStreamPacket& packet) {
+    if (audio_batch_.empty()) {
+        audio_batch_.assign(audio_batch_headroom_ + 1, 0);
+    }
+    size_t offset = audio_batch_.size();
+    audio_batch_.resize(offset + sizeof(AudioBatchFrame) + packet.payload.size());
+    auto frame = (AudioBatchFrame*)&audio_batch_[offset];
+    frame->timestamp = htonl(packet.timestamp);
+    frame->payload_size = htons(packet.payload.size());
+    memcpy(frame->payload, packet.payload.data(), packet.payload.size());
+    return ++audio_batch_[audio_batch_headroom_] >= audio_batch_frames_;
+}
+
+bool Protocol::ParseAudioBatch(const uint8_t* data, size_t size, uint32_t first_sequence) {
+    if (size < 1) {
+        return false;
+    }
+    int count = data[0];
+    size_t offset = 1;
+    auto& audio_service = Application::GetInstance().GetAudioService();
+    for (int i = 0; i < count; i++) {
+        if (size - offset < sizeof(AudioBatchFrame)) {
+            ESP_LOGE(TAG, "Truncated audio batch, frame %d of %d", i, count);
+            return false;
+        }
+        auto frame = (const AudioBatchFrame*)(data + offset);
+        size_t payload_size = ntohs(frame->payload_size);
+        offset += sizeof(AudioBatchFrame);
+        if (size - offset < payload_size) {
+            ESP_LOGE(TAG, "Truncated audio batch, frame %d of %d", i, count);
+            return false;
+        }
+
+        if (on_incoming_audio_ != nullptr) {
+            auto packet = audio_service.AcquirePacket();
+            packet->sample_rate = server_sample_rate_;
+            packet->frame_duration = server_frame_duration_;
+            packet->timestamp = ntohl(frame->timestamp);
+            packet->sequence = first_sequence != 0 ? first_sequence + i : 0;
+            // The frames of a batch arrive together, only the first one has a meaningful arrival time
+            CountIncomingAudio(packet->sequence, i == 0 ? packet->timestamp : 0);
+            packet->payload.assign(frame->payload, frame->payload + payload_size);
+            on_incoming_audio_(std::move(packet));
+        }
+        offset += payload_size;
+    }
+    return true;
+}
+
+void Protocol::AddStatsFeature(cJSON* features) {
+    cJSON_AddBoolToObject(features, "stats", true);
+}
+
+void Protocol::ParseStatsFeature(const cJSON* root) {
+    stats_interval_ = 0;
+    uplink_loss_percent_ = -1;
+    audio_channel_stats_.Reset();
+    auto features = cJSON_GetObjectItem(root, "features");
+    auto stats = cJSON_GetObjectItem(features, "stats");
+    if (cJSON_IsNumber(stats) && stats->valueint > 0) {
+        stats_interval_ = stats->valueint;
+        ESP_LOGI(TAG, "Audio channel stats: every %d seconds", stats_interval_);
+    }
+}
+
+void Protocol::CountIncomingAudio(uint32_t sequence, uint32_t timestamp) {
+    audio_channel_stats_.OnPacket(sequence, timestamp, (uint32_t)(esp_timer_get_time() / 1000));
+}
+
+void Protocol::SendAudioChannelStats() {
+    auto stats = audio_channel_stats_.Get();
+    ESP_LOGI(TAG, "Audio channel: received %lu, lost %lu, reordered %lu, duplicate %lu, jitter %lu ms, rtt %d ms",
+        stats.received, stats.lost, stats.reordered, stats.duplicate, stats.jitter_ms, stats.rtt_ms);
+
+    // The ping is echoed back in a pong, the device clock is all that is needed to measure the RTT
+    uint32_t ping = (uint32_t)(esp_timer_get_time() / 1000);
+    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"stats\",\"audio\":{";
+    message += "\"received\":" + std::to_string(stats.received);
+    message += ",\"lost\":" + std::to_string(stats.lost);
+    message += ",\"reordered\":" + std::to_string(stats.reordered);
+    message += ",\"duplicate\":" + std::to_string(stats.duplicate);
+    message += ",\"jitter\":" + std::to_string(stats.jitter_ms);
+    message += ",\"rtt\":" + std::to_string(stats.rtt_ms);
+    message += "},\"ping\":" + std::to_string(ping) + "}";
+    SendText(message);
+}
+
+void Protocol::ParsePong(const cJSON* root) {
+    auto ping = cJSON_GetObjectItem(root, "ping");
+    if (!cJSON_IsNumber(ping)) {
+        return;
+    }
+    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000);
+    audio_channel_stats_.OnRoundTrip((int)(now - (uint32_t)ping->valuedouble));
+
+    auto uplink_loss = cJSON_GetObjectItem(root, "uplink_loss");
+    if (cJSON_IsNumber(uplink_loss)) {
+        uplink_loss_percent_ = std::clamp(uplink_loss->valueint, 0, 100);
+    }
+}
+
+void Protocol::ParseBinaryControlFeature(const cJSON* root) {
+    auto features = cJSON_GetObjectItem(root, "features");
+    binary_control_ = cJSON_IsTrue(cJSON_GetObjectItem(features, "binary_control"));
+    if (binary_control_) {
+        ESP_LOGI(TAG, "Binary control messages enabled");
+    }
+}
+
+bool Protocol::ParseControl(const uint8_t* data, size_t size) {
+    if (size < 1) {
+        ESP_LOGE(TAG, "Empty control message");
+        return false;
+    }
+    if (on_incoming_control_ != nullptr) {
+        on_incoming_control_(data[0], std::string((const char*)data + 1, size - 1));
+    }
+    return true;
+}
+
+bool Protocol::ParseJsonAsControl(const char* data, size_t size) {
+    if (on_incoming_control_ == nullptr) {
+        return false;
+    }
+    JsonReader reader(data, size);
+    std::string_view type;
+    if (!reader.GetString("type", type)) {
+        return false;
+    }
+
+    std::string_view value;
+    std::string text;
+    if (type == "tts") {
+        if (!reader.GetString("state", value)) {
+            return false;
+        }
+        if (value == "start") {
+            on_incoming_control_(kControlTtsStart, std::string());
+        } else if (value == "stop") {
+            on_incoming_control_(kControlTtsStop, std::string());
+        } else if (value == "sentence_start" && reader.GetString("text", value)) {
+            JsonReader::Unescape(value, text);
+            on_incoming_control_(kControlTtsSentence, std::move(text));
+        } else {
+            return false;
+        }
+    } else if (type == "stt" && reader.GetString("text", value)) {
+        JsonReader::Unescape(value, text);
+        on_incoming_control_(kControlStt, std::move(text));
+    } else if (type == "llm" && reader.GetString("emotion", value)) {
+        JsonReader::Unescape(value, text);
+        on_incoming_control_(kControlEmotion, std::move(text));
+    } else {
+        return false;
+    }
+    return true;
+}
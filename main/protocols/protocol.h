@@ -4,13 +4,23 @@
 #include <cJSON.h>
 #include <string>
 #include <functional>
+#include <memory>
 #include <chrono>
 #include <vector>
+#include <atomic>
+#include <mutex>
+
+#include "audio_channel_stats.h"
+
+// Failed pre-warm connections are retried after this delay
+#define AUDIO_CHANNEL_PREWARM_RETRY_MS 30000
 
 struct AudioStreamPacket {
     int sample_rate = 0;
     int frame_duration = 0;
     uint32_t timestamp = 0;
+    uint32_t sequence = 0;  // Transport sequence number, 0 if the transport does not have one
+    int64_t encoded_time_us = 0;    // When the encoder finished, for send latency stats
     std::vector<uint8_t> payload;
 };
 
@@ -30,6 +40,40 @@ struct BinaryProtocol3 {
     uint8_t payload[];
 } __attribute__((packed));
 
+/*
+ * Several Opus frames in one transport message, used when both sides announce "audio_batch" in hello.
+ * Sent as BinaryProtocol3 type 2 (WebSocket) or UDP packet type 0x02 (MQTT), the payload is
+ * |count 1u| followed by count times |AudioBatchFrame|
+ */
+#define AUDIO_BATCH_MESSAGE_TYPE 2
+
+struct AudioBatchFrame {
+    uint32_t timestamp;
+    uint16_t payload_size;
+    uint8_t payload[];
+} __attribute__((packed));
+
+/*
+ * Compact control messages, used instead of JSON when both sides announce "binary_control" in hello.
+ * Sent as BinaryProtocol3 type 3, the payload is |type 1u| followed by the arguments below.
+ * Text arguments are UTF-8 without a terminator and fill the rest of the payload.
+ */
+#define CONTROL_MESSAGE_TYPE 3
+
+enum ControlMessageType : uint8_t {
+    // Device to server
+    kControlListenStart = 0x01,     // |mode 1u| ListeningMode
+    kControlListenStop = 0x02,
+    kControlListenDetect = 0x03,    // |wake word|
+    kControlAbort = 0x04,           // |reason 1u| AbortReason
+    // Server to device
+    kControlTtsStart = 0x81,
+    kControlTtsStop = 0x82,
+    kControlTtsSentence = 0x83,     // |text|
+    kControlStt = 0x84,             // |text|
+    kControlEmotion = 0x85,         // |emotion|
+};
+
 enum AbortReason {
     kAbortReasonNone,
     kAbortReasonWakeWordDetected
@@ -51,12 +95,29 @@ public:
     inline int server_frame_duration() const {
         return server_frame_duration_;
     }
+    inline int uplink_frame_duration() const {
+        return uplink_frame_duration_;
+    }
+    inline int uplink_complexity() const {
+        return uplink_complexity_;
+    }
+    inline bool uplink_adaptive() const {
+        return uplink_adaptive_;
+    }
     inline const std::string& session_id() const {
         return session_id_;
     }
+    // Seconds between stats reports, 0 if the server did not ask for them
+    inline int stats_interval() const {
+        return stats_interval_;
+    }
+    AudioChannelStats GetAudioChannelStats() {
+        return audio_channel_stats_.Get();
+    }
 
     void OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback);
     void OnIncomingJson(std::function<void(const cJSON* root)> callback);
+    void OnIncomingControl(std::function<void(uint8_t type, std::string&& text)> callback);
     void OnAudioChannelOpened(std::function<void()> callback);
     void OnAudioChannelClosed(std::function<void()> callback);
     void OnNetworkError(std::function<void(const std::string& message)> callback);
@@ -67,15 +128,21 @@ public:
     virtual bool OpenAudioChannel() = 0;
     virtual void CloseAudioChannel() = 0;
     virtual bool IsAudioChannelOpened() const = 0;
+    // Connects the transport ahead of OpenAudioChannel, so a wake word only waits for the hello.
+    // Called periodically on a worker task while idle, cheap when the connection is already warm.
+    virtual void PrewarmAudioChannel() {}
     virtual bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) = 0;
     virtual void SendWakeWordDetected(const std::string& wake_word);
     virtual void SendStartListening(ListeningMode mode);
     virtual void SendStopListening();
     virtual void SendAbortSpeaking(AbortReason reason);
     virtual void SendMcpMessage(const std::string& message);
+    // Reports the audio channel stats, the server answers with a pong that measures the RTT
+    virtual void SendAudioChannelStats();
 
 protected:
     std::function<void(const cJSON* root)> on_incoming_json_;
+    std::function<void(uint8_t type, std::string&& text)> on_incoming_control_;
     std::function<void(std::unique_ptr<AudioStreamPacket> packet)> on_incoming_audio_;
     std::function<void()> on_audio_channel_opened_;
     std::function<void()> on_audio_channel_closed_;
@@ -85,13 +152,54 @@ protected:
 
     int server_sample_rate_ = 24000;
     int server_frame_duration_ = 60;
+    int uplink_frame_duration_ = 60;
+    int uplink_complexity_ = 0;
+    bool uplink_adaptive_ = false;
+    int audio_batch_frames_ = 1;
+    bool binary_control_ = false;
+    std::vector<uint8_t> audio_batch_;
+    // Left free in front of audio_batch_ for the transport to write its header, so the batch is sent in place
+    size_t audio_batch_headroom_ = 0;
+    int stats_interval_ = 0;
+    // Uplink loss measured by the server and returned in pong, -1 if unknown
+    std::atomic<int> uplink_loss_percent_{-1};
+    AudioChannelStatsTracker audio_channel_stats_;
     bool error_occurred_ = false;
     std::string session_id_;
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
+    int64_t last_prewarm_time_us_ = 0;
+    // Held while the transport is connected or closed, the prewarm runs on a worker task and
+    // OpenAudioChannel waits for it rather than connecting a second time
+    std::mutex connect_mutex_;
 
     virtual bool SendText(const std::string& text) = 0;
     virtual void SetError(const std::string& message);
     virtual bool IsTimeout() const;
+    // Sends the frames waiting in a partial batch
+    virtual bool SendAudioBatch() { return true; }
+    // Sends a binary control message, only called when binary_control_ was negotiated
+    virtual bool SendControl(uint8_t type, const void* args, size_t size) { return false; }
+
+    void AddUplinkAudioParams(cJSON* audio_params);
+    void ParseUplinkAudioParams(const cJSON* audio_params);
+    void AddAudioBatchFeature(cJSON* features);
+    // Resets audio_batch_, call it with the lock SendAudio holds, the hello arrives on the network task
+    void ParseAudioBatchFeature(const cJSON* root);
+    // Returns true when the batch is full and should be sent
+    bool AddToAudioBatch(const AudioStreamPacket& packet);
+    // Passes every frame of a received batch to on_incoming_audio_, sequenced from first_sequence if not 0
+    bool ParseAudioBatch(const uint8_t* data, size_t size, uint32_t first_sequence);
+    void AddStatsFeature(cJSON* features);
+    void ParseStatsFeature(const cJSON* root);
+    // Counts a received audio packet in the channel stats, a timestamp of 0 leaves the jitter alone
+    void CountIncomingAudio(uint32_t sequence, uint32_t timestamp);
+    void ParsePong(const cJSON* root);
+    void ParseBinaryControlFeature(const cJSON* root);
+    // Passes a received control message to on_incoming_control_
+    bool ParseControl(const uint8_t* data, size_t size);
+    // Dispatches the frequent tts, stt and llm messages to on_incoming_control_ without building a cJSON tree.
+    // Returns false if the message needs the full parser.
+    bool ParseJsonAsControl(const char* data, size_t size);
 };
 
 #endif // PROTOCOL_H
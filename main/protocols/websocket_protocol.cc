@@ -5,8 +5,10 @@
 #include "settings.h"
 
 #include <cstring>
+#include <algorithm>
 #include <cJSON.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <arpa/inet.h>
 #include "assets/lang_config.h"
 
@@ -14,6 +16,7 @@
 
 WebsocketProtocol::WebsocketProtocol() {
     event_group_handle_ = xEventGroupCreate();
+    audio_batch_headroom_ = sizeof(BinaryProtocol3);
 }
 
 WebsocketProtocol::~WebsocketProtocol() {
@@ -26,38 +29,97 @@ bool WebsocketProtocol::Start() {
 }
 
 bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
+    std::lock_guard<std::mutex> lock(channel_mutex_);
     if (websocket_ == nullptr || !websocket_->IsConnected()) {
         return false;
     }
 
-    if (version_ == 2) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol2) + packet->payload.size());
-        auto bp2 = (BinaryProtocol2*)serialized.data();
-        bp2->version = htons(version_);
-        bp2->type = 0;
-        bp2->reserved = 0;
-        bp2->timestamp = htonl(packet->timestamp);
-        bp2->payload_size = htonl(packet->payload.size());
-        memcpy(bp2->payload, packet->payload.data(), packet->payload.size());
-
-        return websocket_->Send(serialized.data(), serialized.size(), true);
-    } else if (version_ == 3) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol3) + packet->payload.size());
-        auto bp3 = (BinaryProtocol3*)serialized.data();
-        bp3->type = 0;
-        bp3->reserved = 0;
-        bp3->payload_size = htons(packet->payload.size());
-        memcpy(bp3->payload, packet->payload.data(), packet->payload.size());
-
-        return websocket_->Send(serialized.data(), serialized.size(), true);
+    if (audio_batch_frames_ > 1) {
+        bool full = AddToAudioBatch(*packet);
+        Application::GetInstance().GetAudioService().ReleasePacket(std::move(packet));
+        return full ? SendBatchLocked() : true;
+    }
+
+    bool sent;
+    if (version_ == 2 || version_ == 3) {
+        // The header is written in place into a buffer that keeps its capacity, so framing does not allocate
+        size_t header_size = version_ == 2 ? sizeof(BinaryProtocol2) : sizeof(BinaryProtocol3);
+        send_buffer_.resize(header_size + packet->payload.size());
+        if (version_ == 2) {
+            auto bp2 = (BinaryProtocol2*)send_buffer_.data();
+            bp2->version = htons(version_);
+            bp2->type = 0;
+            bp2->reserved = 0;
+            bp2->timestamp = htonl(packet->timestamp);
+            bp2->payload_size = htonl(packet->payload.size());
+        } else {
+            auto bp3 = (BinaryProtocol3*)send_buffer_.data();
+            bp3->type = 0;
+            bp3->reserved = 0;
+            bp3->payload_size = htons(packet->payload.size());
+        }
+        memcpy(send_buffer_.data() + header_size, packet->payload.data(), packet->payload.size());
+
+        sent = websocket_->Send(send_buffer_.data(), send_buffer_.size(), true);
     } else {
-        return websocket_->Send(packet->payload.data(), packet->payload.size(), true);
+        sent = websocket_->Send(packet->payload.data(), packet->payload.size(), true);
+    }
+
+    Application::GetInstance().GetAudioService().ReleasePacket(std::move(packet));
+    return sent;
+}
+
+bool WebsocketProtocol::SendAudioBatch() {
+    std::lock_guard<std::mutex> lock(channel_mutex_);
+    return SendBatchLocked();
+}
+
+bool WebsocketProtocol::SendBatchLocked() {
+    if (audio_batch_.empty()) {
+        return true;
+    }
+    if (websocket_ == nullptr || !websocket_->IsConnected()) {
+        audio_batch_.clear();
+        return false;
+    }
+
+    // Batches are only negotiated with protocol version 3, the header goes into the headroom of the batch
+    auto bp3 = (BinaryProtocol3*)audio_batch_.data();
+    bp3->type = AUDIO_BATCH_MESSAGE_TYPE;
+    bp3->reserved = 0;
+    bp3->payload_size = htons(audio_batch_.size() - sizeof(BinaryProtocol3));
+    bool sent = websocket_->Send(audio_batch_.data(), audio_batch_.size(), true);
+    audio_batch_.clear();
+    return sent;
+}
+
+bool WebsocketProtocol::SendControl(uint8_t type, const void* args, size_t size) {
+    std::lock_guard<std::mutex> lock(channel_mutex_);
+    if (websocket_ == nullptr || !websocket_->IsConnected()) {
+        return false;
+    }
+
+    // Control messages are only negotiated with protocol version 3
+    send_buffer_.resize(sizeof(BinaryProtocol3) + 1 + size);
+    auto bp3 = (BinaryProtocol3*)send_buffer_.data();
+    bp3->type = CONTROL_MESSAGE_TYPE;
+    bp3->reserved = 0;
+    bp3->payload_size = htons(1 + size);
+    bp3->payload[0] = type;
+    if (size > 0) {
+        memcpy(bp3->payload + 1, args, size);
+    }
+
+    if (!websocket_->Send(send_buffer_.data(), send_buffer_.size(), true)) {
+        ESP_LOGE(TAG, "Failed to send control message: %02x", type);
+        SetError(Lang::Strings::SERVER_ERROR);
+        return false;
     }
+    return true;
 }
 
 bool WebsocketProtocol::SendText(const std::string& text) {
+    std::lock_guard<std::mutex> lock(channel_mutex_);
     if (websocket_ == nullptr || !websocket_->IsConnected()) {
         return false;
     }
@@ -72,14 +134,102 @@ bool WebsocketProtocol::SendText(const std::string& text) {
 }
 
 bool WebsocketProtocol::IsAudioChannelOpened() const {
-    return websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_ && !IsTimeout();
+    // The prewarm worker may free a dropped websocket_ at any time
+    std::lock_guard<std::mutex> lock(channel_mutex_);
+    return !prewarmed_ && websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_ && !IsTimeout();
 }
 
 void WebsocketProtocol::CloseAudioChannel() {
-    websocket_.reset();
+    std::lock_guard<std::mutex> lock(connect_mutex_);
+    prewarmed_ = false;
+    ResetWebSocket();
+}
+
+void WebsocketProtocol::ResetWebSocket() {
+    std::unique_ptr<WebSocket> websocket;
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        websocket = std::move(websocket_);
+    }
+    // Closed outside the lock, the disconnect callbacks may run while it shuts down
+    websocket.reset();
+}
+
+void WebsocketProtocol::PrewarmAudioChannel() {
+    // Runs on a worker task, skipped while the main event loop opens or closes the channel
+    std::unique_lock<std::mutex> lock(connect_mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return;
+    }
+    if (websocket_ != nullptr) {
+        if (websocket_->IsConnected()) {
+            return;
+        }
+        // The server or the network dropped it, an audio channel would fail on it anyway
+        prewarmed_ = true;
+        ResetWebSocket();
+        prewarmed_ = false;
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (last_prewarm_time_us_ != 0 && now - last_prewarm_time_us_ < AUDIO_CHANNEL_PREWARM_RETRY_MS * 1000LL) {
+        return;
+    }
+    last_prewarm_time_us_ = now;
+
+    prewarmed_ = true;
+    if (!Connect()) {
+        ResetWebSocket();
+        prewarmed_ = false;
+        return;
+    }
+    ESP_LOGI(TAG, "Prewarmed websocket connection in %d ms", (int)((esp_timer_get_time() - now) / 1000));
 }
 
 bool WebsocketProtocol::OpenAudioChannel() {
+    int64_t start_time = esp_timer_get_time();
+    error_occurred_ = false;
+
+    bool warm;
+    {
+        // Waits for a prewarm that is still connecting on the worker
+        std::lock_guard<std::mutex> lock(connect_mutex_);
+        warm = prewarmed_ && websocket_ != nullptr && websocket_->IsConnected();
+        prewarmed_ = false;
+        if (!warm && !Connect()) {
+            return false;
+        }
+    }
+    int64_t connected_time = esp_timer_get_time();
+
+    // Send hello message to describe the client
+    auto message = GetHelloMessage();
+    if (!SendText(message)) {
+        return false;
+    }
+
+    // Wait for server hello
+    EventBits_t bits = xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(10000));
+    if (!(bits & WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT)) {
+        ESP_LOGE(TAG, "Failed to receive server hello");
+        SetError(Lang::Strings::SERVER_TIMEOUT);
+        return false;
+    }
+
+    // Connect covers TCP, TLS and the websocket upgrade, the transport does not time them separately
+    int64_t hello_time = esp_timer_get_time();
+    ESP_LOGI(TAG, "Audio channel opened in %d ms: connect %d ms%s, hello %d ms",
+        (int)((hello_time - start_time) / 1000), (int)((connected_time - start_time) / 1000),
+        warm ? " (prewarmed)" : "", (int)((hello_time - connected_time) / 1000));
+
+    if (on_audio_channel_opened_ != nullptr) {
+        on_audio_channel_opened_();
+    }
+
+    return true;
+}
+
+bool WebsocketProtocol::Connect() {
     Settings settings("websocket", false);
     std::string url = settings.GetString("url");
     std::string token = settings.GetString("token");
@@ -88,10 +238,13 @@ bool WebsocketProtocol::OpenAudioChannel() {
         version_ = version;
     }
 
-    error_occurred_ = false;
-
     auto network = Board::GetInstance().GetNetwork();
-    websocket_ = network->CreateWebSocket(1);
+    ResetWebSocket();
+    auto websocket = network->CreateWebSocket(1);
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        websocket_ = std::move(websocket);
+    }
     if (websocket_ == nullptr) {
         ESP_LOGE(TAG, "Failed to create websocket");
         return false;
@@ -110,54 +263,63 @@ bool WebsocketProtocol::OpenAudioChannel() {
 
     websocket_->OnData([this](const char* data, size_t len, bool binary) {
         if (binary) {
-            if (on_incoming_audio_ != nullptr) {
+            if (version_ == 3 && len >= sizeof(BinaryProtocol3) && data[0] == AUDIO_BATCH_MESSAGE_TYPE) {
+                auto bp3 = (const BinaryProtocol3*)data;
+                ParseAudioBatch(bp3->payload, std::min<size_t>(ntohs(bp3->payload_size), len - sizeof(BinaryProtocol3)), 0);
+            } else if (version_ == 3 && len >= sizeof(BinaryProtocol3) && data[0] == CONTROL_MESSAGE_TYPE) {
+                auto bp3 = (const BinaryProtocol3*)data;
+                ParseControl(bp3->payload, std::min<size_t>(ntohs(bp3->payload_size), len - sizeof(BinaryProtocol3)));
+            } else if (on_incoming_audio_ != nullptr) {
+                auto packet = Application::GetInstance().GetAudioService().AcquirePacket();
+                packet->sample_rate = server_sample_rate_;
+                packet->frame_duration = server_frame_duration_;
+                packet->timestamp = 0;
+                // TCP delivers in order, the jitter buffer passes unsequenced packets straight through
+                packet->sequence = 0;
+                // Headers are read where they are, the payload is copied once into the pooled packet
                 if (version_ == 2) {
-                    BinaryProtocol2* bp2 = (BinaryProtocol2*)data;
-                    bp2->version = ntohs(bp2->version);
-                    bp2->type = ntohs(bp2->type);
-                    bp2->timestamp = ntohl(bp2->timestamp);
-                    bp2->payload_size = ntohl(bp2->payload_size);
-                    auto payload = (uint8_t*)bp2->payload;
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = bp2->timestamp,
-                        .payload = std::vector<uint8_t>(payload, payload + bp2->payload_size)
-                    }));
+                    auto bp2 = (const BinaryProtocol2*)data;
+                    if (len < sizeof(BinaryProtocol2) || ntohl(bp2->payload_size) > len - sizeof(BinaryProtocol2)) {
+                        ESP_LOGE(TAG, "Invalid audio packet size: %u", len);
+                        Application::GetInstance().GetAudioService().ReleasePacket(std::move(packet));
+                        return;
+                    }
+                    packet->timestamp = ntohl(bp2->timestamp);
+                    packet->payload.assign(bp2->payload, bp2->payload + ntohl(bp2->payload_size));
                 } else if (version_ == 3) {
-                    BinaryProtocol3* bp3 = (BinaryProtocol3*)data;
-                    bp3->type = bp3->type;
-                    bp3->payload_size = ntohs(bp3->payload_size);
-                    auto payload = (uint8_t*)bp3->payload;
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>(payload, payload + bp3->payload_size)
-                    }));
+                    auto bp3 = (const BinaryProtocol3*)data;
+                    if (len < sizeof(BinaryProtocol3) || ntohs(bp3->payload_size) > len - sizeof(BinaryProtocol3)) {
+                        ESP_LOGE(TAG, "Invalid audio packet size: %u", len);
+                        Application::GetInstance().GetAudioService().ReleasePacket(std::move(packet));
+                        return;
+                    }
+                    packet->payload.assign(bp3->payload, bp3->payload + ntohs(bp3->payload_size));
                 } else {
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>((uint8_t*)data, (uint8_t*)data + len)
-                    }));
+                    packet->payload.assign((uint8_t*)data, (uint8_t*)data + len);
                 }
+                CountIncomingAudio(0, packet->timestamp);
+                on_incoming_audio_(std::move(packet));
             }
         } else {
-            // Parse JSON data
-            auto root = cJSON_Parse(data);
+            // Parse JSON data, the frequent messages skip the cJSON tree
+            if (ParseJsonAsControl(data, len)) {
+                last_incoming_time_ = std::chrono::steady_clock::now();
+                return;
+            }
+            auto root = cJSON_ParseWithLength(data, len);
             auto type = cJSON_GetObjectItem(root, "type");
             if (cJSON_IsString(type)) {
                 if (strcmp(type->valuestring, "hello") == 0) {
                     ParseServerHello(root);
+                } else if (strcmp(type->valuestring, "pong") == 0) {
+                    ParsePong(root);
                 } else {
                     if (on_incoming_json_ != nullptr) {
                         on_incoming_json_(root);
                     }
                 }
             } else {
-                ESP_LOGE(TAG, "Missing message type, data: %s", data);
+                ESP_LOGE(TAG, "Missing message type, data: %.*s", (int)len, data);
             }
             cJSON_Delete(root);
         }
@@ -166,6 +328,10 @@ bool WebsocketProtocol::OpenAudioChannel() {
 
     websocket_->OnDisconnected([this]() {
         ESP_LOGI(TAG, "Websocket disconnected");
+        if (prewarmed_) {
+            // No audio channel was opened on it, the next prewarm reconnects
+            return;
+        }
         if (on_audio_channel_closed_ != nullptr) {
             on_audio_channel_closed_();
         }
@@ -174,28 +340,12 @@ bool WebsocketProtocol::OpenAudioChannel() {
     ESP_LOGI(TAG, "Connecting to websocket server: %s with version: %d", url.c_str(), version_);
     if (!websocket_->Connect(url.c_str())) {
         ESP_LOGE(TAG, "Failed to connect to websocket server, code=%d", websocket_->GetLastError());
-        SetError(Lang::Strings::SERVER_NOT_CONNECTED);
-        return false;
-    }
-
-    // Send hello message to describe the client
-    auto message = GetHelloMessage();
-    if (!SendText(message)) {
-        return false;
-    }
-
-    // Wait for server hello
-    EventBits_t bits = xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(10000));
-    if (!(bits & WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT)) {
-        ESP_LOGE(TAG, "Failed to receive server hello");
-        SetError(Lang::Strings::SERVER_TIMEOUT);
+        // A failed prewarm is retried later, the user did not ask for a connection yet
+        if (!prewarmed_) {
+            SetError(Lang::Strings::SERVER_NOT_CONNECTED);
+        }
         return false;
     }
-
-    if (on_audio_channel_opened_ != nullptr) {
-        on_audio_channel_opened_();
-    }
-
     return true;
 }
 
@@ -209,6 +359,11 @@ std::string WebsocketProtocol::GetHelloMessage() {
     cJSON_AddBoolToObject(features, "aec", true);
 #endif
     cJSON_AddBoolToObject(features, "mcp", true);
+    if (version_ == 3) {
+        AddAudioBatchFeature(features);
+        cJSON_AddBoolToObject(features, "binary_control", true);
+    }
+    AddStatsFeature(features);
     cJSON_AddItemToObject(root, "features", features);
     cJSON_AddStringToObject(root, "transport", "websocket");
     cJSON* audio_params = cJSON_CreateObject();
@@ -216,6 +371,7 @@ std::string WebsocketProtocol::GetHelloMessage() {
     cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
     cJSON_AddNumberToObject(audio_params, "channels", 1);
     cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
+    AddUplinkAudioParams(audio_params);
     cJSON_AddItemToObject(root, "audio_params", audio_params);
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
@@ -248,6 +404,16 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
             server_frame_duration_ = frame_duration->valueint;
         }
     }
+    ParseUplinkAudioParams(audio_params);
+    binary_control_ = false;
+    if (version_ == 3) {
+        {
+            std::lock_guard<std::mutex> lock(channel_mutex_);
+            ParseAudioBatchFeature(root);
+        }
+        ParseBinaryControlFeature(root);
+    }
+    ParseStatsFeature(root);
 
     xEventGroupSetBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
 }
@@ -5,6 +5,7 @@
 #include "protocol.h"
 
 #include <web_socket.h>
+#include <mutex>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
 
@@ -20,14 +21,28 @@ public:
     bool OpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
+    void PrewarmAudioChannel() override;
 
 private:
     EventGroupHandle_t event_group_handle_;
+    // Audio is sent by its own task, the lock keeps websocket_ alive and send_buffer_ / audio_batch_ consistent.
+    // websocket_ is only replaced under connect_mutex_, by the main event loop or by the prewarm worker, and
+    // anything that does not hold connect_mutex_ must hold this lock to dereference it.
+    mutable std::mutex channel_mutex_;
     std::unique_ptr<WebSocket> websocket_;
     int version_ = 1;
-
+    // Connected ahead of time without a hello, not an audio channel yet
+    std::atomic<bool> prewarmed_{false};
+    // Framing buffer for outgoing audio, reused by every SendAudio call
+    std::vector<uint8_t> send_buffer_;
+
+    bool Connect();
+    void ResetWebSocket();
+    bool SendBatchLocked();
     void ParseServerHello(const cJSON* root);
     bool SendText(const std::string& text) override;
+    bool SendAudioBatch() override;
+    bool SendControl(uint8_t type, const void* args, size_t size) override;
     std::string GetHelloMessage();
 };
 
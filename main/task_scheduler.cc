@@ -0,0 +1,183 @@
+#include "task_scheduler.h"
+#include "pipeline_trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#define TAG "TaskScheduler"
+
+// __builtin_FILE() is the path given to the compiler, only the file name is printed
+static const char* BaseName(const char* path) {
+    const char* slash = strrchr(path, '/');
+    return slash != nullptr ? slash + 1 : path;
+}
+
+static bool SameSite(const char* file_a, int line_a, const char* file_b, int line_b) {
+    return line_a == line_b && (file_a == file_b || strcmp(file_a, file_b) == 0);
+}
+
+void TaskScheduler::Push(std::function<void()> callback, TaskPriority priority, int deadline_ms, const char* caller,
+    const char* file, int line) {
+    Task task;
+    task.callback = std::move(callback);
+    task.caller = caller;
+    task.file = file;
+    task.line = line;
+    task.enqueue_time_us = esp_timer_get_time();
+    task.deadline_us = deadline_ms > 0 ? task.enqueue_time_us + deadline_ms * 1000LL : 0;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    queues_[priority].push_back(std::move(task));
+}
+
+bool TaskScheduler::RunPending() {
+    size_t budget = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& queue : queues_) {
+            budget += queue.size();
+        }
+    }
+
+    // Tasks pushed while running wait for the next call, so the event loop still gets to its other events
+    for (; budget > 0; budget--) {
+        Task task;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto queue = std::find_if(std::begin(queues_), std::end(queues_), [](const std::deque<Task>& q) { return !q.empty(); });
+            if (queue == std::end(queues_)) {
+                return false;
+            }
+            task = std::move(queue->front());
+            queue->pop_front();
+        }
+        Run(task);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::any_of(std::begin(queues_), std::end(queues_), [](const std::deque<Task>& q) { return !q.empty(); });
+}
+
+void TaskScheduler::Run(Task& task) {
+    int64_t start_time = esp_timer_get_time();
+    bool missed = task.deadline_us > 0 && start_time > task.deadline_us;
+    if (missed) {
+        ESP_LOGW(TAG, "Task from %s (%s:%d) started %d ms after its deadline", task.caller, BaseName(task.file),
+            task.line, (int)((start_time - task.deadline_us) / 1000));
+    }
+
+    PIPELINE_TRACE(kTraceTaskBegin, task.line);
+    task.callback();
+    PIPELINE_TRACE(kTraceTaskEnd, task.line);
+
+#if CONFIG_USE_SCHEDULE_STATS
+    Record(task, start_time, esp_timer_get_time(), missed);
+#endif
+}
+
+void TaskScheduler::SetWorkers(int count, int priority, int stack_size) {
+    worker_count_ = count;
+    worker_priority_ = priority;
+    worker_stack_size_ = stack_size;
+}
+
+bool TaskScheduler::PushToWorker(std::function<void()>&& callback, const char* caller, const char* file, int line) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Another worker is started only when the idle ones already have a task each
+    if (started_workers_ < worker_count_ && idle_workers_ <= (int)worker_queue_.size()) {
+        auto result = xTaskCreate([](void* arg) {
+            ((TaskScheduler*)arg)->WorkerTask();
+            vTaskDelete(NULL);
+        }, "schedule_worker", worker_stack_size_, this, worker_priority_, nullptr);
+        if (result == pdPASS) {
+            // Idle from the start, it takes the task below as soon as it runs
+            started_workers_++;
+            idle_workers_++;
+            ESP_LOGI(TAG, "Started schedule worker %d of %d", started_workers_, worker_count_);
+        } else {
+            ESP_LOGE(TAG, "Failed to start a schedule worker");
+        }
+    }
+    if (started_workers_ == 0) {
+        return false;
+    }
+
+    Task task;
+    task.callback = std::move(callback);
+    task.caller = caller;
+    task.file = file;
+    task.line = line;
+    task.enqueue_time_us = esp_timer_get_time();
+    worker_queue_.push_back(std::move(task));
+    worker_cv_.notify_one();
+    return true;
+}
+
+void TaskScheduler::WorkerTask() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        worker_cv_.wait(lock, [this]() { return !worker_queue_.empty(); });
+        idle_workers_--;
+        auto task = std::move(worker_queue_.front());
+        worker_queue_.pop_front();
+        lock.unlock();
+        Run(task);
+        lock.lock();
+        idle_workers_++;
+    }
+}
+
+void TaskScheduler::Record(const Task& task, int64_t start_time_us, int64_t end_time_us, bool missed) {
+    uint32_t wait_us = (uint32_t)(start_time_us - task.enqueue_time_us);
+    uint32_t run_us = (uint32_t)(end_time_us - start_time_us);
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    SiteStats* site = &other_sites_;
+    for (auto& s : sites_) {
+        if (s.file == nullptr) {
+            s.caller = task.caller;
+            s.file = task.file;
+            s.line = task.line;
+        }
+        if (SameSite(s.file, s.line, task.file, task.line)) {
+            site = &s;
+            break;
+        }
+    }
+
+    site->count++;
+    site->missed += missed ? 1 : 0;
+    site->total_wait_us += wait_us;
+    site->total_run_us += run_us;
+    site->max_wait_us = std::max(site->max_wait_us, wait_us);
+    site->max_run_us = std::max(site->max_run_us, run_us);
+}
+
+void TaskScheduler::PrintStats() {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    for (auto& site : sites_) {
+        PrintSite(site);
+    }
+    PrintSite(other_sites_);
+}
+
+void TaskScheduler::PrintSite(SiteStats& site) {
+    if (site.count == 0) {
+        return;
+    }
+    ESP_LOGI(TAG, "%s (%s:%d) n=%lu wait avg=%lu max=%lu us, run avg=%lu max=%lu us, missed=%lu",
+        site.caller, site.file != nullptr ? BaseName(site.file) : "", site.line, site.count,
+        (uint32_t)(site.total_wait_us / site.count), site.max_wait_us,
+        (uint32_t)(site.total_run_us / site.count), site.max_run_us, site.missed);
+    // Keep the call site, so the table does not fill up with the same entries again
+    site.count = 0;
+    site.missed = 0;
+    site.total_wait_us = 0;
+    site.total_run_us = 0;
+    site.max_wait_us = 0;
+    site.max_run_us = 0;
+}
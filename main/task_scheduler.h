@@ -0,0 +1,93 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+
+#define SCHEDULE_STATS_MAX_SITES 24
+
+enum TaskPriority {
+    kTaskPriorityAudio,         // Changes the audio flow (TTS start / stop), runs before anything queued
+    kTaskPriorityControl,       // Device and protocol state changes, the default
+    kTaskPriorityBackground,    // Display text, MCP tool calls and housekeeping
+    kTaskPriorityCount,
+};
+
+/*
+ * The queues behind Application::Schedule.
+ *
+ * The main event loop calls RunPending(), which always runs the highest priority task first and FIFO within
+ * a priority, so audio work does not wait behind MCP tool calls. Tasks may have a deadline, a task that starts
+ * after its deadline still runs but is logged and counted.
+ *
+ * Work that blocks for long (camera capture, HTTP) can go to the worker tasks instead of the main loop. The
+ * workers are started when such work arrives and no idle worker can take it, so their stacks are only
+ * allocated on boards that use them.
+ *
+ * With CONFIG_USE_SCHEDULE_STATS, queue wait and run time are kept per call site (file and line, the function
+ * is only printed because inside a lambda it is just "operator()") and printed with the other statistics.
+ */
+class TaskScheduler {
+public:
+    void Push(std::function<void()> callback, TaskPriority priority, int deadline_ms, const char* caller,
+        const char* file, int line);
+    // Runs the tasks queued when it was called, higher priority tasks pushed meanwhile may run before them.
+    // Returns true if tasks are left for the next call.
+    bool RunPending();
+
+    // Allows up to count workers, none is started yet
+    void SetWorkers(int count, int priority, int stack_size);
+    bool HasWorkers() const { return worker_count_ > 0; }
+    // Returns false, leaving callback as it was, if no worker is allowed or could be started
+    bool PushToWorker(std::function<void()>&& callback, const char* caller, const char* file, int line);
+
+    void PrintStats();
+
+private:
+    struct Task {
+        std::function<void()> callback;
+        const char* caller = nullptr;
+        const char* file = nullptr;
+        int line = 0;
+        int64_t enqueue_time_us = 0;
+        int64_t deadline_us = 0;    // 0 if none
+    };
+
+    struct SiteStats {
+        const char* caller = nullptr;
+        const char* file = nullptr;
+        int line = 0;
+        uint32_t count = 0;
+        uint32_t missed = 0;
+        uint32_t max_wait_us = 0;
+        uint32_t max_run_us = 0;
+        uint64_t total_wait_us = 0;
+        uint64_t total_run_us = 0;
+    };
+
+    std::mutex mutex_;
+    std::deque<Task> queues_[kTaskPriorityCount];
+
+    std::condition_variable worker_cv_;
+    std::deque<Task> worker_queue_;
+    int worker_count_ = 0;
+    int worker_priority_ = 0;
+    int worker_stack_size_ = 0;
+    int started_workers_ = 0;
+    int idle_workers_ = 0;
+
+    std::mutex stats_mutex_;
+    SiteStats sites_[SCHEDULE_STATS_MAX_SITES];
+    // Collects the call sites that found the table full, so the ones already listed keep their entries
+    SiteStats other_sites_ = {"(other)"};
+
+    void Run(Task& task);
+    void WorkerTask();
+    void Record(const Task& task, int64_t start_time_us, int64_t end_time_us, bool missed);
+    void PrintSite(SiteStats& site);
+};
+
+#endif // TASK_SCHEDULER_H
@@ -0,0 +1,161 @@
+import argparse
+import csv
+import random
+
+
+'''
+  Replay a server audio packet trace through the same algorithm as main/audio/jitter_buffer.cc,
+  and report concealed / late packets, playback underruns and the mouth-to-ear delay.
+
+  Without --trace, a trace is generated with the given loss rate and jitter.
+  A trace is a CSV file with one "sequence,arrival_ms" row per received packet.
+'''
+
+MIN_DELAY_MS = 20
+MAX_DELAY_MS = 480
+MAX_CONCEALED_FRAMES = 3
+MAX_PLAYBACK_TASKS_IN_QUEUE = 2
+
+
+class JitterBuffer:
+    def __init__(self, frame_ms):
+        self.frame_ms = frame_ms
+        self.packets = []   # [sequence, arrival_ms], sorted by sequence
+        self.playing = False
+        self.next_sequence = None
+        self.missing_since = None
+        self.last_transit = None
+        self.jitter = 0.0
+        self.late = self.duplicate = self.concealed = self.skipped = 0
+
+    def target_delay(self):
+        return min(max(3 * self.jitter, MIN_DELAY_MS), MAX_DELAY_MS)
+
+    def buffered(self):
+        return len(self.packets) * self.frame_ms
+
+    def push(self, sequence, now):
+        if self.next_sequence is not None and sequence < self.next_sequence:
+            self.late += 1
+            return
+        # Traces carry no timestamps, the buffer then uses sequence numbers as the media clock
+        transit = now - sequence * self.frame_ms
+        if self.last_transit is not None:
+            self.jitter += (abs(transit - self.last_transit) - self.jitter) / 16
+        self.last_transit = transit
+        if any(p[0] == sequence for p in self.packets):
+            self.duplicate += 1
+            return
+        self.packets.append([sequence, now])
+        self.packets.sort()
+
+    def pop(self, now):
+        """Returns a sequence number, 'plc' for a concealed frame, or None if nothing is due"""
+        if not self.packets:
+            return None
+        target = self.target_delay()
+        sequence, arrival = self.packets[0]
+        enough_buffered = self.buffered() >= target + self.frame_ms
+        if not self.playing:
+            if not enough_buffered and now - arrival < target:
+                return None
+            self.playing = True
+            self.next_sequence = sequence
+            self.missing_since = None
+        gap = sequence - self.next_sequence
+        if gap > 0:
+            if self.missing_since is None:
+                self.missing_since = now
+            if not enough_buffered and now - self.missing_since < target:
+                return None
+            if gap <= MAX_CONCEALED_FRAMES:
+                self.next_sequence += 1
+                self.concealed += 1
+                return 'plc'
+            self.skipped += gap
+            self.next_sequence = sequence
+        self.next_sequence += 1
+        self.missing_since = None
+        self.packets.pop(0)
+        return sequence
+
+
+def generate_trace(frames, frame_ms, loss, jitter_ms, base_delay_ms, seed):
+    rng = random.Random(seed)
+    trace = []
+    for sequence in range(1, frames + 1):
+        if rng.random() < loss:
+            continue
+        delay = base_delay_ms + rng.expovariate(1.0 / jitter_ms) if jitter_ms > 0 else base_delay_ms
+        trace.append((sequence, (sequence - 1) * frame_ms + delay))
+    return sorted(trace, key=lambda p: p[1])
+
+
+def load_trace(path):
+    with open(path) as f:
+        return sorted(((int(row[0]), float(row[1])) for row in csv.reader(f) if row), key=lambda p: p[1])
+
+
+def simulate(trace, frame_ms):
+    jb = JitterBuffer(frame_ms)
+    playback_queue = []
+    next_play_time = None
+    underruns = 0
+    delays = []
+    index = 0
+    end = trace[-1][1] + MAX_DELAY_MS * 4
+    now = 0
+    while now <= end:
+        while index < len(trace) and trace[index][1] <= now:
+            jb.push(trace[index][0], now)
+            index += 1
+        # Opus decode task
+        while len(playback_queue) < MAX_PLAYBACK_TASKS_IN_QUEUE:
+            item = jb.pop(now)
+            if item is None:
+                break
+            playback_queue.append(item)
+        # Audio output task, writes one frame per frame duration once started
+        if next_play_time is None and playback_queue:
+            next_play_time = now
+        if next_play_time is not None and now >= next_play_time:
+            if playback_queue:
+                item = playback_queue.pop(0)
+                if item != 'plc':
+                    delays.append(now - (item - 1) * frame_ms)
+                next_play_time += frame_ms
+            else:
+                if index < len(trace) or jb.packets:
+                    underruns += 1
+                jb.playing = False
+                next_play_time = None
+        now += 1
+    return jb, underruns, delays
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Jitter buffer simulator')
+    parser.add_argument('--trace', help='CSV file with sequence,arrival_ms rows')
+    parser.add_argument('--frames', type=int, default=500)
+    parser.add_argument('--frame-duration', type=int, default=60, help='Opus frame duration in ms')
+    parser.add_argument('--loss', type=float, default=0.02, help='Packet loss rate, 0.0 - 1.0')
+    parser.add_argument('--jitter', type=float, default=30, help='Mean extra network delay in ms')
+    parser.add_argument('--delay', type=float, default=40, help='Base network delay in ms')
+    parser.add_argument('--seed', type=int, default=1)
+    args = parser.parse_args()
+
+    if args.trace:
+        trace = load_trace(args.trace)
+    else:
+        trace = generate_trace(args.frames, args.frame_duration, args.loss, args.jitter, args.delay, args.seed)
+    jb, underruns, delays = simulate(trace, args.frame_duration)
+
+    delays.sort()
+    print(f"packets: {len(trace)}, jitter: {jb.jitter:.1f} ms, target delay: {jb.target_delay():.0f} ms")
+    print(f"late: {jb.late}, duplicate: {jb.duplicate}, concealed: {jb.concealed}, skipped: {jb.skipped}, underruns: {underruns}")
+    if delays:
+        print(f"delay p50: {delays[len(delays) // 2]:.0f} ms, p99: {delays[len(delays) * 99 // 100]:.0f} ms")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,146 @@
+import argparse
+import json
+import re
+import socket
+import sys
+
+
+'''
+  Convert the pipeline trace of main/pipeline_trace.cc (CONFIG_USE_PIPELINE_TRACE) into a Chrome trace
+  that opens in https://ui.perfetto.dev or chrome://tracing.
+
+  The device exports "TRACE <time_us> <core> <task> <event> <arg>" lines, either to the serial console
+  (save the monitor output to a file) or to the audio debugger UDP server on port + 1:
+
+    python trace_to_perfetto.py --udp 8001 --raw trace.txt     # record until Ctrl+C
+    python trace_to_perfetto.py trace.txt -o trace.json
+'''
+
+
+LINE = re.compile(r'TRACE (\d+) (\d+) (\S+) (\S+) (\d+)')
+DROPPED = re.compile(r'TRACE_DROPPED (\d+)')
+
+# Same order as DeviceState in main/device_state.h
+STATES = ['unknown', 'starting', 'wifi_configuring', 'idle', 'connecting', 'listening', 'speaking',
+          'upgrading', 'activating', 'audio_testing', 'fatal_error']
+
+
+def receive_udp(port, path):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(('0.0.0.0', port))
+    print(f"Saving trace from 0.0.0.0:{port} to {path}, Ctrl+C to stop")
+    with open(path, 'w') as f:
+        try:
+            while True:
+                data, _ = sock.recvfrom(2048)
+                f.write(data.decode('utf-8', errors='replace'))
+        except KeyboardInterrupt:
+            pass
+    sock.close()
+
+
+def parse(lines):
+    # Timestamps are the low 32 bits of esp_timer, unwrapped here (they wrap every 71 minutes)
+    records = []
+    dropped = 0
+    epoch = 0
+    last = None
+    for line in lines:
+        m = DROPPED.search(line)
+        if m:
+            dropped += int(m.group(1))
+            continue
+        m = LINE.search(line)
+        if not m:
+            continue
+        time_us = int(m.group(1)) + epoch
+        if last is not None and time_us < last - (1 << 31):
+            epoch += 1 << 32
+            time_us += 1 << 32
+        last = time_us
+        records.append((time_us, int(m.group(2)), m.group(3), m.group(4), int(m.group(5))))
+    records.sort(key=lambda r: r[0])
+    return records, dropped
+
+
+def to_chrome_trace(records):
+    events = []
+    threads = {}
+
+    def tid(task):
+        if task not in threads:
+            threads[task] = len(threads) + 2
+            events.append({'ph': 'M', 'pid': 1, 'tid': threads[task], 'name': 'thread_name', 'args': {'name': task}})
+        return threads[task]
+
+    events.append({'ph': 'M', 'pid': 1, 'tid': 1, 'name': 'thread_name', 'args': {'name': 'device state'}})
+    state_start = None
+    state = None
+    for time_us, core, task, event, arg in records:
+        if event == 'state':
+            # Each state is a slice on its own track, from one change to the next
+            if state is not None:
+                events.append({'ph': 'X', 'pid': 1, 'tid': 1, 'ts': state_start, 'dur': time_us - state_start,
+                               'name': state})
+            state = STATES[arg] if arg < len(STATES) else str(arg)
+            state_start = time_us
+        elif event == 'task_begin':
+            events.append({'ph': 'B', 'pid': 1, 'tid': tid(task), 'ts': time_us, 'name': f'scheduled:{arg}'})
+        elif event == 'task_end':
+            events.append({'ph': 'E', 'pid': 1, 'tid': tid(task), 'ts': time_us})
+        else:
+            events.append({'ph': 'i', 's': 't', 'pid': 1, 'tid': tid(task), 'ts': time_us, 'name': event,
+                           'args': {'arg': arg, 'core': core}})
+    if state is not None and records:
+        events.append({'ph': 'X', 'pid': 1, 'tid': 1, 'ts': state_start, 'dur': records[-1][0] - state_start,
+                       'name': state})
+    return {'traceEvents': events, 'displayTimeUnit': 'ms'}
+
+
+def print_latency(records):
+    # Median time from each encode to the next send, the uplink delay the sender task is meant to keep short
+    encodes = [r[0] for r in records if r[3] == 'encode_done']
+    sends = [r[0] for r in records if r[3] == 'send']
+    delays = []
+    j = 0
+    for t in encodes:
+        while j < len(sends) and sends[j] < t:
+            j += 1
+        if j < len(sends):
+            delays.append(sends[j] - t)
+            j += 1
+    if delays:
+        delays.sort()
+        print(f"encode -> send: {len(delays)} frames, p50 {delays[len(delays) // 2]} us, "
+              f"p99 {delays[len(delays) * 99 // 100]} us, max {delays[-1]} us")
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Pipeline trace to Chrome / Perfetto trace converter')
+    parser.add_argument('input', nargs='?', help='Serial log or raw trace file')
+    parser.add_argument('-o', '--output', default='trace.json')
+    parser.add_argument('--udp', type=int, help='Receive the trace from the audio debugger on this port first')
+    parser.add_argument('--raw', default='trace.txt', help='Where --udp saves the raw trace')
+    args = parser.parse_args()
+
+    path = args.input
+    if args.udp:
+        receive_udp(args.udp, args.raw)
+        path = args.raw
+    if path is None:
+        parser.error('input file or --udp is required')
+
+    with open(path, encoding='utf-8', errors='replace') as f:
+        records, dropped = parse(f)
+    if not records:
+        sys.exit(f"No trace records in {path}")
+
+    with open(args.output, 'w') as f:
+        json.dump(to_chrome_trace(records), f)
+    duration = (records[-1][0] - records[0][0]) / 1e6
+    print(f"{len(records)} events over {duration:.1f} s, {dropped} dropped, written to {args.output}")
+    print_latency(records)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,84 @@
+import argparse
+import random
+
+
+'''
+  Estimate how many uplink audio frames reach the server with and without the UDP redundancy
+  of main/protocols/mqtt_protocol.cc, where every packet repeats the previous frame.
+
+  Losses are drawn either independently or from a Gilbert-Elliott model (bursts), since the
+  bursts are what hurts speech recognition: a single missing 60 ms frame is usually harmless,
+  a run of missing frames drops phonemes.
+'''
+
+
+def random_losses(packets, loss, rng):
+    return [rng.random() < loss for _ in range(packets)]
+
+
+def burst_losses(packets, loss, burst, rng):
+    # Two state Markov chain with a mean burst length of `burst` packets and an average loss of `loss`
+    p_bad_to_good = 1.0 / burst
+    p_good_to_bad = loss * p_bad_to_good / (1.0 - loss)
+    bad = False
+    lost = []
+    for _ in range(packets):
+        bad = rng.random() < (1.0 - p_bad_to_good if bad else p_good_to_bad)
+        lost.append(bad)
+    return lost
+
+
+def received_frames(lost, redundancy):
+    # Frame i is carried by packet i, and by packet i + 1 when redundancy is on
+    frames = []
+    for i in range(len(lost)):
+        ok = not lost[i]
+        if redundancy and i + 1 < len(lost):
+            ok = ok or not lost[i + 1]
+        frames.append(ok)
+    return frames
+
+
+def gap_stats(frames, long_gap):
+    gaps = 0
+    longest = 0
+    run = 0
+    for ok in frames + [True]:
+        if ok:
+            if run >= long_gap:
+                gaps += 1
+            longest = max(longest, run)
+            run = 0
+        else:
+            run += 1
+    return gaps, longest
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Uplink redundancy simulator')
+    parser.add_argument('--frames', type=int, default=100000)
+    parser.add_argument('--frame-duration', type=int, default=60, help='Opus frame duration in ms')
+    parser.add_argument('--burst', type=float, default=2.0, help='Mean burst length in packets for bursty loss')
+    parser.add_argument('--long-gap', type=int, default=2, help='Gaps of at least this many frames are counted')
+    parser.add_argument('--seed', type=int, default=1)
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    print(f"{'model':<8}{'loss':>6}{'redundancy':>12}{'frames lost':>13}{'long gaps/min':>15}{'longest ms':>12}")
+    for model in ('random', 'burst'):
+        for loss in (0.05, 0.10, 0.15, 0.20):
+            if model == 'random':
+                lost = random_losses(args.frames, loss, rng)
+            else:
+                lost = burst_losses(args.frames, loss, args.burst, rng)
+            for redundancy in (False, True):
+                frames = received_frames(lost, redundancy)
+                missing = frames.count(False) / len(frames)
+                gaps, longest = gap_stats(frames, args.long_gap)
+                minutes = len(frames) * args.frame_duration / 60000
+                print(f"{model:<8}{loss:>6.0%}{'on' if redundancy else 'off':>12}{missing:>13.2%}"
+                      f"{gaps / minutes:>15.1f}{longest * args.frame_duration:>12}")
+
+
+if __name__ == "__main__":
+    main()
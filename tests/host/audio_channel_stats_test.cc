@@ -0,0 +1,87 @@
+// AudioChannelStatsTracker loss, reordering, duplicate and jitter counting
+#include <gtest/gtest.h>
+
+#include "audio_channel_stats.h"
+
+TEST(AudioChannelStatsTest, CountsLoss) {
+    AudioChannelStatsTracker tracker;
+    for (uint32_t sequence : {1, 2, 4, 5, 8}) {
+        tracker.OnPacket(sequence, 0, 0);
+    }
+    auto stats = tracker.Get();
+    EXPECT_EQ(stats.received, 5u);
+    EXPECT_EQ(stats.lost, 3u);
+    EXPECT_EQ(stats.reordered, 0u);
+    EXPECT_EQ(stats.duplicate, 0u);
+}
+
+TEST(AudioChannelStatsTest, LatePacketIsReorderedNotLost) {
+    AudioChannelStatsTracker tracker;
+    for (uint32_t sequence : {1, 3, 4, 2}) {
+        tracker.OnPacket(sequence, 0, 0);
+    }
+    auto stats = tracker.Get();
+    EXPECT_EQ(stats.lost, 0u);
+    EXPECT_EQ(stats.reordered, 1u);
+}
+
+TEST(AudioChannelStatsTest, CountsDuplicates) {
+    AudioChannelStatsTracker tracker;
+    for (uint32_t sequence : {1, 2, 2, 3, 1}) {
+        tracker.OnPacket(sequence, 0, 0);
+    }
+    auto stats = tracker.Get();
+    EXPECT_EQ(stats.received, 5u);
+    EXPECT_EQ(stats.duplicate, 2u);
+    EXPECT_EQ(stats.reordered, 0u);
+    EXPECT_EQ(stats.lost, 0u);
+}
+
+TEST(AudioChannelStatsTest, PacketOutOfWindowDoesNotHideLoss) {
+    AudioChannelStatsTracker tracker;
+    for (uint32_t sequence = 1; sequence <= 100; sequence++) {
+        if (sequence != 50) {
+            tracker.OnPacket(sequence, 0, 0);
+        }
+    }
+    // A duplicate of 10, far behind the highest sequence number
+    tracker.OnPacket(10, 0, 0);
+    auto stats = tracker.Get();
+    EXPECT_EQ(stats.lost, 1u);
+    EXPECT_EQ(stats.reordered, 1u);
+}
+
+TEST(AudioChannelStatsTest, JitterOfAlternatingDelay) {
+    AudioChannelStatsTracker tracker;
+    // Every other packet takes 16 ms longer, the jitter converges to 16 ms
+    for (uint32_t i = 0; i < 500; i++) {
+        uint32_t timestamp = 1000 + i * 60;
+        tracker.OnPacket(i + 1, timestamp, 5000 + timestamp + (i % 2) * 16);
+    }
+    EXPECT_NEAR(tracker.Get().jitter_ms, 16, 1);
+
+    tracker.Reset();
+    for (uint32_t i = 0; i < 500; i++) {
+        uint32_t timestamp = 1000 + i * 60;
+        tracker.OnPacket(i + 1, timestamp, 5000 + timestamp);
+    }
+    EXPECT_EQ(tracker.Get().jitter_ms, 0u);
+}
+
+TEST(AudioChannelStatsTest, BatchFramesShareOneArrival) {
+    AudioChannelStatsTracker tracker;
+    // Batches of three 60 ms frames sent when the last one is encoded. The protocol passes the timestamp
+    // of the first frame only, the others arrived with it and say nothing about the network.
+    uint32_t sequence = 1;
+    for (uint32_t batch = 0; batch < 20; batch++) {
+        uint32_t arrival = 5000 + batch * 180 + 120;
+        for (uint32_t i = 0; i < 3; i++, sequence++) {
+            uint32_t timestamp = 1000 + (sequence - 1) * 60;
+            tracker.OnPacket(sequence, i == 0 ? timestamp : 0, arrival);
+        }
+    }
+    auto stats = tracker.Get();
+    EXPECT_EQ(stats.received, 60u);
+    EXPECT_EQ(stats.lost, 0u);
+    EXPECT_EQ(stats.jitter_ms, 0u);
+}
@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "audio_pipeline_stats.h"
+
+TEST(LatencyRecorder, BucketsAreContiguous) {
+    EXPECT_EQ(LatencyRecorder::BucketIndex(0), 0);
+    int previous = 0;
+    for (uint32_t us = 1; us < (1u << AUDIO_LATENCY_MAX_BITS); us += 1 + us / 64) {
+        int index = LatencyRecorder::BucketIndex(us);
+        ASSERT_GE(index, previous);
+        ASSERT_LE(index, previous + 1);
+        ASSERT_LE(us, LatencyRecorder::BucketUpperBound(index));
+        if (index > 0) {
+            ASSERT_GT(us, LatencyRecorder::BucketUpperBound(index - 1));
+        }
+        previous = index;
+    }
+    EXPECT_EQ(LatencyRecorder::BucketIndex(0xffffffff), AUDIO_LATENCY_BUCKETS - 1);
+}
+
+TEST(LatencyRecorder, EmptyRecorder) {
+    LatencyRecorder recorder;
+    EXPECT_EQ(recorder.count(), 0u);
+    EXPECT_EQ(recorder.Percentile(50), 0u);
+    EXPECT_EQ(recorder.max(), 0u);
+}
+
+// A 10 s interval at 50 frames per second, every sample has to count
+TEST(LatencyRecorder, PercentilesCoverWholeInterval) {
+    std::mt19937 random(1);
+    std::lognormal_distribution<double> distribution(9.0, 0.6);
+    std::vector<uint32_t> samples(500);
+    LatencyRecorder recorder;
+    for (auto& sample : samples) {
+        sample = (uint32_t)distribution(random);
+        recorder.Add(sample);
+    }
+    // A slow frame at the start of the interval is still seen
+    recorder.Add(250000);
+    samples.push_back(250000);
+    std::sort(samples.begin(), samples.end());
+
+    EXPECT_EQ(recorder.count(), samples.size());
+    EXPECT_EQ(recorder.max(), 250000u);
+    for (int percent : {50, 90, 99}) {
+        uint32_t exact = samples[(samples.size() * percent + 99) / 100 - 1];
+        uint32_t estimate = recorder.Percentile(percent);
+        EXPECT_GE(estimate, exact) << "p" << percent;
+        EXPECT_LE(estimate, exact + exact / 4) << "p" << percent;
+    }
+    EXPECT_EQ(recorder.Percentile(100), 250000u);
+
+    recorder.Reset();
+    EXPECT_EQ(recorder.count(), 0u);
+    EXPECT_EQ(recorder.Percentile(99), 0u);
+}
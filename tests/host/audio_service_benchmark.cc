@@ -0,0 +1,354 @@
+// Runs the whole AudioService on a host: microphone file -> encode -> send queue -> loopback "server"
+// -> jitter buffer -> decode -> speaker file, and prints the pipeline statistics the firmware prints.
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "audio_service.h"
+#include "file_audio_codec.h"
+#include "host_heap.h"
+#include "host_tasks.h"
+
+#define SAMPLE_RATE 16000
+#define INPUT_DURATION_MS 6000
+
+namespace {
+
+std::string TempPath(const char* name) {
+    return testing::TempDir() + name;
+}
+
+// A tone that changes every frame, so no frame is silent and no two frames are equal
+std::vector<int16_t> MakeInput() {
+    std::vector<int16_t> pcm(SAMPLE_RATE * INPUT_DURATION_MS / 1000);
+    for (size_t i = 0; i < pcm.size(); i++) {
+        double t = (double)i / SAMPLE_RATE;
+        pcm[i] = (int16_t)(8000 * std::sin(2 * M_PI * (300 + 5 * t * 100) * t) + 1000);
+    }
+    return pcm;
+}
+
+void WriteFile(const std::string& path, const std::vector<int16_t>& pcm) {
+    FILE* file = fopen(path.c_str(), "wb");
+    ASSERT_NE(file, nullptr);
+    fwrite(pcm.data(), sizeof(int16_t), pcm.size(), file);
+    fclose(file);
+}
+
+std::vector<int16_t> ReadFile(const std::string& path) {
+    std::vector<int16_t> pcm;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return pcm;
+    }
+    int16_t buffer[1024];
+    size_t read;
+    while ((read = fread(buffer, sizeof(int16_t), 1024, file)) > 0) {
+        pcm.insert(pcm.end(), buffer, buffer + read);
+    }
+    fclose(file);
+    return pcm;
+}
+
+// Echoes every uplink packet back as downlink audio with a transport sequence number, like the UDP channel
+class LoopbackServer {
+public:
+    explicit LoopbackServer(AudioService& audio_service) : audio_service_(audio_service) {
+        thread_ = std::thread([this]() { Run(); });
+    }
+
+    ~LoopbackServer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopped_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    void Notify() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    int packets() const { return packets_; }
+    // Leaves a gap in the sequence numbers before the given packet, as if the one before it was lost
+    void LoseSequenceBefore(int packet) { lose_before_ = packet; }
+    int last_frame_duration() const { return last_frame_duration_; }
+
+private:
+    AudioService& audio_service_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool pending_ = false;
+    bool stopped_ = false;
+    std::atomic<int> packets_{0};
+    std::atomic<int> last_frame_duration_{0};
+    std::atomic<int> lose_before_{-1};
+    uint32_t sequence_ = 0;
+
+    void Run() {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this]() { return pending_ || stopped_; });
+                if (stopped_) {
+                    return;
+                }
+                pending_ = false;
+            }
+            while (auto packet = audio_service_.PopPacketFromSendQueue()) {
+                audio_service_.RecordPacketSent(packet->encoded_time_us);
+                last_frame_duration_ = packet->frame_duration;
+                if (packets_ == lose_before_) {
+                    ++sequence_;
+                }
+                packet->sequence = ++sequence_;
+                audio_service_.PushPacketToDecodeQueue(std::move(packet), true);
+                packets_++;
+            }
+        }
+    }
+};
+
+}  // namespace
+
+class AudioServiceBenchmark : public testing::Test {
+protected:
+    std::vector<int16_t> input_;
+    std::string output_path_;
+    std::unique_ptr<FileAudioCodec> codec_;
+    std::unique_ptr<AudioService> audio_service_;
+    std::unique_ptr<LoopbackServer> server_;
+    HostHeapUsage heap_start_;
+    std::vector<HostTaskStats> task_stats_;
+    int frames_ = 0;
+
+    void SetUp() override {
+        input_ = MakeInput();
+        std::string input_path = TempPath("audio_service_input.pcm");
+        output_path_ = TempPath("audio_service_output.pcm");
+        WriteFile(input_path, input_);
+
+        // The peak heap of the pipeline, from before the codec and the service are created
+        HostHeapResetPeak();
+        heap_start_ = HostHeapGetUsage();
+        codec_ = std::make_unique<FileAudioCodec>(input_path, output_path_, SAMPLE_RATE, SAMPLE_RATE);
+        audio_service_ = std::make_unique<AudioService>();
+        audio_service_->Initialize(codec_.get());
+        server_ = std::make_unique<LoopbackServer>(*audio_service_);
+
+        AudioServiceCallbacks callbacks;
+        callbacks.on_send_queue_available = [this]() { server_->Notify(); };
+        audio_service_->SetCallbacks(callbacks);
+        audio_service_->Start();
+        // Starts the statistics interval, so the final print has frame rates
+        audio_service_->PrintPipelineStats();
+    }
+
+    // Stops the service and returns what the speaker played
+    std::vector<int16_t> Finish() {
+        audio_service_->PrintPipelineStats();
+        auto heap = HostHeapGetUsage();
+        printf("heap: peak %zu bytes above the %zu before the pipeline started, %llu allocations\n",
+            heap.peak_bytes - heap_start_.current_bytes, heap_start_.current_bytes,
+            (unsigned long long)(heap.allocations - heap_start_.allocations));
+        audio_service_->Stop();
+        HostWaitForTasks();
+        // Counted over the whole test, so the idle time before and after the frames adds to them
+        frames_ = std::max(server_->packets(), 1);
+        task_stats_ = HostTakeTaskStats();
+        for (auto& task : task_stats_) {
+            printf("%s: %ld wakeups (%.1f per frame), %ld preemptions, %ld contended locks\n", task.name.c_str(),
+                task.wakeups, (double)task.wakeups / frames_, task.preemptions, task.contended_locks);
+        }
+        server_.reset();
+        audio_service_.reset();
+        codec_.reset();
+        return ReadFile(output_path_);
+    }
+
+    void WaitForInput(int64_t timeout_ms) {
+        int64_t start_us = esp_timer_get_time();
+        while (!codec_->input_finished() && esp_timer_get_time() - start_us < timeout_ms * 1000) {
+            vTaskDelay(pdMS_TO_TICKS(100));
+        }
+    }
+
+    void WaitForIdle(int64_t timeout_ms) {
+        int64_t start_us = esp_timer_get_time();
+        while (!audio_service_->IsIdle() && esp_timer_get_time() - start_us < timeout_ms * 1000) {
+            vTaskDelay(pdMS_TO_TICKS(100));
+        }
+        // The last frame is still being written
+        vTaskDelay(pdMS_TO_TICKS(200));
+    }
+
+
+    struct OutputCheck {
+        int concealed_frames = 0;   // Extrapolated from the previous frame, see the host OpusDecoderWrapper
+        int silent_gaps = 0;        // Silent frames between the first and the last input frame
+    };
+
+    // Matches the output against the input frame by frame
+    OutputCheck CheckOutput(const std::vector<int16_t>& output) {
+        const size_t frame_samples = SAMPLE_RATE * OPUS_FRAME_DURATION_MS / 1000;
+        EXPECT_EQ(output.size() % frame_samples, 0u);
+        OutputCheck check;
+        size_t matched = 0;
+        int silent_frames = 0;
+        size_t previous = 0;    // Offset of the last frame played, concealment continues from it
+        for (size_t offset = 0; offset + frame_samples <= output.size(); offset += frame_samples) {
+            auto frame = output.begin() + offset;
+            bool silent = std::all_of(frame, frame + frame_samples, [](int16_t sample) { return sample == 0; });
+            if (silent) {
+                silent_frames++;
+                continue;
+            }
+            bool concealed = matched > 0 && silent_frames == 0 && std::equal(frame, frame + frame_samples,
+                output.begin() + previous, [](int16_t sample, int16_t last) { return sample == last / 2; });
+            previous = offset;
+            if (concealed) {
+                check.concealed_frames++;
+                continue;
+            }
+            if (matched + frame_samples > input_.size()) {
+                break;
+            }
+            if (!std::equal(input_.begin() + matched, input_.begin() + matched + frame_samples, frame)) {
+                ADD_FAILURE() << "frame " << matched / frame_samples << " differs";
+                break;
+            }
+            if (matched > 0) {
+                check.silent_gaps += silent_frames;
+            }
+            silent_frames = 0;
+            matched += frame_samples;
+        }
+        EXPECT_EQ(matched, input_.size() / frame_samples * frame_samples);
+        return check;
+    }
+};
+
+TEST_F(AudioServiceBenchmark, LoopbackIsSampleExact) {
+    audio_service_->EnableVoiceProcessing(true);
+    WaitForInput(INPUT_DURATION_MS + 5000);
+    audio_service_->EnableVoiceProcessing(false);
+    WaitForIdle(5000);
+    // The output is the input, with silence only before and after it
+    auto check = CheckOutput(Finish());
+    EXPECT_EQ(check.concealed_frames, 0);
+    EXPECT_EQ(check.silent_gaps, 0);
+
+    // Every queue wakes only the task that waits on it, a shared notify_all() would wake each codec
+    // task for the pushes and pops of the other queues too
+    EXPECT_EQ(task_stats_.size(), 4u);
+    for (auto& task : task_stats_) {
+        if (task.name == "opus_encode" || task.name == "opus_decode") {
+            EXPECT_LE(task.wakeups, 2 * frames_) << task.name;
+        }
+    }
+}
+
+TEST_F(AudioServiceBenchmark, LostPacketIsConcealedByTheDecoder) {
+    server_->LoseSequenceBefore(20);
+    audio_service_->EnableVoiceProcessing(true);
+    WaitForInput(INPUT_DURATION_MS + 5000);
+    audio_service_->EnableVoiceProcessing(false);
+    WaitForIdle(5000);
+    // Every packet that arrived is played, the missing sequence number is replaced by the decoder's
+    // concealment of the frame before it instead of a hole of silence
+    auto check = CheckOutput(Finish());
+    EXPECT_EQ(check.concealed_frames, 1);
+    EXPECT_EQ(check.silent_gaps, 0);
+}
+
+TEST_F(AudioServiceBenchmark, SteadyStateDoesNotAllocate) {
+    audio_service_->EnableVoiceProcessing(true);
+    // The pools and the queues reach their size in the first frames
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    int packets = server_->packets();
+    auto heap = HostHeapGetUsage();
+    vTaskDelay(pdMS_TO_TICKS(3000));
+    auto allocations = HostHeapGetUsage().allocations - heap.allocations;
+    int frames = server_->packets() - packets;
+    printf("steady state: %llu allocations in %d frames, %.2f per frame\n", (unsigned long long)allocations, frames,
+        (double)allocations / std::max(frames, 1));
+    // Every frame and packet goes up and down the pipeline in buffers recycled through the pools. What is
+    // left are the blocks of the std::deque queues, one per 32 to 128 entries of each queue.
+    EXPECT_GE(frames, 2000 / OPUS_FRAME_DURATION_MS);
+    EXPECT_LE(allocations, (uint64_t)frames / 5);
+
+    audio_service_->EnableVoiceProcessing(false);
+    WaitForIdle(5000);
+    Finish();
+}
+
+// Frames held while the channel opens are sent in one burst, which must not look like a congested network
+TEST_F(AudioServiceBenchmark, PrerollKeepsFrameDuration) {
+    audio_service_->SetUplinkAudioParams(OPUS_FRAME_DURATION_MS, 0, true);
+    audio_service_->StartPreroll();
+    // Longer than FRAME_DURATION_UP_QUEUE_MS, like a slow connect
+    vTaskDelay(pdMS_TO_TICKS(1500));
+    EXPECT_TRUE(audio_service_->IsPrerolling());
+    EXPECT_EQ(server_->packets(), 0);
+    audio_service_->FinishPreroll();
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    EXPECT_GE(server_->packets(), 1500 / OPUS_FRAME_DURATION_MS);
+
+    // The next utterance adapts to what the last one queued
+    audio_service_->EnableVoiceProcessing(false);
+    audio_service_->EnableVoiceProcessing(true);
+    vTaskDelay(pdMS_TO_TICKS(500));
+    audio_service_->EnableVoiceProcessing(false);
+    EXPECT_EQ(server_->last_frame_duration(), OPUS_FRAME_DURATION_MS);
+    WaitForIdle(5000);
+    Finish();
+}
+
+// Boards with an AEC reference read interleaved microphone and reference samples at the codec rate, which
+// ReadAudioData resamples to 16 kHz channel by channel
+TEST(AudioServiceInputTest, StereoResampleDoesNotAllocate) {
+    const int input_sample_rate = 48000;
+    const int frame_samples = SAMPLE_RATE * OPUS_FRAME_DURATION_MS / 1000;
+    std::vector<int16_t> input(input_sample_rate * 2 * 2);
+    for (size_t i = 0; i < input.size(); i += 2) {
+        input[i] = (int16_t)(8000 * std::sin(2 * M_PI * 440 * i / 2 / input_sample_rate));
+        input[i + 1] = (int16_t)(4000 * std::sin(2 * M_PI * 300 * i / 2 / input_sample_rate));
+    }
+    std::string input_path = TempPath("audio_service_stereo_input.pcm");
+    WriteFile(input_path, input);
+
+    FileAudioCodec codec(input_path, TempPath("audio_service_stereo_output.pcm"), input_sample_rate, SAMPLE_RATE, 2);
+    AudioService audio_service;
+    audio_service.Initialize(&codec);
+
+    // The scratch buffers and the output grow on the first frame
+    std::vector<int16_t> data;
+    for (int i = 0; i < 5; i++) {
+        ASSERT_TRUE(audio_service.ReadAudioData(data, SAMPLE_RATE, frame_samples));
+    }
+    const int frames = 20;
+    auto heap = HostHeapGetUsage();
+    for (int i = 0; i < frames; i++) {
+        ASSERT_TRUE(audio_service.ReadAudioData(data, SAMPLE_RATE, frame_samples));
+    }
+    auto allocations = HostHeapGetUsage().allocations - heap.allocations;
+    printf("stereo %d Hz input: %llu allocations in %d frames\n", input_sample_rate,
+        (unsigned long long)allocations, frames);
+    EXPECT_EQ(data.size(), (size_t)frame_samples * 2);
+    EXPECT_EQ(allocations, 0u);
+    audio_service.Stop();
+}
@@ -0,0 +1,60 @@
+// memcpy() and memmove() of the executable, they count and forward to the C library
+#include "copy_counter.h"
+
+#include <dlfcn.h>
+
+namespace {
+
+typedef void* (*CopyFunction)(void* destination, const void* source, size_t size);
+
+thread_local bool counting = false;
+thread_local size_t copied = 0;
+CopyFunction libc_memcpy = nullptr;
+CopyFunction libc_memmove = nullptr;
+
+// Until dlsym() has found the C library, which may itself copy
+void* CopyBytes(void* destination, const void* source, size_t size) {
+    auto to = (volatile char*)destination;
+    auto from = (const volatile char*)source;
+    if (to < from) {
+        for (size_t i = 0; i < size; i++) {
+            to[i] = from[i];
+        }
+    } else {
+        for (size_t i = size; i > 0; i--) {
+            to[i - 1] = from[i - 1];
+        }
+    }
+    return destination;
+}
+
+__attribute__((constructor)) void FindLibc() {
+    libc_memmove = (CopyFunction)dlsym(RTLD_NEXT, "memmove");
+    libc_memcpy = (CopyFunction)dlsym(RTLD_NEXT, "memcpy");
+}
+
+} // namespace
+
+extern "C" void* memcpy(void* destination, const void* source, size_t size) {
+    if (counting) {
+        copied += size;
+    }
+    return libc_memcpy ? libc_memcpy(destination, source, size) : CopyBytes(destination, source, size);
+}
+
+extern "C" void* memmove(void* destination, const void* source, size_t size) {
+    if (counting) {
+        copied += size;
+    }
+    return libc_memmove ? libc_memmove(destination, source, size) : CopyBytes(destination, source, size);
+}
+
+void StartCountingCopies() {
+    copied = 0;
+    counting = true;
+}
+
+size_t StopCountingCopies() {
+    counting = false;
+    return copied;
+}
@@ -0,0 +1,14 @@
+#ifndef _COPY_COUNTER_H
+#define _COPY_COUNTER_H
+
+#include <cstddef>
+
+/*
+ * Counts the bytes memcpy() and memmove() copy on the calling thread, libstdc++ included. Copies of a
+ * constant size the compiler expands inline are not seen, build with -D_FORTIFY_SOURCE=0 so the others
+ * are not routed to __memcpy_chk.
+ */
+void StartCountingCopies();
+size_t StopCountingCopies();
+
+#endif // _COPY_COUNTER_H
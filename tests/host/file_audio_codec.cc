@@ -0,0 +1,97 @@
+#include "file_audio_codec.h"
+
+#include <esp_timer.h>
+#include <esp_log.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#define TAG "FileAudioCodec"
+
+FileAudioCodec::FileAudioCodec(const std::string& input_path, const std::string& output_path,
+    int input_sample_rate, int output_sample_rate, int input_channels) {
+    duplex_ = true;
+    input_reference_ = input_channels == 2;
+    input_channels_ = input_channels;
+    input_sample_rate_ = input_sample_rate;
+    output_sample_rate_ = output_sample_rate;
+
+    input_file_ = fopen(input_path.c_str(), "rb");
+    if (input_file_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to open %s", input_path.c_str());
+        input_finished_ = true;
+    }
+    output_file_ = fopen(output_path.c_str(), "wb");
+    if (output_file_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to open %s", output_path.c_str());
+    }
+}
+
+FileAudioCodec::~FileAudioCodec() {
+    if (input_file_ != nullptr) {
+        fclose(input_file_);
+    }
+    if (output_file_ != nullptr) {
+        fclose(output_file_);
+    }
+}
+
+bool FileAudioCodec::input_finished() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return input_finished_;
+}
+
+size_t FileAudioCodec::output_samples() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return output_samples_;
+}
+
+// Sleeps until the given number of samples has been clocked out since start_us
+static void WaitForSamples(int64_t start_us, size_t samples, int sample_rate) {
+    int64_t due_us = start_us + (int64_t)samples * 1000000 / sample_rate;
+    int64_t wait_us = due_us - esp_timer_get_time();
+    if (wait_us > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(wait_us));
+    }
+}
+
+int FileAudioCodec::Read(int16_t* dest, int samples) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (input_start_us_ == 0) {
+        input_start_us_ = esp_timer_get_time();
+    }
+    size_t read = 0;
+    if (!input_finished_) {
+        read = fread(dest, sizeof(int16_t), samples, input_file_);
+        input_finished_ = read < (size_t)samples;
+    }
+    std::fill(dest + read, dest + samples, 0);
+    input_samples_ += samples;
+    int64_t start_us = input_start_us_;
+    size_t total = input_samples_;
+    lock.unlock();
+
+    WaitForSamples(start_us, total / input_channels_, input_sample_rate_);
+    return samples;
+}
+
+int FileAudioCodec::Write(const int16_t* data, int samples) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // Playback restarts after the speaker ran dry, like the DMA buffer draining
+    int64_t now = esp_timer_get_time();
+    int64_t played_us = output_start_us_ + (int64_t)output_samples_ * 1000000 / output_sample_rate_;
+    if (output_start_us_ == 0 || played_us < now) {
+        output_start_us_ = now - (int64_t)output_samples_ * 1000000 / output_sample_rate_;
+    }
+    if (output_file_ != nullptr) {
+        fwrite(data, sizeof(int16_t), samples, output_file_);
+    }
+    output_samples_ += samples;
+    int64_t start_us = output_start_us_;
+    size_t total = output_samples_;
+    lock.unlock();
+
+    // The write returns once the DMA buffer has room again, which is a frame before the data is played
+    WaitForSamples(start_us, total - std::min<size_t>(total, samples), output_sample_rate_);
+    return samples;
+}
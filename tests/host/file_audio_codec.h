@@ -0,0 +1,41 @@
+#ifndef _FILE_AUDIO_CODEC_H
+#define _FILE_AUDIO_CODEC_H
+
+#include "audio_codec.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+/*
+ * DummyAudioCodec backed by files: the microphone reads raw 16-bit PCM from input_path, the speaker
+ * appends to output_path. Reads and writes block like I2S DMA would, one sample period per sample,
+ * so the audio tasks run at their real rate. After the end of the input the microphone returns silence.
+ * With two input channels the file holds interleaved microphone and reference samples, like a board with
+ * an AEC reference.
+ */
+class FileAudioCodec : public AudioCodec {
+public:
+    FileAudioCodec(const std::string& input_path, const std::string& output_path, int input_sample_rate,
+        int output_sample_rate, int input_channels = 1);
+    virtual ~FileAudioCodec();
+
+    bool input_finished();
+    size_t output_samples();
+
+private:
+    FILE* input_file_ = nullptr;
+    FILE* output_file_ = nullptr;
+    std::mutex mutex_;
+    bool input_finished_ = false;
+    size_t input_samples_ = 0;
+    size_t output_samples_ = 0;
+    int64_t input_start_us_ = 0;
+    int64_t output_start_us_ = 0;
+
+    virtual int Read(int16_t* dest, int samples) override;
+    virtual int Write(const int16_t* data, int samples) override;
+};
+
+#endif // _FILE_AUDIO_CODEC_H
@@ -0,0 +1,100 @@
+// gifdec_lut.h against the scalar loops of gifdec.c, which are the reference output
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "gifdec_lut.h"
+
+namespace {
+
+// The #else branch of dispose() in gifdec.c
+void FillBackground(uint8_t* canvas, int i, int fw, int fh, int width, const uint8_t* bgcolor, uint8_t opa) {
+    for (int j = 0; j < fh; j++) {
+        for (int k = 0; k < fw; k++) {
+            canvas[(i + k) * 4 + 0] = bgcolor[2];
+            canvas[(i + k) * 4 + 1] = bgcolor[1];
+            canvas[(i + k) * 4 + 2] = bgcolor[0];
+            canvas[(i + k) * 4 + 3] = opa;
+        }
+        i += width;
+    }
+}
+
+// The #else branch of render_frame_rect() in gifdec.c
+void RenderFrame(uint8_t* buffer, int fx, int fy, int fw, int fh, int width, const uint8_t* frame,
+    const uint8_t* colors, bool transparency, uint8_t tindex) {
+    int i = fy * width + fx;
+    for (int j = 0; j < fh; j++) {
+        for (int k = 0; k < fw; k++) {
+            uint8_t index = frame[(fy + j) * width + fx + k];
+            const uint8_t* color = &colors[index * 3];
+            if (!transparency || index != tindex) {
+                buffer[(i + k) * 4 + 0] = color[2];
+                buffer[(i + k) * 4 + 1] = color[1];
+                buffer[(i + k) * 4 + 2] = color[0];
+                buffer[(i + k) * 4 + 3] = 0xFF;
+            }
+        }
+        i += width;
+    }
+}
+
+}  // namespace
+
+// The initial fill in gd_open_gif() covers the whole canvas, also when width * height does not fit 16 bits
+TEST(GifdecLut, FullCanvasFill) {
+    uint8_t bgcolor[3] = {0x12, 0x34, 0x56};
+    for (auto size : {std::make_pair(256, 256), std::make_pair(320, 240), std::make_pair(480, 480)}) {
+        int width = size.first;
+        int height = size.second;
+        std::vector<uint32_t> expected(width * height, 0xdeadbeef);
+        std::vector<uint32_t> actual(expected);
+        FillBackground((uint8_t*)expected.data(), 0, width, height, width, bgcolor, 0x00);
+        GIFDEC_FILL_BG((uint8_t*)actual.data(), width, height, width, bgcolor, 0x00);
+        ASSERT_EQ(0, memcmp(expected.data(), actual.data(), expected.size() * 4)) << width << "x" << height;
+        EXPECT_EQ(actual.back(), 0x00123456u);
+    }
+}
+
+// Random canvases, frame rects, palettes and transparent indexes
+TEST(GifdecLut, BitExactWithScalarLoops) {
+    std::mt19937 random(1);
+    for (int iteration = 0; iteration < 2000; iteration++) {
+        int width = 1 + random() % 97;
+        int height = 1 + random() % 61;
+        int fx = random() % width;
+        int fy = random() % height;
+        int fw = random() % (width - fx + 1);
+        int fh = random() % (height - fy + 1);
+
+        std::vector<uint32_t> expected(width * height);
+        std::vector<uint8_t> frame(width * height);
+        uint8_t colors[256 * 3];
+        for (auto& pixel : expected) {
+            pixel = random();
+        }
+        std::vector<uint32_t> actual(expected);
+        // Fewer distinct indexes in some frames, so the transparent index actually shows up
+        int indexes = 1 + random() % 256;
+        for (auto& index : frame) {
+            index = random() % indexes;
+        }
+        for (auto& color : colors) {
+            color = random();
+        }
+        bool transparency = random() % 2;
+        uint8_t tindex = random() % indexes;
+        uint8_t opa = random();
+
+        int i = fy * width + fx;
+        if (iteration % 2) {
+            FillBackground((uint8_t*)expected.data(), i, fw, fh, width, &colors[tindex * 3], opa);
+            GIFDEC_FILL_BG((uint8_t*)&actual[i], fw, fh, width, &colors[tindex * 3], opa);
+        }
+        RenderFrame((uint8_t*)expected.data(), fx, fy, fw, fh, width, frame.data(), colors, transparency, tindex);
+        GIFDEC_RENDER_FRAME((uint8_t*)&actual[i], fw, fh, width, &frame[i], colors, transparency ? tindex : 0x100);
+        ASSERT_EQ(expected, actual) << "iteration " << iteration;
+    }
+}
@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+
+#include "jitter_buffer.h"
+
+namespace {
+
+class JitterBufferTest : public testing::Test {
+protected:
+    AudioBufferPool<AudioStreamPacket> pool_{8};
+    JitterBuffer buffer_{pool_};
+
+    void Push(uint32_t sequence, int64_t now_us, uint32_t timestamp = 0) {
+        auto packet = pool_.Acquire();
+        packet->sample_rate = 16000;
+        packet->frame_duration = 60;
+        packet->timestamp = timestamp;
+        packet->sequence = sequence;
+        packet->payload.assign(4, (uint8_t)sequence);
+        buffer_.Push(std::move(packet), now_us);
+    }
+
+    // Returns the sequence number of the next packet, 0 if none is due, -1 for a concealed frame
+    int64_t Pop(int64_t now_us) {
+        auto packet = buffer_.Pop(now_us);
+        if (!packet) {
+            return 0;
+        }
+        int64_t sequence = packet->payload.empty() ? -1 : (int64_t)packet->sequence;
+        pool_.Release(std::move(packet));
+        return sequence;
+    }
+};
+
+}  // namespace
+
+TEST_F(JitterBufferTest, HoldsTargetDelayBeforePlaying) {
+    Push(1, 0);
+    EXPECT_EQ(Pop(0), 0);
+    EXPECT_EQ(buffer_.WaitTime(0), JITTER_BUFFER_MIN_DELAY_MS * 1000);
+    EXPECT_EQ(Pop(JITTER_BUFFER_MIN_DELAY_MS * 1000), 1);
+    EXPECT_TRUE(buffer_.playing());
+    EXPECT_TRUE(buffer_.empty());
+}
+
+TEST_F(JitterBufferTest, ReordersPackets) {
+    Push(1, 0);
+    Push(3, 1000);
+    Push(2, 2000);
+    EXPECT_EQ(buffer_.duration_ms(), 180);
+    // A burst covering the target delay plays right away
+    EXPECT_EQ(Pop(2000), 1);
+    EXPECT_EQ(Pop(2000), 2);
+    EXPECT_EQ(Pop(2000), 3);
+}
+
+TEST_F(JitterBufferTest, ConcealsShortGapsWithEmptyPackets) {
+    Push(1, 0);
+    EXPECT_EQ(Pop(100000), 1);
+    Push(3, 120000);
+    // Packet 2 gets the target delay to arrive, then one empty frame stands in for it
+    EXPECT_EQ(Pop(120000), 0);
+    EXPECT_EQ(Pop(120000 + JITTER_BUFFER_MIN_DELAY_MS * 1000), -1);
+    EXPECT_EQ(Pop(120000 + JITTER_BUFFER_MIN_DELAY_MS * 1000), 3);
+}
+
+TEST_F(JitterBufferTest, SkipsLongGaps) {
+    Push(1, 0);
+    EXPECT_EQ(Pop(100000), 1);
+    // Arrives on time for its sequence number, so the jitter stays at zero
+    int64_t arrival_us = (2 + JITTER_BUFFER_MAX_CONCEALED_FRAMES) * 60000;
+    Push(3 + JITTER_BUFFER_MAX_CONCEALED_FRAMES, arrival_us);
+    EXPECT_EQ(Pop(arrival_us), 0);
+    EXPECT_EQ(Pop(arrival_us + JITTER_BUFFER_MIN_DELAY_MS * 1000), 3 + JITTER_BUFFER_MAX_CONCEALED_FRAMES);
+    EXPECT_TRUE(buffer_.empty());
+}
+
+TEST_F(JitterBufferTest, DropsLatePackets) {
+    Push(1, 0);
+    Push(2, 0);
+    Push(3, 0);
+    EXPECT_EQ(Pop(100000), 1);
+    EXPECT_EQ(Pop(100000), 2);
+    Push(1, 110000);
+    EXPECT_EQ(buffer_.size(), 1u);
+    EXPECT_EQ(Pop(110000), 3);
+}
+
+TEST_F(JitterBufferTest, RebufferWaitsForTargetDelayAgain) {
+    Push(1, 0);
+    EXPECT_EQ(Pop(100000), 1);
+    buffer_.Rebuffer();
+    EXPECT_FALSE(buffer_.playing());
+    Push(2, 60000);
+    EXPECT_EQ(Pop(60000), 0);
+    EXPECT_EQ(Pop(60000 + JITTER_BUFFER_MIN_DELAY_MS * 1000), 2);
+}
+
+TEST_F(JitterBufferTest, TimestampsAreTheMediaClock) {
+    // The server paused 600 ms between sentences without skipping sequence numbers
+    const uint32_t timestamps[] = {1000, 1060, 1720, 1780};
+    for (uint32_t i = 0; i < 4; i++) {
+        int64_t arrival_us = (int64_t)timestamps[i] * 1000;
+        Push(i + 1, arrival_us, timestamps[i]);
+        EXPECT_EQ(Pop(arrival_us + 100000), i + 1);
+    }
+    // Arrivals matched the timestamps, so the pause is not jitter
+    buffer_.Rebuffer();
+    Push(5, 1840000, 1840);
+    EXPECT_EQ(buffer_.WaitTime(1840000), JITTER_BUFFER_MIN_DELAY_MS * 1000);
+}
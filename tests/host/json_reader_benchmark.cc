@@ -0,0 +1,159 @@
+// JsonReader against cJSON on the text frames of a server session, one message per line.
+// data/server_session.jsonl is used unless JSON_TRAFFIC names another capture, for example:
+//   JSON_TRAFFIC=capture.jsonl ./json_reader_benchmark
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "cJSON.h"
+#include "json_reader.h"
+
+namespace {
+
+const int kRounds = 2000;
+
+size_t cjson_allocations = 0;
+
+void* CountingMalloc(size_t size) {
+    cjson_allocations++;
+    return malloc(size);
+}
+
+std::vector<std::string> LoadTraffic() {
+    const char* path = getenv("JSON_TRAFFIC");
+    std::ifstream file(path != nullptr ? path : JSON_TRAFFIC_FILE);
+    std::vector<std::string> messages;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty()) {
+            messages.push_back(line);
+        }
+    }
+    return messages;
+}
+
+// The dispatch of Protocol::ParseJsonAsControl(), the result is "<control>:<text>"
+bool ReaderControl(const std::string& message, std::string& control) {
+    JsonReader reader(message.data(), message.size());
+    std::string_view type, value;
+    std::string text;
+    if (!reader.GetString("type", type)) {
+        return false;
+    }
+    if (type == "tts") {
+        if (!reader.GetString("state", value)) {
+            return false;
+        }
+        if (value == "start" || value == "stop") {
+            control = "tts_" + std::string(value) + ":";
+        } else if (value == "sentence_start" && reader.GetString("text", value)) {
+            JsonReader::Unescape(value, text);
+            control = "tts_sentence:" + text;
+        } else {
+            return false;
+        }
+    } else if (type == "stt" && reader.GetString("text", value)) {
+        JsonReader::Unescape(value, text);
+        control = "stt:" + text;
+    } else if (type == "llm" && reader.GetString("emotion", value)) {
+        JsonReader::Unescape(value, text);
+        control = "emotion:" + text;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// The same messages through the cJSON tree, as the application handled them before
+bool CJsonControl(const std::string& message, std::string& control) {
+    cJSON* root = cJSON_ParseWithLength(message.data(), message.size());
+    auto type = cJSON_GetObjectItem(root, "type");
+    auto state = cJSON_GetObjectItem(root, "state");
+    auto text = cJSON_GetObjectItem(root, "text");
+    auto emotion = cJSON_GetObjectItem(root, "emotion");
+    bool handled = true;
+    if (!cJSON_IsString(type)) {
+        handled = false;
+    } else if (strcmp(type->valuestring, "tts") == 0 && cJSON_IsString(state)) {
+        if (strcmp(state->valuestring, "start") == 0 || strcmp(state->valuestring, "stop") == 0) {
+            control = std::string("tts_") + state->valuestring + ":";
+        } else if (strcmp(state->valuestring, "sentence_start") == 0 && cJSON_IsString(text)) {
+            control = std::string("tts_sentence:") + text->valuestring;
+        } else {
+            handled = false;
+        }
+    } else if (strcmp(type->valuestring, "stt") == 0 && cJSON_IsString(text)) {
+        control = std::string("stt:") + text->valuestring;
+    } else if (strcmp(type->valuestring, "llm") == 0 && cJSON_IsString(emotion)) {
+        control = std::string("emotion:") + emotion->valuestring;
+    } else {
+        handled = false;
+    }
+    cJSON_Delete(root);
+    return handled;
+}
+
+} // namespace
+
+TEST(JsonReaderBenchmark, AgreesWithCJson) {
+    auto messages = LoadTraffic();
+    ASSERT_FALSE(messages.empty());
+    int handled = 0;
+    for (auto& message : messages) {
+        std::string reader_control, cjson_control;
+        bool by_reader = ReaderControl(message, reader_control);
+        bool by_cjson = CJsonControl(message, cjson_control);
+        EXPECT_EQ(by_reader, by_cjson) << message;
+        if (by_reader && by_cjson) {
+            EXPECT_EQ(reader_control, cjson_control) << message;
+            handled++;
+        }
+    }
+    printf("%d of %zu messages dispatched without cJSON\n", handled, messages.size());
+}
+
+TEST(JsonReaderBenchmark, Throughput) {
+    auto messages = LoadTraffic();
+    ASSERT_FALSE(messages.empty());
+    cJSON_Hooks hooks = {CountingMalloc, free};
+    cJSON_InitHooks(&hooks);
+
+    // Before: every message is parsed into a cJSON tree
+    std::string control;
+    cjson_allocations = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < kRounds; round++) {
+        for (auto& message : messages) {
+            CJsonControl(message, control);
+        }
+    }
+    auto cjson_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    size_t before_allocations = cjson_allocations;
+
+    // After: JsonReader first, cJSON for the messages it does not handle
+    cjson_allocations = 0;
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < kRounds; round++) {
+        for (auto& message : messages) {
+            if (!ReaderControl(message, control)) {
+                cJSON_Delete(cJSON_ParseWithLength(message.data(), message.size()));
+            }
+        }
+    }
+    auto reader_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    size_t after_allocations = cjson_allocations;
+    cJSON_InitHooks(nullptr);
+
+    double count = (double)kRounds * messages.size();
+    printf("cJSON only:        %7.0f ns/message, %5.1f cJSON allocations/message\n",
+        cjson_ns / count, before_allocations / count);
+    printf("JsonReader first:  %7.0f ns/message, %5.1f cJSON allocations/message\n",
+        reader_ns / count, after_allocations / count);
+    EXPECT_LT(after_allocations, before_allocations);
+}
@@ -0,0 +1,117 @@
+// JsonReader on the incoming message formats of docs/websocket.md, and on what a broken frame looks like
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "json_reader.h"
+
+namespace {
+
+// The value of key, or "(none)" if GetString() fails
+std::string Get(const std::string& json, const char* key) {
+    JsonReader reader(json.data(), json.size());
+    std::string_view value;
+    if (!reader.GetString(key, value)) {
+        return "(none)";
+    }
+    return std::string(value);
+}
+
+std::string Unescape(const char* raw) {
+    std::string output;
+    JsonReader::Unescape(raw, output);
+    return output;
+}
+
+} // namespace
+
+TEST(JsonReaderTest, ReadsStringMembers) {
+    std::string json = R"({"session_id":"abc","type":"tts","state":"sentence_start","text":"你好"})";
+    EXPECT_EQ(Get(json, "type"), "tts");
+    EXPECT_EQ(Get(json, "state"), "sentence_start");
+    EXPECT_EQ(Get(json, "text"), "你好");
+    EXPECT_EQ(Get(json, "emotion"), "(none)");
+    EXPECT_EQ(Get(" \r\n\t{ \"type\" : \"stt\" } \n", "type"), "stt");
+}
+
+TEST(JsonReaderTest, SkipsNestedValues) {
+    std::string json = R"({"type":"mcp","payload":{"jsonrpc":"2.0","params":{"type":"x","list":[1,{"a":"}"},"]"]}},)"
+        R"("n":-1.5e3,"ok":true,"none":null,"list":[],"state":"start"})";
+    EXPECT_EQ(Get(json, "type"), "mcp");
+    // The inner "type" and the brackets inside strings are not mistaken for the outer object
+    EXPECT_EQ(Get(json, "state"), "start");
+}
+
+TEST(JsonReaderTest, NonStringIsNotAString) {
+    EXPECT_EQ(Get(R"({"type":1})", "type"), "(none)");
+    EXPECT_EQ(Get(R"({"type":{"name":"tts"}})", "type"), "(none)");
+    EXPECT_EQ(Get(R"({"type":["tts"]})", "type"), "(none)");
+    EXPECT_EQ(Get(R"({"type":null})", "type"), "(none)");
+}
+
+TEST(JsonReaderTest, FirstOfDuplicateKeys) {
+    EXPECT_EQ(Get(R"({"type":"tts","type":"stt"})", "type"), "tts");
+}
+
+TEST(JsonReaderTest, RejectsTruncatedFrames) {
+    std::string json = R"({"type":"tts","state":"start"})";
+    EXPECT_EQ(Get(json, "type"), "tts");
+    // Every prefix is missing at least the closing brace
+    for (size_t size = 0; size < json.size(); size++) {
+        EXPECT_EQ(Get(json.substr(0, size), "type"), "(none)") << json.substr(0, size);
+    }
+    EXPECT_EQ(Get(R"({"type":"tts","payload":{"a":[1,2)", "type"), "(none)");
+    EXPECT_EQ(Get(R"({"type":"tts","text":"abc\)", "type"), "(none)");
+}
+
+TEST(JsonReaderTest, RejectsMalformedObjects) {
+    for (const char* json : {
+        R"(["type","tts"])",
+        R"("type")",
+        R"({})",
+        R"({"type" "tts"})",
+        R"({"type":"tts" "state":"start"})",
+        R"({"type":"tts",})",
+        R"({"state":,"type":"tts"})",
+        R"({type:"tts"})",
+        R"({"type":"tts"]})",
+    }) {
+        EXPECT_EQ(Get(json, "type"), "(none)") << json;
+    }
+}
+
+TEST(JsonReaderTest, EscapedStringsStayRaw) {
+    std::string json = R"({"text":"say \"hi\" \\","type":"stt"})";
+    EXPECT_EQ(Get(json, "text"), R"(say \"hi\" \\)");
+    EXPECT_EQ(Get(json, "type"), "stt");
+}
+
+TEST(JsonReaderTest, UnescapesSimpleEscapes) {
+    EXPECT_EQ(Unescape(R"(a\"b\\c\/d\be\ff\ng\rh\ti)"), "a\"b\\c/d\be\ff\ng\rh\ti");
+    EXPECT_EQ(Unescape("plain"), "plain");
+    EXPECT_EQ(Unescape(""), "");
+}
+
+TEST(JsonReaderTest, UnescapesUnicode) {
+    EXPECT_EQ(Unescape(R"(\u0041\u00e9\u4F60)"), "Aé你");
+    // U+1F600 as a surrogate pair
+    EXPECT_EQ(Unescape(R"(\ud83d\ude00!)"), "\xF0\x9F\x98\x80!");
+}
+
+TEST(JsonReaderTest, LoneSurrogatesBecomeReplacementCharacter) {
+    const char* replacement = "\xEF\xBF\xBD";
+    EXPECT_EQ(Unescape(R"(\ud83d)"), replacement);
+    EXPECT_EQ(Unescape(R"(\ud83dx)"), std::string(replacement) + "x");
+    EXPECT_EQ(Unescape(R"(\ude00)"), replacement);
+    // A high surrogate followed by another high surrogate
+    EXPECT_EQ(Unescape(R"(\ud83d\ud83d)"), std::string(replacement) + replacement);
+    // A high surrogate followed by an escape that is not \u
+    EXPECT_EQ(Unescape(R"(\ud83d\n)"), std::string(replacement) + "\n");
+}
+
+TEST(JsonReaderTest, BadUnicodeEscapes) {
+    const char* replacement = "\xEF\xBF\xBD";
+    EXPECT_EQ(Unescape(R"(\u12G4)"), std::string(replacement) + "12G4");
+    EXPECT_EQ(Unescape(R"(\u12)"), std::string(replacement) + "12");
+    EXPECT_EQ(Unescape(R"(a\)"), "a\\");
+}
@@ -0,0 +1,207 @@
+// MqttProtocol's UDP audio channel against a server played by the test, with mbedTLS's software AES:
+// packets per second and cycles per packet of the encrypting send and decrypting receive paths.
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "application.h"
+#include "copy_counter.h"
+#include "host_heap.h"
+#include "mqtt_protocol.h"
+#include "protocol_benchmark.h"
+#include "settings.h"
+
+namespace {
+
+const size_t kPayloadSize = PROTOCOL_BENCHMARK_PAYLOAD_SIZE;
+const int kWarmupPackets = 50;
+const int kPackets = 5000;
+
+// Time stamp counter ticks, the nominal clock of the CPU. Elsewhere nanoseconds.
+uint64_t Cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+} // namespace
+
+class MqttProtocolBenchmark : public testing::Test {
+protected:
+    std::unique_ptr<MqttProtocol> protocol_;
+    Udp* udp_ = nullptr;
+    std::thread server_thread_;
+    size_t sent_messages_ = 0;
+    size_t sent_bytes_ = 0;
+    size_t received_packets_ = 0;
+    // The datagrams the device sent while recording, the key is the same both ways
+    bool record_ = false;
+    std::vector<std::string> recorded_;
+    uint64_t cycles_ = 0;
+
+    void TearDown() override {
+        Close();
+    }
+
+    void Close() {
+        protocol_.reset();
+        udp_ = nullptr;
+        Mqtt::server = nullptr;
+        Udp::server = nullptr;
+    }
+
+    void Open(int audio_batch, bool redundancy) {
+        Settings settings("mqtt", true);
+        settings.SetString("endpoint", "broker:8883");
+        settings.SetString("publish_topic", "device-server");
+
+        std::string hello = "{\"type\":\"hello\",\"transport\":\"udp\",\"session_id\":\"benchmark\","
+            "\"audio_params\":{\"sample_rate\":16000,\"frame_duration\":60},"
+            "\"features\":{\"audio_batch\":" + std::to_string(audio_batch) +
+            ",\"redundancy\":" + (redundancy ? "true" : "false") + "},"
+            "\"udp\":{\"server\":\"udp.host\",\"port\":8884,\"key\":\"000102030405060708090a0b0c0d0e0f\","
+            "\"nonce\":\"01000000112233440000000000000000\"}}";
+        Mqtt::server = [this, hello](Mqtt& mqtt, const std::string& topic, const std::string& payload) {
+            if (payload.find("\"type\":\"hello\"") != std::string::npos) {
+                // Answered from another thread like the network task would
+                server_thread_ = std::thread([&mqtt, hello]() {
+                    mqtt.Receive("server-device", hello);
+                });
+            }
+        };
+        Udp::server = [this](Udp& udp, const std::string& data) {
+            udp_ = &udp;
+            sent_messages_++;
+            sent_bytes_ += data.size();
+            if (record_) {
+                recorded_.push_back(data);
+            }
+        };
+
+        protocol_ = std::make_unique<MqttProtocol>();
+        protocol_->OnIncomingAudio([this](std::unique_ptr<AudioStreamPacket> packet) {
+            received_packets_++;
+            Application::GetInstance().GetAudioService().ReleasePacket(std::move(packet));
+        });
+        bool opened = protocol_->OpenAudioChannel();
+        if (server_thread_.joinable()) {
+            server_thread_.join();
+        }
+        ASSERT_TRUE(opened);
+    }
+
+    void SendPackets(int count) {
+        auto& audio_service = Application::GetInstance().GetAudioService();
+        for (int i = 0; i < count; i++) {
+            auto packet = audio_service.AcquirePacket();
+            packet->sample_rate = 16000;
+            packet->frame_duration = OPUS_FRAME_DURATION_MS;
+            packet->timestamp = i * OPUS_FRAME_DURATION_MS;
+            packet->payload.resize(kPayloadSize);
+            protocol_->SendAudio(std::move(packet));
+        }
+    }
+
+    PathCost MeasureSend() {
+        SendPackets(kWarmupPackets);
+        sent_messages_ = 0;
+        sent_bytes_ = 0;
+
+        auto heap = HostHeapGetUsage();
+        StartCountingCopies();
+        auto start = std::chrono::steady_clock::now();
+        uint64_t start_cycles = Cycles();
+        SendPackets(kPackets);
+        cycles_ = Cycles() - start_cycles;
+        auto end = std::chrono::steady_clock::now();
+        size_t copied = StopCountingCopies();
+        auto allocations = HostHeapGetUsage().allocations - heap.allocations;
+
+        return PathCost{(double)allocations / kPackets, (double)copied / kPackets, (double)sent_messages_ / kPackets,
+            (double)sent_bytes_ / kPackets,
+            (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / kPackets};
+    }
+
+    // Replays what the device sent as the server's audio, every datagram decrypts to the same frames
+    PathCost MeasureReceive() {
+        recorded_.clear();
+        record_ = true;
+        SendPackets(kPackets);
+        record_ = false;
+        EXPECT_NE(udp_, nullptr);
+        if (udp_ == nullptr) {
+            return PathCost{};
+        }
+        for (int i = 0; i < kWarmupPackets; i++) {
+            udp_->Receive(recorded_[i]);
+        }
+        received_packets_ = 0;
+
+        size_t bytes = 0;
+        auto heap = HostHeapGetUsage();
+        StartCountingCopies();
+        auto start = std::chrono::steady_clock::now();
+        uint64_t start_cycles = Cycles();
+        for (auto& datagram : recorded_) {
+            udp_->Receive(datagram);
+            bytes += datagram.size();
+        }
+        cycles_ = Cycles() - start_cycles;
+        auto end = std::chrono::steady_clock::now();
+        size_t copied = StopCountingCopies();
+        auto allocations = HostHeapGetUsage().allocations - heap.allocations;
+
+        double packets = received_packets_;
+        return PathCost{allocations / packets, copied / packets, recorded_.size() / packets, bytes / packets,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / packets};
+    }
+
+    void Report(const std::string& path, const PathCost& cost, double packets) {
+        PrintCost(path, cost);
+        printf("%-18s %.0f packets/s, %.0f cycles per packet\n", path.c_str(), 1e9 / cost.ns, cycles_ / packets);
+    }
+};
+
+TEST_F(MqttProtocolBenchmark, Send) {
+    for (int batch : {1, 4}) {
+        Open(batch, false);
+        auto cost = MeasureSend();
+        Report("send batch " + std::to_string(batch), cost, kPackets);
+        // The frame is encrypted straight into a send buffer that keeps its capacity
+        EXPECT_EQ(cost.allocations, 0) << batch;
+        EXPECT_NEAR(cost.messages, 1.0 / batch, 0.01) << batch;
+        Close();
+    }
+}
+
+TEST_F(MqttProtocolBenchmark, SendRedundant) {
+    Open(1, true);
+    auto cost = MeasureSend();
+    Report("send redundant", cost, kPackets);
+    EXPECT_EQ(cost.allocations, 0);
+    EXPECT_EQ(cost.messages, 1);
+}
+
+TEST_F(MqttProtocolBenchmark, Receive) {
+    for (int batch : {1, 4}) {
+        Open(batch, false);
+        auto cost = MeasureReceive();
+        Report("receive batch " + std::to_string(batch), cost, received_packets_);
+        // Decrypted into a pooled packet, or for a batch into a buffer of the channel, and split from there
+        EXPECT_EQ(received_packets_, (size_t)kPackets) << batch;
+        EXPECT_EQ(cost.allocations, 0) << batch;
+        Close();
+    }
+}
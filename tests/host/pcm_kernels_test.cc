@@ -0,0 +1,118 @@
+// pcm_kernels against the scalar loops they replaced in the codecs, AudioService and the processors
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+#include "pcm_kernels.h"
+
+namespace {
+
+// Odd and tiny lengths catch unrolled loops that mishandle the tail
+const size_t kLengths[] = {0, 1, 3, 7, 160, 480, 961};
+
+std::vector<int16_t> RandomSamples(size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> dist(INT16_MIN, INT16_MAX);
+    std::vector<int16_t> samples(count);
+    for (auto& sample : samples) {
+        sample = dist(rng);
+    }
+    // The extremes are where saturation differs
+    if (count >= 3) {
+        samples[0] = INT16_MIN;
+        samples[1] = INT16_MAX;
+        samples[2] = 0;
+    }
+    return samples;
+}
+
+int16_t Clamp16(int32_t value) {
+    return (value > INT16_MAX) ? INT16_MAX : (value < -INT16_MAX) ? -INT16_MAX : (int16_t)value;
+}
+
+} // namespace
+
+TEST(PcmKernelsTest, DeinterleaveAndInterleave) {
+    for (size_t frames : kLengths) {
+        auto data = RandomSamples(frames * 2, frames);
+        std::vector<int16_t> mic(frames), reference(frames);
+        std::vector<int16_t> expected_mic(frames), expected_reference(frames);
+        for (size_t i = 0, j = 0; i < frames; ++i, j += 2) {
+            expected_mic[i] = data[j];
+            expected_reference[i] = data[j + 1];
+        }
+        PcmDeinterleave(data.data(), mic.data(), reference.data(), frames);
+        EXPECT_EQ(mic, expected_mic) << frames;
+        EXPECT_EQ(reference, expected_reference) << frames;
+
+        std::vector<int16_t> interleaved(frames * 2);
+        PcmInterleave(mic.data(), reference.data(), interleaved.data(), frames);
+        EXPECT_EQ(interleaved, data) << frames;
+    }
+}
+
+TEST(PcmKernelsTest, ExtractChannelInPlace) {
+    for (size_t frames : kLengths) {
+        for (int channel = 0; channel < 2; channel++) {
+            auto data = RandomSamples(frames * 2, frames + channel);
+            std::vector<int16_t> expected(frames);
+            for (size_t i = 0, j = channel; i < frames; ++i, j += 2) {
+                expected[i] = data[j];
+            }
+            PcmExtractChannel(data.data(), data.data(), frames, 2, channel);
+            data.resize(frames);
+            EXPECT_EQ(data, expected) << frames << " channel " << channel;
+        }
+    }
+}
+
+TEST(PcmKernelsTest, ApplyGainSaturates) {
+    for (size_t samples : kLengths) {
+        for (int gain : {0, 1, 3, 10, 40}) {
+            auto data = RandomSamples(samples, samples * 100 + gain);
+            std::vector<int16_t> expected(samples);
+            for (size_t i = 0; i < samples; i++) {
+                expected[i] = Clamp16(data[i] * gain);
+            }
+            PcmApplyGain(data.data(), samples, gain);
+            EXPECT_EQ(data, expected) << samples << " gain " << gain;
+        }
+    }
+}
+
+TEST(PcmKernelsTest, ScaleToInt32MatchesInt64Clamp) {
+    for (size_t samples : kLengths) {
+        for (int volume : {0, 1, 50, 70, 99, 100}) {
+            auto data = RandomSamples(samples, samples * 1000 + volume);
+            int32_t factor = volume * volume * 65536 / 10000;
+            std::vector<int32_t> expected(samples), output(samples);
+            for (size_t i = 0; i < samples; i++) {
+                int64_t temp = int64_t(data[i]) * factor;
+                expected[i] = temp > INT32_MAX ? INT32_MAX : temp < INT32_MIN ? INT32_MIN : (int32_t)temp;
+            }
+            PcmScaleToInt32(data.data(), output.data(), samples, factor);
+            EXPECT_EQ(output, expected) << samples << " volume " << volume;
+        }
+    }
+}
+
+TEST(PcmKernelsTest, ShiftToInt16Saturates) {
+    std::mt19937 rng(12);
+    for (size_t samples : kLengths) {
+        std::vector<int32_t> data(samples);
+        for (auto& sample : data) {
+            sample = (int32_t)rng();
+        }
+        if (samples >= 2) {
+            data[0] = INT32_MIN;
+            data[1] = INT32_MAX;
+        }
+        std::vector<int16_t> expected(samples), output(samples);
+        for (size_t i = 0; i < samples; i++) {
+            expected[i] = Clamp16(data[i] >> 12);
+        }
+        PcmShiftToInt16(data.data(), output.data(), samples, 12);
+        EXPECT_EQ(output, expected) << samples;
+    }
+}
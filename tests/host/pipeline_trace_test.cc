@@ -0,0 +1,42 @@
+#include <gtest/gtest.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "host_tasks.h"
+#include "pipeline_trace.h"
+
+// Without the audio debugger the records go to stdout
+static std::string ExportToString() {
+    testing::internal::CaptureStdout();
+    PipelineTrace::GetInstance().Export();
+    return testing::internal::GetCapturedStdout();
+}
+
+TEST(PipelineTrace, ExportsRecordsOfDeletedTasks) {
+    ExportToString();
+    xTaskCreate([](void* arg) {
+        PIPELINE_TRACE(kTraceMicRead, 960);
+        vTaskDelete(NULL);
+    }, "short_lived_task", 2048, nullptr, 5, nullptr);
+    HostWaitForTasks();
+    PIPELINE_TRACE(kTraceStateChange, 3);
+
+    auto output = ExportToString();
+    // Names are cut to configMAX_TASK_NAME_LEN - 1 characters like in FreeRTOS
+    EXPECT_NE(output.find(" 0 short_lived_tas mic_read 960\n"), std::string::npos) << output;
+    EXPECT_NE(output.find(" 0 main state 3\n"), std::string::npos) << output;
+    // Every record is exported once
+    EXPECT_EQ(ExportToString(), "");
+}
+
+TEST(PipelineTrace, CountsOverwrittenRecords) {
+    ExportToString();
+    for (int i = 0; i < CONFIG_PIPELINE_TRACE_EVENTS + 10; i++) {
+        PIPELINE_TRACE(kTraceSend, i);
+    }
+    auto output = ExportToString();
+    EXPECT_NE(output.find("TRACE_DROPPED 10\n"), std::string::npos);
+    EXPECT_EQ(output.find("send 9\n"), std::string::npos);
+    EXPECT_NE(output.find("send 10\n"), std::string::npos);
+}
@@ -0,0 +1,29 @@
+#ifndef _PROTOCOL_BENCHMARK_H
+#define _PROTOCOL_BENCHMARK_H
+
+#include <cstdio>
+#include <string>
+
+#include "audio_service.h"
+
+// About 16 kbit/s of Opus at 60 ms frames
+#define PROTOCOL_BENCHMARK_PAYLOAD_SIZE 120
+
+// What the protocol spends on one audio packet
+struct PathCost {
+    double allocations;
+    double copied_bytes;
+    double messages;
+    double wire_bytes;
+    double ns;
+};
+
+inline void PrintCost(const std::string& path, const PathCost& cost) {
+    const double packets_per_second = 1000.0 / OPUS_FRAME_DURATION_MS;
+    printf("%-18s per packet: %.2f allocations, %.0f bytes copied, %.2f messages, %.0f bytes on the wire, %.0f ns"
+        " | per second: %.1f allocations, %.0f bytes copied\n", path.c_str(), cost.allocations, cost.copied_bytes,
+        cost.messages, cost.wire_bytes, cost.ns, cost.allocations * packets_per_second,
+        cost.copied_bytes * packets_per_second);
+}
+
+#endif // _PROTOCOL_BENCHMARK_H
@@ -0,0 +1,25 @@
+// The part of Application the protocols use. There is no main event loop on the host, scheduled
+// callbacks run on a thread of their own.
+#pragma once
+
+#include <functional>
+#include <thread>
+
+#include "audio_service.h"
+#include "device_state.h"
+
+class Application {
+public:
+    static Application& GetInstance() {
+        static Application instance;
+        return instance;
+    }
+
+    DeviceState GetDeviceState() const { return kDeviceStateIdle; }
+    void Schedule(std::function<void()> callback) { std::thread(std::move(callback)).detach(); }
+    void ScheduleWorker(std::function<void()> callback) { std::thread(std::move(callback)).detach(); }
+    AudioService& GetAudioService() { return audio_service_; }
+
+private:
+    AudioService audio_service_;
+};
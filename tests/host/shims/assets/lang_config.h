@@ -0,0 +1,11 @@
+// The strings the protocols report errors with, scripts/gen_lang.py generates them for the firmware
+#pragma once
+
+namespace Lang {
+    namespace Strings {
+        constexpr const char* SERVER_ERROR = "Server error";
+        constexpr const char* SERVER_NOT_CONNECTED = "Unable to connect to server";
+        constexpr const char* SERVER_NOT_FOUND = "Looking for available service";
+        constexpr const char* SERVER_TIMEOUT = "Waiting for response timeout";
+    }
+}
@@ -0,0 +1,20 @@
+// The audio pipeline only gets its codec passed in, the protocols get the host transports of the network
+#pragma once
+
+#include <string>
+
+#include "network_interface.h"
+
+class Board {
+public:
+    static Board& GetInstance() {
+        static Board instance;
+        return instance;
+    }
+
+    NetworkInterface* GetNetwork() { return &network_; }
+    std::string GetUuid() { return "host"; }
+
+private:
+    NetworkInterface network_;
+};
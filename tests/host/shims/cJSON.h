@@ -0,0 +1,4 @@
+// The protocol headers only pass cJSON pointers around
+#pragma once
+
+typedef struct cJSON cJSON;
@@ -0,0 +1,3 @@
+#pragma once
+
+#include "i2s_std.h"
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "host_heap.h"
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+// One heap for all capabilities
+inline void* heap_caps_malloc(size_t size, uint32_t caps) { return HostHeapAlloc(size); }
+inline void* heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+    void* ptr = HostHeapAlloc(n * size);
+    if (ptr != nullptr) {
+        memset(ptr, 0, n * size);
+    }
+    return ptr;
+}
+inline void heap_caps_free(void* ptr) { HostHeapFree(ptr); }
+inline size_t heap_caps_get_free_size(uint32_t caps) { return HOST_HEAP_SIZE - HostHeapGetUsage().current_bytes; }
+// The host heap does not fragment, the whole free space is one block
+inline size_t heap_caps_get_largest_free_block(uint32_t caps) { return heap_caps_get_free_size(caps); }
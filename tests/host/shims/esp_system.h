@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+
+#include "host_heap.h"
+
+// Against HOST_HEAP_SIZE, see host_heap.h for what is counted
+inline uint32_t esp_get_free_heap_size() { return HOST_HEAP_SIZE - HostHeapGetUsage().current_bytes; }
+inline uint32_t esp_get_minimum_free_heap_size() { return HOST_HEAP_SIZE - HostHeapGetUsage().peak_bytes; }
@@ -0,0 +1,109 @@
+#include <esp_timer.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+struct esp_timer {
+    esp_timer_create_args_t args;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread thread;
+    bool active = false;
+    bool deleted = false;
+    uint64_t period_us = 0;
+    int64_t deadline_us = 0;
+};
+
+static const auto start_time = std::chrono::steady_clock::now();
+
+int64_t esp_timer_get_time() {
+    auto elapsed = std::chrono::steady_clock::now() - start_time;
+    return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+static void TimerThread(esp_timer* timer) {
+    std::unique_lock<std::mutex> lock(timer->mutex);
+    while (!timer->deleted) {
+        if (!timer->active) {
+            timer->cv.wait(lock);
+            continue;
+        }
+        int64_t wait_us = timer->deadline_us - esp_timer_get_time();
+        if (wait_us > 0) {
+            timer->cv.wait_for(lock, std::chrono::microseconds(wait_us));
+            continue;
+        }
+        if (timer->period_us > 0) {
+            timer->deadline_us += timer->period_us;
+            if (timer->args.skip_unhandled_events && timer->deadline_us < esp_timer_get_time()) {
+                timer->deadline_us = esp_timer_get_time() + timer->period_us;
+            }
+        } else {
+            timer->active = false;
+        }
+        lock.unlock();
+        timer->args.callback(timer->args.arg);
+        lock.lock();
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle) {
+    auto timer = new esp_timer();
+    timer->args = *create_args;
+    timer->thread = std::thread(TimerThread, timer);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t StartTimer(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us) {
+    std::lock_guard<std::mutex> lock(timer->mutex);
+    if (timer->active) {
+        return ESP_FAIL;
+    }
+    timer->active = true;
+    timer->period_us = period_us;
+    timer->deadline_us = esp_timer_get_time() + timeout_us;
+    timer->cv.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return StartTimer(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    return StartTimer(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(timer->mutex);
+    if (!timer->active) {
+        return ESP_FAIL;
+    }
+    timer->active = false;
+    timer->cv.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    {
+        std::lock_guard<std::mutex> lock(timer->mutex);
+        timer->deleted = true;
+        timer->cv.notify_all();
+    }
+    // A callback may delete its own timer
+    if (timer->thread.get_id() == std::this_thread::get_id()) {
+        timer->thread.detach();
+        return ESP_OK;
+    }
+    timer->thread.join();
+    delete timer;
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(timer->mutex);
+    return timer->active;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "esp_wn_iface.h"
+
+inline const esp_wn_iface_t* esp_wn_handle_from_name(const char* model_name) { return nullptr; }
@@ -0,0 +1,200 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/event_groups.h>
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "host_tasks.h"
+
+struct HostTask {
+    std::string name;
+    UBaseType_t priority;
+    std::atomic<long> contended_locks{0};
+};
+
+struct HostEventGroup {
+    std::mutex mutex;
+    std::condition_variable cv;
+    EventBits_t bits = 0;
+};
+
+static std::mutex tasks_mutex;
+static std::condition_variable tasks_cv;
+static int running_tasks = 0;
+static std::vector<HostTaskStats> finished_tasks;
+static thread_local HostTask* current_task = nullptr;
+static const auto start_time = std::chrono::steady_clock::now();
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth, void* arg,
+    UBaseType_t priority, TaskHandle_t* out_handle, BaseType_t core_id) {
+    // Tasks are never freed, like the handles kept by the firmware after a task exits
+    auto task = new HostTask{name, priority};
+    if (out_handle != nullptr) {
+        *out_handle = task;
+    }
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        running_tasks++;
+    }
+    std::thread([function, arg, task]() {
+        current_task = task;
+        function(arg);
+        struct rusage usage = {};
+        getrusage(RUSAGE_THREAD, &usage);
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        finished_tasks.push_back({task->name, usage.ru_nvcsw, usage.ru_nivcsw, task->contended_locks});
+        running_tasks--;
+        tasks_cv.notify_all();
+    }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth, void* arg,
+    UBaseType_t priority, TaskHandle_t* out_handle) {
+    return xTaskCreatePinnedToCore(function, name, stack_depth, arg, priority, out_handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+TickType_t xTaskGetTickCount() {
+    auto elapsed = std::chrono::steady_clock::now() - start_time;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() / portTICK_PERIOD_MS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    // Threads not created through the shim, like the test runner, get a task of their own on first use
+    if (current_task == nullptr) {
+        current_task = new HostTask{"main", 1};
+    }
+    return current_task;
+}
+
+char* pcTaskGetName(TaskHandle_t task) {
+    if (task == nullptr) {
+        task = xTaskGetCurrentTaskHandle();
+    }
+    return const_cast<char*>(task->name.c_str());
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    if (task == nullptr) {
+        task = xTaskGetCurrentTaskHandle();
+    }
+    return task->priority;
+}
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority) {
+    if (task == nullptr) {
+        task = xTaskGetCurrentTaskHandle();
+    }
+    task->priority = priority;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    return 0;
+}
+
+BaseType_t xPortGetCoreID() {
+    return 0;
+}
+
+void HostWaitForTasks() {
+    std::unique_lock<std::mutex> lock(tasks_mutex);
+    tasks_cv.wait(lock, []() { return running_tasks == 0; });
+}
+
+std::vector<HostTaskStats> HostTakeTaskStats() {
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    std::vector<HostTaskStats> stats;
+    stats.swap(finished_tasks);
+    return stats;
+}
+
+EventGroupHandle_t xEventGroupCreate() {
+    return new HostEventGroup();
+}
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+    delete group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    group->bits |= bits;
+    group->cv.notify_all();
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    EventBits_t previous = group->bits;
+    group->bits &= ~bits;
+    return previous;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+    BaseType_t wait_for_all, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(group->mutex);
+    auto ready = [&]() {
+        return wait_for_all ? (group->bits & bits) == bits : (group->bits & bits) != 0;
+    };
+    if (ticks == portMAX_DELAY) {
+        group->cv.wait(lock, ready);
+    } else {
+        group->cv.wait_for(lock, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), ready);
+    }
+    EventBits_t result = group->bits;
+    if (ready() && clear_on_exit) {
+        group->bits &= ~bits;
+    }
+    return result;
+}
+
+typedef int (*MutexFunction)(pthread_mutex_t* mutex);
+static MutexFunction libc_mutex_lock = nullptr;
+
+__attribute__((constructor)) static void FindMutexLock() {
+    libc_mutex_lock = (MutexFunction)dlsym(RTLD_NEXT, "pthread_mutex_lock");
+}
+
+// pthread_mutex_lock() of the executable, std::mutex included: a lock another thread holds is counted
+// against the task that has to wait for it
+extern "C" int pthread_mutex_lock(pthread_mutex_t* mutex) {
+    int result = pthread_mutex_trylock(mutex);
+    if (result != EBUSY) {
+        return result;
+    }
+    if (current_task != nullptr) {
+        current_task->contended_locks++;
+    }
+    if (libc_mutex_lock != nullptr) {
+        return libc_mutex_lock(mutex);
+    }
+    // Before the constructor ran
+    while ((result = pthread_mutex_trylock(mutex)) == EBUSY) {
+        sched_yield();
+    }
+    return result;
+}
@@ -0,0 +1,92 @@
+#include "host_heap.h"
+
+#include <malloc.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<size_t> current_bytes{0};
+static std::atomic<size_t> peak_bytes{0};
+static std::atomic<uint64_t> allocations{0};
+
+static void* Count(void* ptr) {
+    if (ptr == nullptr) {
+        return nullptr;
+    }
+    // The usable size, so the free side does not need the requested size
+    size_t current = current_bytes += malloc_usable_size(ptr);
+    size_t peak = peak_bytes.load();
+    while (current > peak && !peak_bytes.compare_exchange_weak(peak, current)) {
+    }
+    allocations++;
+    return ptr;
+}
+
+HostHeapUsage HostHeapGetUsage() {
+    return {current_bytes.load(), peak_bytes.load(), allocations.load()};
+}
+
+void HostHeapResetPeak() {
+    peak_bytes = current_bytes.load();
+}
+
+void* HostHeapAlloc(size_t size) {
+    return Count(malloc(size == 0 ? 1 : size));
+}
+
+void HostHeapFree(void* ptr) {
+    if (ptr != nullptr) {
+        current_bytes -= malloc_usable_size(ptr);
+        free(ptr);
+    }
+}
+
+static void* AlignedAlloc(size_t size, std::align_val_t align) {
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, (size_t)align, size == 0 ? 1 : size) != 0) {
+        return nullptr;
+    }
+    return Count(ptr);
+}
+
+void* operator new(size_t size) {
+    void* ptr = HostHeapAlloc(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return HostHeapAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return HostHeapAlloc(size);
+}
+
+void* operator new(size_t size, std::align_val_t align) {
+    void* ptr = AlignedAlloc(size, align);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size, std::align_val_t align) {
+    return operator new(size, align);
+}
+
+void operator delete(void* ptr) noexcept { HostHeapFree(ptr); }
+void operator delete[](void* ptr) noexcept { HostHeapFree(ptr); }
+void operator delete(void* ptr, size_t) noexcept { HostHeapFree(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { HostHeapFree(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { HostHeapFree(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { HostHeapFree(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { HostHeapFree(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { HostHeapFree(ptr); }
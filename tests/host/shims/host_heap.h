@@ -0,0 +1,22 @@
+// Host only heap accounting, behind esp_get_free_heap_size() and the heap_caps shims.
+// operator new / delete and heap_caps_malloc() are counted, plain malloc() is not.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// The heap the shims report free space against, about what a board with PSRAM has
+#define HOST_HEAP_SIZE (8 * 1024 * 1024)
+
+struct HostHeapUsage {
+    size_t current_bytes;
+    size_t peak_bytes;      // Since the start or the last HostHeapResetPeak()
+    uint64_t allocations;   // Allocations made since the start
+};
+
+HostHeapUsage HostHeapGetUsage();
+// Starts the peak over from the current usage
+void HostHeapResetPeak();
+
+void* HostHeapAlloc(size_t size);
+void HostHeapFree(void* ptr);
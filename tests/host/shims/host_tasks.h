@@ -0,0 +1,17 @@
+// Host only helpers for the FreeRTOS shim
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct HostTaskStats {
+    std::string name;
+    long wakeups;           // Voluntary context switches: waits on a queue, a lock or a timer that ended
+    long preemptions;       // Involuntary context switches
+    long contended_locks;   // pthread_mutex_lock() calls that found the mutex held by another thread
+};
+
+// Waits until every task created with xTaskCreate has returned from its function
+void HostWaitForTasks();
+// The tasks that returned from their function since the last call
+std::vector<HostTaskStats> HostTakeTaskStats();
@@ -0,0 +1,17 @@
+// No speech models on the host, wake word engines fail to initialize
+#pragma once
+
+#include <cstddef>
+
+typedef struct {
+    char** model_name;
+    char** model_info;
+    int num;
+} srmodel_list_t;
+
+#define ESP_WN_PREFIX "wn"
+#define ESP_MN_PREFIX "mn"
+
+inline srmodel_list_t* esp_srmodel_init(const char* partition_label) { return nullptr; }
+inline void esp_srmodel_deinit(srmodel_list_t* models) {}
+inline char* esp_srmodel_filter(srmodel_list_t* models, const char* keyword1, const char* keyword2) { return nullptr; }
@@ -0,0 +1,49 @@
+// An MQTT client without a broker. Publish() goes to the server hook, Receive() delivers a message of
+// the server like the network task would.
+#pragma once
+
+#include <functional>
+#include <string>
+
+class Mqtt {
+public:
+    // Set by the test, called on the publishing thread
+    static inline std::function<void(Mqtt& mqtt, const std::string& topic, const std::string& payload)> server;
+
+    void SetKeepAlive(int seconds) {}
+    bool Connect(const std::string& broker_address, int broker_port, const std::string& client_id,
+        const std::string& username, const std::string& password) {
+        connected_ = true;
+        if (on_connected_) {
+            on_connected_();
+        }
+        return true;
+    }
+    bool IsConnected() const { return connected_; }
+    int GetLastError() const { return 0; }
+
+    bool Publish(const std::string& topic, const std::string& payload, int qos = 0) {
+        if (server) {
+            server(*this, topic, payload);
+        }
+        return connected_;
+    }
+
+    void OnConnected(std::function<void()> callback) { on_connected_ = callback; }
+    void OnDisconnected(std::function<void()> callback) { on_disconnected_ = callback; }
+    void OnMessage(std::function<void(const std::string& topic, const std::string& payload)> callback) {
+        on_message_ = callback;
+    }
+
+    void Receive(const std::string& topic, const std::string& payload) {
+        if (on_message_) {
+            on_message_(topic, payload);
+        }
+    }
+
+private:
+    bool connected_ = false;
+    std::function<void()> on_connected_;
+    std::function<void()> on_disconnected_;
+    std::function<void(const std::string& topic, const std::string& payload)> on_message_;
+};
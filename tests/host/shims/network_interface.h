@@ -0,0 +1,15 @@
+// Transports without a network, the test plays the server through their server hooks
+#pragma once
+
+#include <memory>
+
+#include "mqtt.h"
+#include "udp.h"
+#include "web_socket.h"
+
+class NetworkInterface {
+public:
+    std::unique_ptr<WebSocket> CreateWebSocket(int connect_id) { return std::make_unique<WebSocket>(); }
+    std::unique_ptr<Mqtt> CreateMqtt(int connect_id) { return std::make_unique<Mqtt>(); }
+    std::unique_ptr<Udp> CreateUdp(int connect_id) { return std::make_unique<Udp>(); }
+};
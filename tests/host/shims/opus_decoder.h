@@ -0,0 +1,22 @@
+// Counterpart of the host OpusEncoderWrapper. An empty packet stands in for opus_decode() packet loss
+// concealment: the previous frame at half amplitude, silence if nothing was decoded yet.
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class OpusDecoderWrapper {
+public:
+    OpusDecoderWrapper(int sample_rate, int channels, int duration_ms = 60);
+
+    bool Decode(std::vector<uint8_t>&& opus, std::vector<int16_t>& pcm);
+    void ResetState() {}
+    int sample_rate() const { return sample_rate_; }
+    int duration_ms() const { return duration_ms_; }
+
+private:
+    int sample_rate_;
+    int duration_ms_;
+    int frame_size_;
+    std::vector<int16_t> last_pcm_;
+};
@@ -0,0 +1,26 @@
+// Stands in for the Opus encoder: the "packet" is the PCM frame as little endian bytes, so the pipeline can be
+// checked sample for sample. Timings on the host measure queueing and scheduling, not Opus itself.
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class OpusEncoderWrapper {
+public:
+    OpusEncoderWrapper(int sample_rate, int channels, int duration_ms = 60);
+
+    void SetDtx(bool enable) {}
+    void SetComplexity(int complexity) { complexity_ = complexity; }
+    bool Encode(std::vector<int16_t>&& pcm, std::vector<uint8_t>& opus);
+    void ResetState() {}
+    int sample_rate() const { return sample_rate_; }
+    int duration_ms() const { return duration_ms_; }
+    int complexity() const { return complexity_; }
+
+private:
+    int sample_rate_;
+    int duration_ms_;
+    int frame_size_;
+    int complexity_ = 0;
+};
@@ -0,0 +1,64 @@
+#include <opus_encoder.h>
+#include <opus_decoder.h>
+#include <opus_resampler.h>
+
+#include <cstring>
+
+OpusEncoderWrapper::OpusEncoderWrapper(int sample_rate, int channels, int duration_ms)
+    : sample_rate_(sample_rate), duration_ms_(duration_ms), frame_size_(sample_rate / 1000 * channels * duration_ms) {
+}
+
+bool OpusEncoderWrapper::Encode(std::vector<int16_t>&& pcm, std::vector<uint8_t>& opus) {
+    if ((int)pcm.size() != frame_size_) {
+        return false;
+    }
+    opus.resize(pcm.size() * sizeof(int16_t));
+    memcpy(opus.data(), pcm.data(), opus.size());
+    return true;
+}
+
+OpusDecoderWrapper::OpusDecoderWrapper(int sample_rate, int channels, int duration_ms)
+    : sample_rate_(sample_rate), duration_ms_(duration_ms), frame_size_(sample_rate / 1000 * channels * duration_ms) {
+}
+
+bool OpusDecoderWrapper::Decode(std::vector<uint8_t>&& opus, std::vector<int16_t>& pcm) {
+    if (opus.empty()) {
+        if (last_pcm_.empty()) {
+            pcm.assign(frame_size_, 0);
+            return true;
+        }
+        pcm.resize(last_pcm_.size());
+        for (size_t i = 0; i < pcm.size(); i++) {
+            pcm[i] = last_pcm_[i] / 2;
+        }
+        last_pcm_ = pcm;
+        return true;
+    }
+    if (opus.size() % sizeof(int16_t) != 0) {
+        return false;
+    }
+    pcm.resize(opus.size() / sizeof(int16_t));
+    memcpy(pcm.data(), opus.data(), opus.size());
+    last_pcm_ = pcm;
+    return true;
+}
+
+void OpusResampler::Configure(int input_sample_rate, int output_sample_rate) {
+    input_sample_rate_ = input_sample_rate;
+    output_sample_rate_ = output_sample_rate;
+}
+
+int OpusResampler::GetOutputSamples(int input_samples) const {
+    return (int64_t)input_samples * output_sample_rate_ / input_sample_rate_;
+}
+
+void OpusResampler::Process(const int16_t* input, int input_samples, int16_t* output) {
+    int output_samples = GetOutputSamples(input_samples);
+    for (int i = 0; i < output_samples; i++) {
+        int64_t position = (int64_t)i * input_sample_rate_ * 256 / output_sample_rate_;
+        int index = position / 256;
+        int fraction = position % 256;
+        int next = index + 1 < input_samples ? index + 1 : index;
+        output[i] = (input[index] * (256 - fraction) + input[next] * fraction) / 256;
+    }
+}
@@ -0,0 +1,10 @@
+// Configuration of the host build, the audio pipeline as on a board without AFE
+#pragma once
+
+#define CONFIG_USE_AUDIO_PIPELINE_STATS 1
+#define CONFIG_OPUS_ENCODE_TASK_CORE -1
+#define CONFIG_OPUS_DECODE_TASK_CORE -1
+#define CONFIG_OPUS_ENCODE_TASK_PRIORITY 2
+#define CONFIG_OPUS_DECODE_TASK_PRIORITY 3
+#define CONFIG_FREERTOS_NUMBER_OF_CORES 2
+#define CONFIG_FREERTOS_HZ 1000
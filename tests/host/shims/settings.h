@@ -0,0 +1,54 @@
+// Settings without NVS, kept in memory for the life of the process
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+class Settings {
+public:
+    Settings(const std::string& ns, bool read_write = false) : ns_(ns + ".") {}
+
+    std::string GetString(const std::string& key, const std::string& default_value = "") {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = strings_.find(ns_ + key);
+        return it != strings_.end() ? it->second : default_value;
+    }
+    void SetString(const std::string& key, const std::string& value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        strings_[ns_ + key] = value;
+    }
+    int32_t GetInt(const std::string& key, int32_t default_value = 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = ints_.find(ns_ + key);
+        return it != ints_.end() ? it->second : default_value;
+    }
+    void SetInt(const std::string& key, int32_t value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ints_[ns_ + key] = value;
+    }
+    bool GetBool(const std::string& key, bool default_value = false) { return GetInt(key, default_value) != 0; }
+    void SetBool(const std::string& key, bool value) { SetInt(key, value); }
+    void EraseKey(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        strings_.erase(ns_ + key);
+        ints_.erase(ns_ + key);
+    }
+    void EraseAll() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        EraseNamespace(strings_);
+        EraseNamespace(ints_);
+    }
+
+private:
+    std::string ns_;
+    static inline std::mutex mutex_;
+    static inline std::map<std::string, std::string> strings_;
+    static inline std::map<std::string, int32_t> ints_;
+
+    template <typename Store>
+    void EraseNamespace(Store& store) {
+        store.erase(store.lower_bound(ns_), store.lower_bound(ns_ + '\xff'));
+    }
+};
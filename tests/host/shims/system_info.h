@@ -0,0 +1,9 @@
+// The device identity the protocols send in their headers
+#pragma once
+
+#include <string>
+
+class SystemInfo {
+public:
+    static std::string GetMacAddress() { return "02:00:00:00:00:01"; }
+};
@@ -0,0 +1,31 @@
+// A UDP socket without a network. Send() goes to the server hook, Receive() delivers a datagram of the
+// server like the network task would.
+#pragma once
+
+#include <functional>
+#include <string>
+
+class Udp {
+public:
+    // Set by the test, called on the sending thread
+    static inline std::function<void(Udp& udp, const std::string& data)> server;
+
+    bool Connect(const std::string& host, int port) { return true; }
+    int Send(const std::string& data) {
+        if (server) {
+            server(*this, data);
+        }
+        return data.size();
+    }
+
+    void OnMessage(std::function<void(const std::string& data)> callback) { on_message_ = callback; }
+
+    void Receive(const std::string& data) {
+        if (on_message_) {
+            on_message_(data);
+        }
+    }
+
+private:
+    std::function<void(const std::string& data)> on_message_;
+};
@@ -0,0 +1,43 @@
+// A WebSocket without a network. What the device sends goes to the server hook, Receive() delivers a
+// message of the server like the network task would.
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+class WebSocket {
+public:
+    // Set by the test, called on the sending thread with every message of the device
+    static inline std::function<void(WebSocket& websocket, const char* data, size_t size, bool binary)> server;
+
+    void SetHeader(const char* key, const char* value) {}
+    bool Connect(const char* uri) {
+        connected_ = true;
+        return true;
+    }
+    bool IsConnected() const { return connected_; }
+    int GetLastError() const { return 0; }
+
+    bool Send(const std::string& data) { return Send(data.data(), data.size(), false); }
+    bool Send(const void* data, size_t size, bool binary = false, bool fin = true) {
+        if (server) {
+            server(*this, (const char*)data, size, binary);
+        }
+        return connected_;
+    }
+
+    void OnData(std::function<void(const char* data, size_t size, bool binary)> callback) { on_data_ = callback; }
+    void OnDisconnected(std::function<void()> callback) { on_disconnected_ = callback; }
+
+    void Receive(const char* data, size_t size, bool binary) {
+        if (on_data_) {
+            on_data_(data, size, binary);
+        }
+    }
+
+private:
+    bool connected_ = false;
+    std::function<void(const char* data, size_t size, bool binary)> on_data_;
+    std::function<void()> on_disconnected_;
+};
@@ -0,0 +1,122 @@
+// TaskScheduler ordering, workers and the per call site statistics (CONFIG_USE_SCHEDULE_STATS)
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "task_scheduler.h"
+
+TEST(TaskSchedulerTest, HigherPriorityFirstFifoWithin) {
+    TaskScheduler scheduler;
+    std::vector<std::string> order;
+    scheduler.Push([&]() { order.push_back("background"); }, kTaskPriorityBackground, 0, "test", "a.cc", 1);
+    scheduler.Push([&]() { order.push_back("control 1"); }, kTaskPriorityControl, 0, "test", "a.cc", 2);
+    scheduler.Push([&]() { order.push_back("audio"); }, kTaskPriorityAudio, 0, "test", "a.cc", 3);
+    scheduler.Push([&]() { order.push_back("control 2"); }, kTaskPriorityControl, 0, "test", "a.cc", 4);
+
+    EXPECT_FALSE(scheduler.RunPending());
+    EXPECT_EQ(order, (std::vector<std::string>{"audio", "control 1", "control 2", "background"}));
+}
+
+TEST(TaskSchedulerTest, TasksPushedWhileRunningWaitForNextCall) {
+    TaskScheduler scheduler;
+    int runs = 0;
+    scheduler.Push([&]() {
+        runs++;
+        scheduler.Push([&]() { runs++; }, kTaskPriorityControl, 0, "test", "a.cc", 2);
+    }, kTaskPriorityControl, 0, "test", "a.cc", 1);
+
+    EXPECT_TRUE(scheduler.RunPending());
+    EXPECT_EQ(runs, 1);
+    EXPECT_FALSE(scheduler.RunPending());
+    EXPECT_EQ(runs, 2);
+}
+
+TEST(TaskSchedulerTest, WorkerRunsOffTheCallingThread) {
+    // Workers run forever like the firmware's, so the scheduler must outlive the test
+    auto& scheduler = *new TaskScheduler();
+    EXPECT_FALSE(scheduler.HasWorkers());
+    EXPECT_FALSE(scheduler.PushToWorker([]() {}, "test", "a.cc", 1));
+    scheduler.SetWorkers(1, 1, 4096);
+    ASSERT_TRUE(scheduler.HasWorkers());
+
+    std::promise<std::thread::id> ran_on;
+    scheduler.PushToWorker([&]() { ran_on.set_value(std::this_thread::get_id()); }, "test", "a.cc", 1);
+    auto future = ran_on.get_future();
+    ASSERT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_NE(future.get(), std::this_thread::get_id());
+}
+
+TEST(TaskSchedulerTest, WorkerStartedWhenOthersAreBusy) {
+    auto& scheduler = *new TaskScheduler();
+    scheduler.SetWorkers(2, 1, 4096);
+
+    // The first worker blocks, the second task needs another one to run
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    std::promise<void> second_ran;
+    EXPECT_TRUE(scheduler.PushToWorker([released]() { released.wait(); }, "test", "a.cc", 1));
+    EXPECT_TRUE(scheduler.PushToWorker([&]() { second_ran.set_value(); }, "test", "a.cc", 2));
+    auto future = second_ran.get_future();
+    EXPECT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    release.set_value();
+}
+
+TEST(TaskSchedulerTest, StatsKeyedByFileAndLine) {
+    TaskScheduler scheduler;
+    // Both lambdas report "operator()", only the location tells them apart
+    scheduler.Push([]() {}, kTaskPriorityControl, 0, "operator()", "main/a.cc", 10);
+    scheduler.Push([]() {}, kTaskPriorityControl, 0, "operator()", "main/b.cc", 10);
+    scheduler.Push([]() {}, kTaskPriorityControl, 0, "operator()", "main/b.cc", 10);
+    scheduler.RunPending();
+
+    testing::internal::CaptureStdout();
+    scheduler.PrintStats();
+    auto output = testing::internal::GetCapturedStdout();
+    EXPECT_NE(output.find("operator() (a.cc:10) n=1 "), std::string::npos) << output;
+    EXPECT_NE(output.find("operator() (b.cc:10) n=2 "), std::string::npos) << output;
+}
+
+TEST(TaskSchedulerTest, FullTableKeepsListedSites) {
+    TaskScheduler scheduler;
+    const int sites = SCHEDULE_STATS_MAX_SITES + 6;
+    for (int line = 1; line <= sites; line++) {
+        scheduler.Push([]() {}, kTaskPriorityControl, 0, "caller", "site.cc", line);
+    }
+    scheduler.RunPending();
+
+    testing::internal::CaptureStdout();
+    scheduler.PrintStats();
+    auto output = testing::internal::GetCapturedStdout();
+    for (int line = 1; line <= SCHEDULE_STATS_MAX_SITES; line++) {
+        auto site = "caller (site.cc:" + std::to_string(line) + ") n=1 ";
+        EXPECT_NE(output.find(site), std::string::npos) << site << "\n" << output;
+    }
+    EXPECT_NE(output.find("(other) (:0) n=6 "), std::string::npos) << output;
+
+    // The listed sites are still counted after the overflow
+    scheduler.Push([]() {}, kTaskPriorityControl, 0, "caller", "site.cc", SCHEDULE_STATS_MAX_SITES);
+    scheduler.RunPending();
+    testing::internal::CaptureStdout();
+    scheduler.PrintStats();
+    output = testing::internal::GetCapturedStdout();
+    EXPECT_NE(output.find("caller (site.cc:" + std::to_string(SCHEDULE_STATS_MAX_SITES) + ") n=1 "), std::string::npos)
+        << output;
+    EXPECT_EQ(output.find("(other)"), std::string::npos) << output;
+}
+
+TEST(TaskSchedulerTest, LateStartCountsAsMissed) {
+    TaskScheduler scheduler;
+    scheduler.Push([]() {}, kTaskPriorityAudio, 1, "late", "a.cc", 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    scheduler.RunPending();
+
+    testing::internal::CaptureStdout();
+    scheduler.PrintStats();
+    auto output = testing::internal::GetCapturedStdout();
+    EXPECT_NE(output.find("late (a.cc:1) n=1 "), std::string::npos) << output;
+    EXPECT_NE(output.find("missed=1"), std::string::npos) << output;
+}
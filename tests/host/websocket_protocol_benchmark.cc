@@ -0,0 +1,417 @@
+// WebsocketProtocol against a server played by the test over the host WebSocket: allocations, bytes
+// copied and messages per audio packet on the send and receive paths of each protocol version, and the
+// parse time and heap of the control messages, binary against JSON.
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <cJSON.h>
+
+#include "application.h"
+#include "copy_counter.h"
+#include "host_heap.h"
+#include "protocol_benchmark.h"
+#include "settings.h"
+#include "websocket_protocol.h"
+
+namespace {
+
+const size_t kPayloadSize = PROTOCOL_BENCHMARK_PAYLOAD_SIZE;
+// Enough to fill the packet pool and let the framing buffers reach their size
+const int kWarmupPackets = 50;
+const int kPackets = 5000;
+const int kControlRounds = 1000;
+
+// What handling one control message costs, heap_bytes is the peak above the heap in use before it
+struct ControlCost {
+    double ns;
+    double allocations;
+    double heap_bytes;
+    double wire_bytes;
+};
+
+void PrintControlCost(const std::string& path, const ControlCost& cost) {
+    printf("%-24s per message: %.0f ns, %.2f allocations, %.0f bytes heap, %.0f bytes on the wire\n",
+        path.c_str(), cost.ns, cost.allocations, cost.heap_bytes, cost.wire_bytes);
+}
+
+// The control messages of a spoken reply, as the server sends them in JSON
+const char* const kJsonControl[] = {
+    "{\"session_id\":\"benchmark\",\"type\":\"stt\",\"text\":\"今天天气怎么样\"}",
+    "{\"session_id\":\"benchmark\",\"type\":\"llm\",\"text\":\"😊\",\"emotion\":\"happy\"}",
+    "{\"session_id\":\"benchmark\",\"type\":\"tts\",\"state\":\"start\"}",
+    "{\"session_id\":\"benchmark\",\"type\":\"tts\",\"state\":\"sentence_start\","
+        "\"text\":\"今天北京晴，最高气温二十五度。\"}",
+    "{\"session_id\":\"benchmark\",\"type\":\"tts\",\"state\":\"stop\"}",
+};
+
+// The same messages as binary control messages
+std::vector<std::vector<char>> MakeBinaryControl() {
+    const std::pair<uint8_t, std::string> controls[] = {
+        {kControlStt, "今天天气怎么样"},
+        {kControlEmotion, "happy"},
+        {kControlTtsStart, ""},
+        {kControlTtsSentence, "今天北京晴，最高气温二十五度。"},
+        {kControlTtsStop, ""},
+    };
+    std::vector<std::vector<char>> messages;
+    for (auto& [type, text] : controls) {
+        std::vector<char> message(sizeof(BinaryProtocol3) + 1);
+        message.insert(message.end(), text.begin(), text.end());
+        auto bp3 = (BinaryProtocol3*)message.data();
+        bp3->type = CONTROL_MESSAGE_TYPE;
+        bp3->payload_size = htons(message.size() - sizeof(BinaryProtocol3));
+        bp3->payload[0] = type;
+        messages.push_back(std::move(message));
+    }
+    return messages;
+}
+
+} // namespace
+
+class WebsocketProtocolBenchmark : public testing::Test {
+protected:
+    std::unique_ptr<WebsocketProtocol> protocol_;
+    WebSocket* websocket_ = nullptr;
+    std::thread server_thread_;
+    size_t sent_messages_ = 0;
+    size_t sent_bytes_ = 0;
+    size_t received_packets_ = 0;
+    // The server returns the device's audio messages as they are
+    bool echo_audio_ = false;
+    size_t control_messages_ = 0;
+
+    // cJSON allocates from the heap that is measured, like it does on the device
+    static void SetUpTestSuite() {
+        cJSON_Hooks hooks = {HostHeapAlloc, HostHeapFree};
+        cJSON_InitHooks(&hooks);
+    }
+
+    static void TearDownTestSuite() {
+        cJSON_InitHooks(nullptr);
+    }
+
+    void TearDown() override {
+        Close();
+    }
+
+    void Close() {
+        protocol_.reset();
+        websocket_ = nullptr;
+        echo_audio_ = false;
+        WebSocket::server = nullptr;
+    }
+
+    void Open(int version, int audio_batch, bool binary_control = false) {
+        Settings settings("websocket", true);
+        settings.SetString("url", "ws://host/xiaozhi/v1/");
+        settings.SetInt("version", version);
+
+        std::string hello = "{\"type\":\"hello\",\"transport\":\"websocket\",\"session_id\":\"benchmark\","
+            "\"audio_params\":{\"sample_rate\":16000,\"frame_duration\":60},"
+            "\"features\":{\"audio_batch\":" + std::to_string(audio_batch) +
+            ",\"binary_control\":" + (binary_control ? "true" : "false") + "}}";
+        WebSocket::server = [this, hello](WebSocket& websocket, const char* data, size_t size, bool binary) {
+            if (!binary && std::string_view(data, size).find("\"type\":\"hello\"") != std::string_view::npos) {
+                // Answered from another thread like the network task would, the hello is sent holding the channel lock
+                websocket_ = &websocket;
+                server_thread_ = std::thread([&websocket, hello]() {
+                    websocket.Receive(hello.data(), hello.size(), false);
+                });
+                return;
+            }
+            sent_messages_++;
+            sent_bytes_ += size;
+            if (echo_audio_ && binary) {
+                websocket.Receive(data, size, true);
+            }
+        };
+
+        protocol_ = std::make_unique<WebsocketProtocol>();
+        protocol_->OnIncomingAudio([this](std::unique_ptr<AudioStreamPacket> packet) {
+            received_packets_++;
+            Application::GetInstance().GetAudioService().ReleasePacket(std::move(packet));
+        });
+        bool opened = protocol_->OpenAudioChannel();
+        if (server_thread_.joinable()) {
+            server_thread_.join();
+        }
+        ASSERT_TRUE(opened);
+    }
+
+    // Like the encode task: a pooled packet the encoder wrote the frame into, handed to SendAudio
+    void SendPackets(int count) {
+        auto& audio_service = Application::GetInstance().GetAudioService();
+        for (int i = 0; i < count; i++) {
+            auto packet = audio_service.AcquirePacket();
+            packet->sample_rate = 16000;
+            packet->frame_duration = OPUS_FRAME_DURATION_MS;
+            packet->timestamp = i * OPUS_FRAME_DURATION_MS;
+            packet->payload.resize(kPayloadSize);
+            protocol_->SendAudio(std::move(packet));
+        }
+    }
+
+    PathCost MeasureSend() {
+        SendPackets(kWarmupPackets);
+        sent_messages_ = 0;
+        sent_bytes_ = 0;
+
+        auto heap = HostHeapGetUsage();
+        StartCountingCopies();
+        auto start = std::chrono::steady_clock::now();
+        SendPackets(kPackets);
+        auto end = std::chrono::steady_clock::now();
+        size_t copied = StopCountingCopies();
+        auto allocations = HostHeapGetUsage().allocations - heap.allocations;
+
+        return PathCost{(double)allocations / kPackets, (double)copied / kPackets, (double)sent_messages_ / kPackets,
+            (double)sent_bytes_ / kPackets,
+            (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / kPackets};
+    }
+
+    // A server message with frames_per_message Opus frames, framed as the negotiated version sends them
+    std::vector<char> MakeServerMessage(int version, int frames_per_message) {
+        std::vector<char> message;
+        std::vector<uint8_t> payload(kPayloadSize, 0x5a);
+        if (frames_per_message > 1) {
+            message.resize(sizeof(BinaryProtocol3) + 1);
+            for (int i = 0; i < frames_per_message; i++) {
+                AudioBatchFrame frame = {htonl(i * OPUS_FRAME_DURATION_MS), htons(kPayloadSize)};
+                message.insert(message.end(), (char*)&frame, (char*)&frame + sizeof(frame));
+                message.insert(message.end(), payload.begin(), payload.end());
+            }
+            auto bp3 = (BinaryProtocol3*)message.data();
+            bp3->type = AUDIO_BATCH_MESSAGE_TYPE;
+            bp3->payload_size = htons(message.size() - sizeof(BinaryProtocol3));
+            bp3->payload[0] = frames_per_message;
+        } else if (version == 2) {
+            message.resize(sizeof(BinaryProtocol2));
+            auto bp2 = (BinaryProtocol2*)message.data();
+            bp2->version = htons(2);
+            bp2->payload_size = htonl(kPayloadSize);
+            message.insert(message.end(), payload.begin(), payload.end());
+        } else if (version == 3) {
+            message.resize(sizeof(BinaryProtocol3));
+            auto bp3 = (BinaryProtocol3*)message.data();
+            bp3->payload_size = htons(kPayloadSize);
+            message.insert(message.end(), payload.begin(), payload.end());
+        } else {
+            message.assign(payload.begin(), payload.end());
+        }
+        return message;
+    }
+
+    PathCost MeasureReceive(int version, int frames_per_message) {
+        auto message = MakeServerMessage(version, frames_per_message);
+        int messages = kPackets / frames_per_message;
+        for (int i = 0; i < kWarmupPackets; i++) {
+            websocket_->Receive(message.data(), message.size(), true);
+        }
+        received_packets_ = 0;
+
+        auto heap = HostHeapGetUsage();
+        StartCountingCopies();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < messages; i++) {
+            websocket_->Receive(message.data(), message.size(), true);
+        }
+        auto end = std::chrono::steady_clock::now();
+        size_t copied = StopCountingCopies();
+        auto allocations = HostHeapGetUsage().allocations - heap.allocations;
+
+        EXPECT_EQ(received_packets_, (size_t)messages * frames_per_message);
+        double packets = received_packets_;
+        return PathCost{allocations / packets, copied / packets, messages / packets,
+            messages * message.size() / packets,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / packets};
+    }
+
+    // Receives the messages kControlRounds times: timed in one pass, then one message at a time for the heap
+    ControlCost MeasureIncomingControl(const std::vector<std::vector<char>>& messages, bool binary) {
+        for (auto& message : messages) {
+            websocket_->Receive(message.data(), message.size(), binary);
+        }
+        control_messages_ = 0;
+
+        size_t bytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kControlRounds; i++) {
+            for (auto& message : messages) {
+                websocket_->Receive(message.data(), message.size(), binary);
+                bytes += message.size();
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        uint64_t allocations = 0;
+        size_t heap_bytes = 0;
+        for (int i = 0; i < kControlRounds; i++) {
+            for (auto& message : messages) {
+                auto heap = HostHeapGetUsage();
+                HostHeapResetPeak();
+                websocket_->Receive(message.data(), message.size(), binary);
+                auto after = HostHeapGetUsage();
+                allocations += after.allocations - heap.allocations;
+                heap_bytes += after.peak_bytes - heap.current_bytes;
+            }
+        }
+
+        double count = (double)kControlRounds * messages.size();
+        EXPECT_EQ(control_messages_, 2 * kControlRounds * messages.size());
+        return ControlCost{std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / count,
+            allocations / count, heap_bytes / count, bytes / count};
+    }
+
+    // What starting to listen, stopping and aborting send, a message each
+    void SendControl(int index) {
+        switch (index) {
+        case 0:
+            protocol_->SendStartListening(kListeningModeAutoStop);
+            break;
+        case 1:
+            protocol_->SendStopListening();
+            break;
+        default:
+            protocol_->SendAbortSpeaking(kAbortReasonNone);
+            break;
+        }
+    }
+
+    ControlCost MeasureOutgoingControl() {
+        const int kinds = 3;
+        for (int k = 0; k < kinds; k++) {
+            SendControl(k);
+        }
+        sent_messages_ = 0;
+        sent_bytes_ = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kControlRounds; i++) {
+            for (int k = 0; k < kinds; k++) {
+                SendControl(k);
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        size_t messages = sent_messages_;
+        size_t bytes = sent_bytes_;
+
+        uint64_t allocations = 0;
+        size_t heap_bytes = 0;
+        for (int i = 0; i < kControlRounds; i++) {
+            for (int k = 0; k < kinds; k++) {
+                auto heap = HostHeapGetUsage();
+                HostHeapResetPeak();
+                SendControl(k);
+                auto after = HostHeapGetUsage();
+                allocations += after.allocations - heap.allocations;
+                heap_bytes += after.peak_bytes - heap.current_bytes;
+            }
+        }
+
+        double count = (double)kControlRounds * kinds;
+        EXPECT_EQ(messages, (size_t)count);
+        return ControlCost{std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / count,
+            allocations / count, heap_bytes / count, bytes / count};
+    }
+};
+
+TEST_F(WebsocketProtocolBenchmark, Send) {
+    for (int version : {1, 2, 3}) {
+        Open(version, 1);
+        auto cost = MeasureSend();
+        PrintCost("send v" + std::to_string(version), cost);
+        // The pooled packet is framed in a buffer that keeps its capacity, the payload is copied at most once
+        EXPECT_EQ(cost.allocations, 0) << version;
+        EXPECT_LE(cost.copied_bytes, kPayloadSize) << version;
+        EXPECT_EQ(cost.messages, 1) << version;
+        Close();
+    }
+}
+
+TEST_F(WebsocketProtocolBenchmark, Receive) {
+    for (int version : {1, 2, 3}) {
+        Open(version, 1);
+        auto cost = MeasureReceive(version, 1);
+        PrintCost("receive v" + std::to_string(version), cost);
+        // The headers are read in place, the payload is copied once into a pooled packet
+        EXPECT_EQ(cost.allocations, 0) << version;
+        EXPECT_LE(cost.copied_bytes, kPayloadSize) << version;
+        Close();
+    }
+}
+
+TEST_F(WebsocketProtocolBenchmark, AudioBatch) {
+    const double packets_per_second = 1000.0 / OPUS_FRAME_DURATION_MS;
+    for (int batch : {1, 2, 4, 8}) {
+        Open(3, batch);
+        auto send = MeasureSend();
+        auto receive = MeasureReceive(3, batch);
+        PrintCost("send batch " + std::to_string(batch), send);
+        PrintCost("receive batch " + std::to_string(batch), receive);
+        // CPU of the protocol only, the TLS record and the WebSocket frame of the real transport come once
+        // per message on top of it
+        printf("batch %d: %.1f messages/s each way, %.0f + %.0f us CPU per second of audio, up to %d ms added"
+            " latency\n", batch, send.messages * packets_per_second, send.ns * packets_per_second / 1000,
+            receive.ns * packets_per_second / 1000, (batch - 1) * OPUS_FRAME_DURATION_MS);
+        EXPECT_NEAR(send.messages, 1.0 / batch, 0.01) << batch;
+        EXPECT_NEAR(receive.messages, 1.0 / batch, 0.01) << batch;
+        EXPECT_EQ(send.allocations, 0) << batch;
+        // Each frame is copied into the batch, which is sent from where it was built
+        EXPECT_LE(send.copied_bytes, kPayloadSize) << batch;
+        EXPECT_EQ(receive.allocations, 0) << batch;
+
+        // A batch the device sends parses back into as many frames
+        echo_audio_ = true;
+        received_packets_ = 0;
+        SendPackets(batch);
+        EXPECT_EQ(received_packets_, (size_t)batch) << batch;
+        Close();
+    }
+}
+
+TEST_F(WebsocketProtocolBenchmark, ControlMessages) {
+    std::vector<std::vector<char>> json;
+    for (auto message : kJsonControl) {
+        json.emplace_back(message, message + strlen(message));
+    }
+
+    Open(3, 1, true);
+    protocol_->OnIncomingControl([this](uint8_t type, std::string&& text) {
+        control_messages_++;
+    });
+    auto binary_in = MeasureIncomingControl(MakeBinaryControl(), true);
+    auto binary_out = MeasureOutgoingControl();
+    // The server may still send JSON, the frequent messages skip the cJSON tree
+    auto reader_in = MeasureIncomingControl(json, false);
+    Close();
+
+    // Without binary control the device sends JSON, and a client without OnIncomingControl parses with cJSON
+    Open(3, 1, false);
+    protocol_->OnIncomingJson([this](const cJSON* root) {
+        control_messages_++;
+    });
+    auto cjson_in = MeasureIncomingControl(json, false);
+    auto json_out = MeasureOutgoingControl();
+
+    PrintControlCost("receive binary", binary_in);
+    PrintControlCost("receive JSON JsonReader", reader_in);
+    PrintControlCost("receive JSON cJSON", cjson_in);
+    PrintControlCost("send binary", binary_out);
+    PrintControlCost("send JSON", json_out);
+    // Only the texts longer than the small string buffer are allocated
+    EXPECT_LT(binary_in.allocations, 1);
+    EXPECT_LE(binary_in.allocations, reader_in.allocations);
+    EXPECT_LT(reader_in.allocations, cjson_in.allocations);
+    EXPECT_LT(binary_in.heap_bytes, cjson_in.heap_bytes);
+    EXPECT_LT(binary_in.wire_bytes, reader_in.wire_bytes);
+    EXPECT_LT(binary_out.allocations, json_out.allocations);
+    EXPECT_LT(binary_out.wire_bytes, json_out.wire_bytes);
+}